@@ -0,0 +1,146 @@
+#pragma once
+#include "Common.h"
+#include <cassert>
+
+// The node graph as it was before GraphT: arrays of structs, with the ports of a node, the links
+// of an output port and the live nodes kept in intrusive doubly-linked lists. Kept here only so
+// that nodegraph_stress can time GraphT against it.
+//
+// The indices are widened from u16 to u32 so that it can hold the larger benchmark graphs; the
+// layout is otherwise unchanged. updateNode and its helpers are left out, as the benchmark
+// doesn't exercise them.
+namespace baseline {
+	typedef u32 port_uid;
+	typedef u32 port_idx;
+	typedef u32 link_idx;
+	typedef u32 node_idx;
+
+	constexpr port_idx invalid_port_idx = port_idx(-1);
+	constexpr link_idx invalid_link_idx = link_idx(-1);
+	constexpr node_idx invalid_node_idx = node_idx(-1);
+
+	template <typename idx_type>
+	struct handle {
+		idx_type idx = idx_type(-1);
+		u16 fingerprint = u16(-1);
+
+		handle() {}
+		handle(idx_type idx, u16 fingerprint)
+			: idx(idx)
+			, fingerprint(fingerprint)
+		{}
+
+		bool valid() const {
+			return idx != idx_type(-1);
+		}
+
+		bool operator==(const handle& other) const {
+			return idx == other.idx && fingerprint == other.fingerprint;
+		}
+		bool operator!=(const handle& other) const {
+			return !(*this == other);
+		}
+	};
+
+	typedef handle<port_idx> port_handle;
+	typedef handle<link_idx> link_handle;
+	typedef handle<node_idx> node_handle;
+
+	struct Port {
+		port_uid uid = 0;
+		node_idx node = invalid_node_idx;
+		link_idx link = invalid_link_idx;		// head of the outgoing links of an output port
+		port_idx nextInNode = invalid_port_idx;
+		port_idx prevInNode = invalid_port_idx;
+		u16 fingerprint = 0;
+	};
+
+	struct Link {
+		port_idx srcPort = invalid_port_idx;
+		port_idx dstPort = invalid_port_idx;
+		link_idx nextInSrcPort = invalid_link_idx;
+		link_idx prevInSrcPort = invalid_link_idx;
+		u16 fingerprint = 0;
+	};
+
+	struct Node {
+		port_idx firstInputPort = invalid_port_idx;
+		port_idx firstOutputPort = invalid_port_idx;
+		node_idx nextNode = invalid_node_idx;
+		node_idx prevNode = invalid_node_idx;
+		u16 fingerprint = 0;
+	};
+
+	struct NodeDesc
+	{
+		vector<port_uid> inputs;
+		vector<port_uid> outputs;
+	};
+
+	struct Graph {
+		vector<Port> ports;
+		vector<Link> links;
+		vector<Node> nodes;
+
+		node_idx firstLiveNode = invalid_node_idx;
+
+		vector<port_handle> deadPorts;
+		vector<link_handle> deadLinks;
+		vector<node_handle> deadNodes;
+
+		template <typename Fn>
+		void iterNodes(Fn fn) const {
+			node_idx next;
+			for (node_idx it = firstLiveNode; it != invalid_node_idx; it = next) {
+				next = nodes[it].nextNode;
+				fn(node_handle(it, nodes[it].fingerprint));
+
+				// Removal of the same element is not supported during iteration
+				assert(next == nodes[it].nextNode);
+			}
+		}
+
+		template <typename Fn>
+		void iterNodeInputPorts(node_handle nodeHandle, Fn fn) const {
+			const Node& node = nodes[nodeHandle.idx];
+			assert(node.fingerprint == nodeHandle.fingerprint);
+
+			port_idx next;
+			for (port_idx it = node.firstInputPort; it != invalid_port_idx; it = next) {
+				next = ports[it].nextInNode;
+				fn(port_handle(it, ports[it].fingerprint));
+
+				// Removal of the same element is not supported during iteration
+				assert(next == ports[it].nextInNode);
+			}
+		}
+
+		template <typename Fn>
+		void iterNodeOutputPorts(node_handle nodeHandle, Fn fn) const {
+			const Node& node = nodes[nodeHandle.idx];
+			assert(node.fingerprint == nodeHandle.fingerprint);
+
+			port_idx next;
+			for (port_idx it = node.firstOutputPort; it != invalid_port_idx; it = next) {
+				next = ports[it].nextInNode;
+				fn(port_handle(it, ports[it].fingerprint));
+
+				// Removal of the same element is not supported during iteration
+				assert(next == ports[it].nextInNode);
+			}
+		}
+
+		port_handle addPort(node_idx node, port_uid uid);
+
+		void addInputPortToNode(Node& node, port_idx port);
+		void addOutputPortToNode(Node& node, port_idx port);
+
+		void addLink(port_idx srcPort, port_idx dstPort);
+
+		void removeLink(link_idx idx);
+		void removePort(port_idx idx);
+		void removeNode(node_handle nodeHandle);
+
+		node_handle addNode(NodeDesc& desc);
+	};
+}
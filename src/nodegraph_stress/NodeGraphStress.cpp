@@ -0,0 +1,795 @@
+// Stress test and benchmark of nodegraph::GraphT, without GL or a window.
+//
+// Runs random sequences of node, port and link edits, and after each one compares the graph with
+// a plain reference model, where nodes are sets of ports and cycles are found by breadth-first
+// search over adjacency sets. GraphT::validate is checked along the way. Then the same edits are
+// timed at a range of graph sizes, without the model, and each kind of operation on its own, to
+// compare the 32-bit layout with the 16-bit one, and both with the linked-list graph GraphT
+// replaced (BaselineGraph.h).
+//
+// Exits with a non-zero code on the first mismatch.
+
+#include "NodeGraph.h"
+#include "BaselineGraph.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <new>
+#include <random>
+#include <set>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Bytes allocated through operator new, for the memory cost of the graph and its operations
+struct AllocStats {
+	u64 allocatedBytes = 0;
+	u64 liveBytes = 0;
+};
+
+static AllocStats g_allocStats;
+
+// Each allocation is prefixed with its size, so that delete can keep liveBytes current. The header
+// is found through an integer rather than pointer arithmetic: once delete is inlined, GCC would
+// otherwise see the pointer from new being indexed out of bounds and passed to free.
+static const size_t allocHeaderSize = 16;
+
+void* operator new(size_t size)
+{
+	void* const block = malloc(size + allocHeaderSize);
+	if (!block) {
+		throw std::bad_alloc();
+	}
+
+	memcpy(block, &size, sizeof(size));
+	g_allocStats.allocatedBytes += size;
+	g_allocStats.liveBytes += size;
+	return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(block) + allocHeaderSize);
+}
+
+void operator delete(void* ptr) noexcept
+{
+	if (ptr) {
+		void* const block = reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(ptr) - allocHeaderSize);
+
+		size_t size;
+		memcpy(&size, block, sizeof(size));
+		g_allocStats.liveBytes -= size;
+		free(block);
+	}
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+	operator delete(ptr);
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	operator delete(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+	operator delete(ptr);
+}
+
+namespace {
+	typedef std::chrono::steady_clock Clock;
+	using nodegraph::port_uid;
+	using nodegraph::NodeDesc;
+	using nodegraph::IdxRange;
+
+	static double secondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	// The graph as plain sets, indexed by the graph's node slots
+	struct Model {
+		static const u32 noNode = u32(-1);
+
+		struct Source {
+			u32 node;
+			port_uid uid;
+		};
+
+		struct Node {
+			bool alive = false;
+			u32 fingerprint = 0;
+			std::map<port_uid, Source> inputs;		// node is noNode if the input isn't linked
+			std::map<port_uid, u32> outputs;		// number of links from the output
+		};
+
+		vector<Node> nodes;
+		vector<std::multiset<u32>> downstream;		// one entry per link, by source node
+		size_t liveCount = 0;
+
+		void addNode(u32 idx, u32 fingerprint, const NodeDesc& desc)
+		{
+			if (idx >= nodes.size()) {
+				nodes.resize(idx + 1);
+				downstream.resize(idx + 1);
+			}
+
+			Node& node = nodes[idx];
+			node = Node();
+			node.alive = true;
+			node.fingerprint = fingerprint;
+
+			for (const port_uid uid : desc.inputs) {
+				node.inputs[uid] = { noNode, 0 };
+			}
+
+			for (const port_uid uid : desc.outputs) {
+				node.outputs[uid] = 0;
+			}
+
+			++liveCount;
+		}
+
+		void unlink(u32 dstNode, port_uid dstUid)
+		{
+			Source& source = nodes[dstNode].inputs[dstUid];
+			if (source.node != noNode) {
+				--nodes[source.node].outputs[source.uid];
+				downstream[source.node].erase(downstream[source.node].find(dstNode));
+				source.node = noNode;
+			}
+		}
+
+		void link(u32 srcNode, port_uid srcUid, u32 dstNode, port_uid dstUid)
+		{
+			unlink(dstNode, dstUid);
+			nodes[dstNode].inputs[dstUid] = { srcNode, srcUid };
+			++nodes[srcNode].outputs[srcUid];
+			downstream[srcNode].insert(dstNode);
+		}
+
+		void removeNode(u32 idx)
+		{
+			Node& node = nodes[idx];
+			for (auto& input : node.inputs) {
+				unlink(idx, input.first);
+			}
+
+			// Copied, as unlinking erases from the set
+			const std::set<u32> targets(downstream[idx].begin(), downstream[idx].end());
+			for (const u32 dst : targets) {
+				for (auto& input : nodes[dst].inputs) {
+					if (input.second.node == idx) {
+						unlink(dst, input.first);
+					}
+				}
+			}
+
+			node = Node();
+			--liveCount;
+		}
+
+		// Ports which aren't in the desc go away unless they are linked; missing ones are added
+		void updateNode(u32 idx, const NodeDesc& desc)
+		{
+			Node& node = nodes[idx];
+
+			for (auto it = node.inputs.begin(); it != node.inputs.end(); ) {
+				const bool referenced = std::find(desc.inputs.begin(), desc.inputs.end(), it->first) != desc.inputs.end();
+				it = (!referenced && it->second.node == noNode) ? node.inputs.erase(it) : std::next(it);
+			}
+
+			for (auto it = node.outputs.begin(); it != node.outputs.end(); ) {
+				const bool referenced = std::find(desc.outputs.begin(), desc.outputs.end(), it->first) != desc.outputs.end();
+				it = (!referenced && 0 == it->second) ? node.outputs.erase(it) : std::next(it);
+			}
+
+			for (const port_uid uid : desc.inputs) {
+				node.inputs.insert({ uid, { noNode, 0 } });
+			}
+
+			for (const port_uid uid : desc.outputs) {
+				node.outputs.insert({ uid, 0 });
+			}
+		}
+
+		bool reaches(u32 from, u32 to) const
+		{
+			vector<u8> visited(nodes.size(), 0);
+			vector<u32> queue(1, from);
+			visited[from] = 1;
+
+			for (size_t i = 0; i < queue.size(); ++i) {
+				if (queue[i] == to) {
+					return true;
+				}
+
+				for (const u32 next : downstream[queue[i]]) {
+					if (!visited[next]) {
+						visited[next] = 1;
+						queue.push_back(next);
+					}
+				}
+			}
+
+			return false;
+		}
+	};
+
+	struct OpCounts {
+		u64 ops = 0;
+		u64 linksAccepted = 0;
+		u64 linksRejected = 0;
+	};
+
+	// Random edits of a graph which is kept at about targetNodeCount nodes. Links mostly go between
+	// nodes close together in liveNodes, so that chains form and some links close cycles.
+	template <typename GraphType>
+	struct StressRun {
+		typedef typename GraphType::node_idx node_idx;
+		typedef typename GraphType::port_idx port_idx;
+		typedef typename GraphType::link_idx link_idx;
+		typedef typename GraphType::node_handle node_handle;
+
+		// Ports of a node are drawn from this many UIDs, at most maxInputs inputs and maxOutputs outputs
+		static const u32 portUidCount = 6;
+		static const u32 maxInputs = 3;
+		static const u32 maxOutputs = 2;
+		static const u32 linkWindow = 32;
+
+		GraphType graph;
+		Model* model = nullptr;		// checked after every op if set
+		std::mt19937 rng;
+		size_t targetNodeCount;
+		OpCounts counts;
+		std::string error;
+
+		NodeDesc desc;
+		vector<port_uid> uidPool;
+
+		StressRun(u32 seed, size_t targetNodeCount)
+			: rng(seed)
+			, targetNodeCount(targetNodeCount)
+		{}
+
+		u32 random(u32 count) {
+			return u32(rng() % count);
+		}
+
+		void randomDesc()
+		{
+			uidPool.clear();
+			for (port_uid uid = 1; uid <= portUidCount; ++uid) {
+				uidPool.push_back(uid);
+			}
+
+			std::shuffle(uidPool.begin(), uidPool.end(), rng);
+			desc.inputs.assign(uidPool.begin(), uidPool.begin() + random(maxInputs + 1));
+
+			std::shuffle(uidPool.begin(), uidPool.end(), rng);
+			desc.outputs.assign(uidPool.begin(), uidPool.begin() + random(maxOutputs + 1));
+		}
+
+		node_idx randomLiveNode() {
+			return graph.liveNodes[random(u32(graph.liveNodes.size()))];
+		}
+
+		bool fail(const char* what, size_t idx)
+		{
+			char message[256];
+			snprintf(message, sizeof(message), "%s (%u) after %llu ops", what, unsigned(idx), counts.ops);
+			error = message;
+			return false;
+		}
+
+		void addNode()
+		{
+			randomDesc();
+			const node_handle h = graph.addNode(desc);
+
+			if (model) {
+				model->addNode(h.idx, h.fingerprint, desc);
+			}
+		}
+
+		void removeNode()
+		{
+			const node_idx idx = randomLiveNode();
+			graph.removeNode(node_handle(idx, graph.nodes.fingerprint[idx]));
+
+			if (model) {
+				model->removeNode(idx);
+			}
+		}
+
+		void updateNode()
+		{
+			const node_idx idx = randomLiveNode();
+			randomDesc();
+			graph.updateNode(node_handle(idx, graph.nodes.fingerprint[idx]), desc);
+
+			if (model) {
+				model->updateNode(idx, desc);
+			}
+		}
+
+		bool addLink()
+		{
+			const size_t liveCount = graph.liveNodes.size();
+			const size_t srcPos = random(u32(liveCount));
+			const size_t dstPos = (srcPos + liveCount - linkWindow / 2 + random(linkWindow + 1)) % liveCount;
+			const node_idx srcNode = graph.liveNodes[srcPos];
+			const node_idx dstNode = graph.liveNodes[dstPos];
+
+			const IdxRange<port_idx> outputs = graph.getOutputPorts(srcNode);
+			const IdxRange<port_idx> inputs = graph.getInputPorts(dstNode);
+			if (outputs.empty() || inputs.empty()) {
+				return true;
+			}
+
+			const port_idx srcPort = outputs[random(u32(outputs.size()))];
+			const port_idx dstPort = inputs[random(u32(inputs.size()))];
+
+			if (model) {
+				const bool cycle = srcNode == dstNode || model->reaches(dstNode, srcNode);
+				if (graph.wouldCreateCycle(srcNode, dstNode) != cycle) {
+					return fail("wouldCreateCycle disagrees with the model", srcNode);
+				}
+
+				if (graph.addLink(srcPort, dstPort) == cycle) {
+					return fail("addLink disagrees with the model", srcNode);
+				}
+
+				if (!cycle) {
+					model->link(srcNode, graph.ports.uid[srcPort], dstNode, graph.ports.uid[dstPort]);
+				}
+
+				++(cycle ? counts.linksRejected : counts.linksAccepted);
+			}
+			else {
+				++(graph.addLink(srcPort, dstPort) ? counts.linksAccepted : counts.linksRejected);
+			}
+
+			return true;
+		}
+
+		void removeLink()
+		{
+			const node_idx node = randomLiveNode();
+			const IdxRange<port_idx> inputs = graph.getInputPorts(node);
+			if (inputs.empty()) {
+				return;
+			}
+
+			const port_idx port = inputs[random(u32(inputs.size()))];
+			if (graph.ports.link[port] != GraphType::invalid_link_idx) {
+				graph.removeLink(graph.ports.link[port]);
+
+				if (model) {
+					model->unlink(node, graph.ports.uid[port]);
+				}
+			}
+		}
+
+		bool step()
+		{
+			const size_t liveCount = graph.liveNodes.size();
+			const u32 r = random(100);
+			bool ok = true;
+
+			if (liveCount < targetNodeCount * 9 / 10 + 1) {
+				addNode();
+			} else if (liveCount > targetNodeCount * 11 / 10) {
+				removeNode();
+			} else if (r < 10) {
+				addNode();
+			} else if (r < 20) {
+				removeNode();
+			} else if (r < 35) {
+				updateNode();
+			} else if (r < 55) {
+				removeLink();
+			} else {
+				ok = addLink();
+			}
+
+			++counts.ops;
+			return ok;
+		}
+
+		bool checkAgainstModel()
+		{
+			std::string validateError;
+			if (!graph.validate(&validateError)) {
+				char suffix[64];
+				snprintf(suffix, sizeof(suffix), " after %llu ops", counts.ops);
+				error = "validate: " + validateError + suffix;
+				return false;
+			}
+
+			if (graph.liveNodes.size() != model->liveCount) {
+				return fail("live node count differs from the model", graph.liveNodes.size());
+			}
+
+			for (size_t i = 0; i < model->nodes.size(); ++i) {
+				const Model::Node& node = model->nodes[i];
+				if (!node.alive) {
+					continue;
+				}
+
+				const node_idx idx = node_idx(i);
+				if (graph.nodes.livePos[idx] == GraphType::invalid_node_idx || graph.nodes.fingerprint[idx] != node.fingerprint) {
+					return fail("node missing from the graph", i);
+				}
+
+				if (graph.getInputPorts(idx).size() != node.inputs.size() || graph.getOutputPorts(idx).size() != node.outputs.size()) {
+					return fail("port count differs from the model", i);
+				}
+
+				for (const auto& input : node.inputs) {
+					const port_idx port = graph.findInputPort(idx, input.first);
+					if (port == GraphType::invalid_port_idx) {
+						return fail("input port missing from the graph", i);
+					}
+
+					const link_idx link = graph.ports.link[port];
+					if (input.second.node == Model::noNode) {
+						if (link != GraphType::invalid_link_idx) return fail("input linked in the graph only", i);
+						continue;
+					}
+
+					if (link == GraphType::invalid_link_idx) {
+						return fail("input linked in the model only", i);
+					}
+
+					const port_idx srcPort = graph.links.srcPort[link];
+					if (graph.ports.node[srcPort] != input.second.node || graph.ports.uid[srcPort] != input.second.uid) {
+						return fail("input linked to a different output", i);
+					}
+				}
+
+				for (const auto& output : node.outputs) {
+					const port_idx port = graph.findOutputPort(idx, output.first);
+					if (port == GraphType::invalid_port_idx) {
+						return fail("output port missing from the graph", i);
+					}
+
+					if (graph.getOutputLinks(port).size() != output.second) {
+						return fail("output link count differs from the model", i);
+					}
+				}
+			}
+
+			return true;
+		}
+	};
+
+	// Compares the graph with the model after every op while the graph is small, and less often
+	// as it grows, so that the whole graph isn't compared after every op
+	template <typename GraphType>
+	bool checkSeed(u32 seed, size_t targetNodeCount, size_t opCount, OpCounts *const total)
+	{
+		Model model;
+		StressRun<GraphType> run(seed, targetNodeCount);
+		run.model = &model;
+
+		const size_t checkInterval = std::max<size_t>(1, targetNodeCount / 64);
+		for (size_t i = 0; i < opCount; ++i) {
+			if (!run.step() || ((i + 1) % checkInterval == 0 && !run.checkAgainstModel())) {
+				fprintf(stderr, "FAILED: seed %u, %u nodes: %s\n", seed, unsigned(targetNodeCount), run.error.c_str());
+				return false;
+			}
+		}
+
+		if (!run.checkAgainstModel()) {
+			fprintf(stderr, "FAILED: seed %u, %u nodes: %s\n", seed, unsigned(targetNodeCount), run.error.c_str());
+			return false;
+		}
+
+		total->ops += run.counts.ops;
+		total->linksAccepted += run.counts.linksAccepted;
+		total->linksRejected += run.counts.linksRejected;
+		return true;
+	}
+
+	template <typename GraphType>
+	bool checkAgainstModel(const char* layoutName)
+	{
+		const size_t sizes[] = { 16, 64, 256, 1024 };
+		const u32 seedCount = 50;
+		const size_t opCount = 3000;
+
+		for (const size_t size : sizes) {
+			OpCounts total;
+			for (u32 seed = 1; seed <= seedCount; ++seed) {
+				if (!checkSeed<GraphType>(seed, size, opCount, &total)) {
+					return false;
+				}
+			}
+
+			printf("%-8s %6u nodes: %u seeds x %u ops match the model (%llu links accepted, %llu closed cycles)\n",
+				layoutName, unsigned(size), seedCount, unsigned(opCount), total.linksAccepted, total.linksRejected);
+		}
+
+		return true;
+	}
+
+	// Times the same random edits without the model
+	template <typename GraphType>
+	bool measureOps(const char* layoutName, size_t targetNodeCount, size_t opCount)
+	{
+		const u64 liveBytesBefore = g_allocStats.liveBytes;
+		StressRun<GraphType> run(1, targetNodeCount);
+
+		while (run.graph.liveNodes.size() < targetNodeCount) {
+			run.addNode();
+		}
+
+		const u64 allocatedBefore = g_allocStats.allocatedBytes;
+		const Clock::time_point start = Clock::now();
+		for (size_t i = 0; i < opCount; ++i) {
+			run.step();
+		}
+		const double seconds = secondsSince(start);
+		const u64 allocated = g_allocStats.allocatedBytes - allocatedBefore;
+
+		std::string error;
+		if (!run.graph.validate(&error)) {
+			fprintf(stderr, "FAILED: %u nodes: %s\n", unsigned(targetNodeCount), error.c_str());
+			return false;
+		}
+
+		printf("%-8s %6u nodes: %10.0f ops/s, %7.1f bytes allocated per op, %6.1f bytes per node\n",
+			layoutName, unsigned(targetNodeCount), opCount / seconds, double(allocated) / opCount,
+			double(g_allocStats.liveBytes - liveBytesBefore) / run.graph.liveNodes.size());
+		return true;
+	}
+
+	// What measurePhases needs beyond the calls GraphT shares with the baseline graph
+	template <typename GraphType>
+	struct PhaseOps {
+		typedef NodeDesc Desc;
+		typedef typename GraphType::port_idx port_idx;
+		typedef typename GraphType::port_handle port_handle;
+		typedef typename GraphType::node_handle node_handle;
+		static const port_idx invalid_port_idx = GraphType::invalid_port_idx;
+
+		static port_idx findPort(const GraphType& graph, node_handle node, bool isOutput, port_uid uid) {
+			return isOutput ? graph.findOutputPort(node.idx, uid) : graph.findInputPort(node.idx, uid);
+		}
+
+		static bool isLinked(const GraphType& graph, port_idx port) {
+			const typename GraphType::link_idx link = graph.ports.link[port];
+			return link != GraphType::invalid_link_idx && graph.links.srcPort[link] != GraphType::invalid_port_idx;
+		}
+
+		static bool validate(const GraphType& graph, std::string* error) {
+			return graph.validate(error);
+		}
+	};
+
+	template <>
+	struct PhaseOps<baseline::Graph> {
+		typedef baseline::NodeDesc Desc;
+		typedef baseline::port_idx port_idx;
+		typedef baseline::port_handle port_handle;
+		typedef baseline::node_handle node_handle;
+		static const port_idx invalid_port_idx = baseline::invalid_port_idx;
+
+		static port_idx findPort(const baseline::Graph& graph, node_handle node, bool isOutput, port_uid uid) {
+			const baseline::Node& n = graph.nodes[node.idx];
+			for (port_idx it = isOutput ? n.firstOutputPort : n.firstInputPort; it != invalid_port_idx; it = graph.ports[it].nextInNode) {
+				if (graph.ports[it].uid == uid) {
+					return it;
+				}
+			}
+
+			return invalid_port_idx;
+		}
+
+		static bool isLinked(const baseline::Graph& graph, port_idx port) {
+			const baseline::link_idx link = graph.ports[port].link;
+			return link != baseline::invalid_link_idx && graph.links[link].srcPort != invalid_port_idx;
+		}
+
+		// The baseline has no checks of its own
+		static bool validate(const baseline::Graph&, std::string*) {
+			return true;
+		}
+	};
+
+	// Adds nodeCount nodes, adds twice as many links, walks every input port ten times, then removes
+	// all the nodes in random order. The descs and the ports to link are picked up front, from the
+	// same seed for every layout, so that only the graph is timed. GraphT::addLink includes the cycle
+	// check and rejects the links which would close one; the baseline takes every link.
+	template <typename GraphType>
+	bool measurePhases(const char* layoutName, size_t nodeCount)
+	{
+		typedef PhaseOps<GraphType> Ops;
+		typedef typename Ops::port_idx port_idx;
+		typedef typename Ops::node_handle node_handle;
+		typedef StressRun<nodegraph::GraphT<u32, u32>> Run;
+
+		if (nodeCount * (Run::maxInputs + Run::maxOutputs) >= size_t(Ops::invalid_port_idx)) {
+			printf("%-8s %6u nodes: doesn't fit the index space\n", layoutName, unsigned(nodeCount));
+			return true;
+		}
+
+		Run run(1, nodeCount);
+		vector<typename Ops::Desc> descs(nodeCount);
+		for (typename Ops::Desc& desc : descs) {
+			run.randomDesc();
+			desc.inputs = run.desc.inputs;
+			desc.outputs = run.desc.outputs;
+		}
+
+		// Pairs of (output, input) as positions in descs and UIDs; between nodes close together in
+		// the order they're added, like StressRun::addLink
+		struct LinkPlan {
+			u32 srcNode, dstNode;
+			port_uid srcUid, dstUid;
+		};
+
+		vector<LinkPlan> linkPlan;
+		const size_t linkAttempts = nodeCount * 2;
+		for (size_t i = 0; i < linkAttempts; ++i) {
+			const u32 srcNode = run.random(u32(nodeCount));
+			const u32 dstNode = u32((srcNode + nodeCount - Run::linkWindow / 2 + run.random(Run::linkWindow + 1)) % nodeCount);
+			const typename Ops::Desc& src = descs[srcNode];
+			const typename Ops::Desc& dst = descs[dstNode];
+			if (!src.outputs.empty() && !dst.inputs.empty()) {
+				const port_uid srcUid = src.outputs[run.random(u32(src.outputs.size()))];
+				const port_uid dstUid = dst.inputs[run.random(u32(dst.inputs.size()))];
+				linkPlan.push_back({ srcNode, dstNode, srcUid, dstUid });
+			}
+		}
+
+		const u64 liveBytesBefore = g_allocStats.liveBytes;
+		GraphType graph;
+		vector<node_handle> nodes(nodeCount);
+
+		Clock::time_point start = Clock::now();
+		for (size_t i = 0; i < nodeCount; ++i) {
+			nodes[i] = graph.addNode(descs[i]);
+		}
+		const double addSeconds = secondsSince(start);
+
+		vector<std::pair<port_idx, port_idx>> linkPorts(linkPlan.size());
+		for (size_t i = 0; i < linkPlan.size(); ++i) {
+			const LinkPlan& plan = linkPlan[i];
+			linkPorts[i].first = Ops::findPort(graph, nodes[plan.srcNode], true, plan.srcUid);
+			linkPorts[i].second = Ops::findPort(graph, nodes[plan.dstNode], false, plan.dstUid);
+		}
+
+		start = Clock::now();
+		for (const std::pair<port_idx, port_idx>& ports : linkPorts) {
+			graph.addLink(ports.first, ports.second);
+		}
+		const double linkSeconds = secondsSince(start);
+		const double bytesPerNode = double(g_allocStats.liveBytes - liveBytesBefore) / nodeCount;
+
+		const int iterateRepeats = 10;
+		size_t portsVisited = 0;
+		size_t linkedInputs = 0;
+		start = Clock::now();
+		for (int i = 0; i < iterateRepeats; ++i) {
+			graph.iterNodes([&](node_handle node) {
+				graph.iterNodeInputPorts(node, [&](typename Ops::port_handle port) {
+					linkedInputs += Ops::isLinked(graph, port.idx);
+					++portsVisited;
+				});
+			});
+		}
+		const double iterateSeconds = secondsSince(start);
+
+		std::string error;
+		if (!Ops::validate(graph, &error)) {
+			fprintf(stderr, "FAILED: %u nodes: %s\n", unsigned(nodeCount), error.c_str());
+			return false;
+		}
+
+		std::shuffle(nodes.begin(), nodes.end(), run.rng);
+		start = Clock::now();
+		for (const node_handle node : nodes) {
+			graph.removeNode(node);
+		}
+		const double removeSeconds = secondsSince(start);
+
+		printf("%-8s %6u nodes: add %6.1f ns/node, link %6.1f ns/link, iterate %5.2f ns/port, remove %6.1f ns/node, %6.1f bytes per node (%u%% of inputs linked)\n",
+			layoutName, unsigned(nodeCount),
+			addSeconds * 1e9 / nodeCount,
+			linkSeconds * 1e9 / std::max<size_t>(1, linkPorts.size()),
+			iterateSeconds * 1e9 / std::max<size_t>(1, portsVisited),
+			removeSeconds * 1e9 / nodeCount,
+			bytesPerNode,
+			unsigned(100 * linkedInputs / std::max<size_t>(1, portsVisited)));
+		return true;
+	}
+
+	// Links one output port to the inputs of linkCount other nodes, as the Wide synthetic graph
+	// does, then removes the links in random order
+	template <typename GraphType>
+	bool measureFanOut(const char* layoutName, size_t linkCount)
+	{
+		typedef typename GraphType::link_idx link_idx;
+
+		if (linkCount + 1 >= size_t(GraphType::invalid_port_idx)) {
+			printf("%-8s %6u links from one port: doesn't fit the index space\n", layoutName, unsigned(linkCount));
+			return true;
+		}
+
+		GraphType graph;
+		NodeDesc desc;
+		desc.outputs.push_back(1);
+		const typename GraphType::node_handle srcNode = graph.addNode(desc);
+		const typename GraphType::port_idx srcPort = graph.findOutputPort(srcNode.idx, 1);
+
+		desc.outputs.clear();
+		desc.inputs.push_back(1);
+		vector<typename GraphType::port_idx> dstPorts(linkCount);
+		for (size_t i = 0; i < linkCount; ++i) {
+			dstPorts[i] = graph.findInputPort(graph.addNode(desc).idx, 1);
+		}
+
+		Clock::time_point start = Clock::now();
+		for (const typename GraphType::port_idx dstPort : dstPorts) {
+			graph.addLink(srcPort, dstPort);
+		}
+		const double linkSeconds = secondsSince(start);
+
+		std::string error;
+		if (!graph.validate(&error)) {
+			fprintf(stderr, "FAILED: %u links from one port: %s\n", unsigned(linkCount), error.c_str());
+			return false;
+		}
+
+		std::shuffle(dstPorts.begin(), dstPorts.end(), std::mt19937(1));
+		start = Clock::now();
+		for (const typename GraphType::port_idx dstPort : dstPorts) {
+			const link_idx link = graph.ports.link[dstPort];
+			graph.removeLink(link);
+		}
+		const double unlinkSeconds = secondsSince(start);
+
+		printf("%-8s %6u links from one port: link %8.3f ms, unlink %8.3f ms\n",
+			layoutName, unsigned(linkCount), linkSeconds * 1e3, unlinkSeconds * 1e3);
+		return true;
+	}
+}
+
+int main()
+{
+	typedef nodegraph::GraphT<u32, u32> Graph32;
+	typedef nodegraph::GraphT<u16, u16> Graph16;
+
+	if (!checkAgainstModel<Graph32>("u32") || !checkAgainstModel<Graph16>("u16")) {
+		return 1;
+	}
+
+	const size_t sizes[] = { 1000, 10000, 100000 };
+	for (const size_t size : sizes) {
+		if (!measureOps<Graph32>("u32", size, 1000000)) {
+			return 1;
+		}
+	}
+
+	for (const size_t size : sizes) {
+		if (!measurePhases<baseline::Graph>("baseline", size) || !measurePhases<Graph32>("u32", size) || !measurePhases<Graph16>("u16", size)) {
+			return 1;
+		}
+	}
+
+	const size_t fanOuts[] = { 10000, 50000, 100000 };
+	for (const size_t fanOut : fanOuts) {
+		if (!measureFanOut<Graph32>("u32", fanOut) || !measureFanOut<Graph16>("u16", fanOut)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,418 @@
+#include "EditorLink.h"
+#include "ShaderRegistry.h"
+#include "Shader.h"
+
+#include <rapidjson/document.h>
+#include <rapidjson/writer.h>
+#include <rapidjson/stringbuffer.h>
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+	// AF_UNIX is available since Windows 10 1803
+	#define VC_EXTRALEAN
+	#define WIN32_LEAN_AND_MEAN
+	#include <winsock2.h>
+	#include <afunix.h>
+
+	typedef SOCKET Socket;
+	const Socket invalidSocket = INVALID_SOCKET;
+	const int sendFlags = 0;
+
+	static void closeSocket(Socket s) { closesocket(s); }
+#else
+	#include <sys/socket.h>
+	#include <sys/select.h>
+	#include <sys/un.h>
+	#include <unistd.h>
+
+	typedef int Socket;
+	const Socket invalidSocket = -1;
+	const int sendFlags = MSG_NOSIGNAL;	// a closed editor shouldn't take RenderToy down with SIGPIPE
+
+	static void closeSocket(Socket s) { close(s); }
+#endif
+
+namespace EditorLink {
+	struct Client {
+		Socket socket;
+		u32 id;
+		std::string received;	// link thread only
+	};
+
+	struct Message {
+		u32 clientId;
+		std::string text;
+	};
+
+	// Sources are big and arrive on every keystroke, but anything above this is surely garbage
+	const size_t maxMessageSize = 64 << 20;
+
+	std::string			socketPath;
+	Socket				listenSocket = invalidSocket;
+	std::thread			linkThread;
+	std::atomic<bool>	threadStopping;
+	std::atomic<void (*)()>	messageNotify(nullptr);
+
+	// Clients are only added and removed by the link thread, under the mutex.
+	// The main thread sends replies under it, and takes the received messages.
+	std::mutex			mutex;
+	vector<Client>		clients;
+	vector<Message>		inbox;
+	u32					nextClientId = 1;
+
+	// Splits the received data into messages; false if the client should be dropped
+	static bool receive(Client& client, const char* data, size_t size)
+	{
+		client.received.append(data, size);
+
+		bool received = false;
+		size_t messageStart = 0;
+		for (size_t end; (end = client.received.find('\n', messageStart)) != std::string::npos; messageStart = end + 1) {
+			if (end > messageStart) {
+				std::lock_guard<std::mutex> lock(mutex);
+				inbox.push_back({ client.id, client.received.substr(messageStart, end - messageStart) });
+				received = true;
+			}
+		}
+
+		void (*const notify)() = messageNotify.load();
+		if (received && notify) {
+			notify();
+		}
+
+		client.received.erase(0, messageStart);
+		return client.received.size() <= maxMessageSize;
+	}
+
+	static void threadFunc()
+	{
+		vector<char> buffer(64 * 1024);
+
+		while (!threadStopping) {
+			fd_set readable;
+			FD_ZERO(&readable);
+			FD_SET(listenSocket, &readable);
+
+			Socket maxSocket = listenSocket;
+			for (const Client& client : clients) {
+				FD_SET(client.socket, &readable);
+				maxSocket = std::max(maxSocket, client.socket);
+			}
+
+			// Wakes up now and then to check threadStopping
+			timeval timeout = { 0, 100 * 1000 };
+			if (select(int(maxSocket + 1), &readable, nullptr, nullptr, &timeout) <= 0) {
+				continue;
+			}
+
+			if (FD_ISSET(listenSocket, &readable)) {
+				const Socket s = accept(listenSocket, nullptr, nullptr);
+				if (s != invalidSocket) {
+					std::lock_guard<std::mutex> lock(mutex);
+					clients.push_back({ s, nextClientId++ });
+				}
+			}
+
+			for (size_t i = 0; i < clients.size(); ) {
+				Client& client = clients[i];
+				bool alive = true;
+
+				if (FD_ISSET(client.socket, &readable)) {
+					const int bytes = recv(client.socket, buffer.data(), int(buffer.size()), 0);
+					alive = bytes > 0 && receive(client, buffer.data(), size_t(bytes));
+				}
+
+				if (alive) {
+					++i;
+				}
+				else {
+					std::lock_guard<std::mutex> lock(mutex);
+					closeSocket(client.socket);
+					clients.erase(clients.begin() + i);
+				}
+			}
+		}
+	}
+
+	static void shutdownSockets()
+	{
+		if (listenSocket != invalidSocket) {
+			closeSocket(listenSocket);
+			listenSocket = invalidSocket;
+		}
+
+		for (const Client& client : clients) {
+			closeSocket(client.socket);
+		}
+		clients.clear();
+
+#ifdef _WIN32
+		WSACleanup();
+#endif
+	}
+
+	// True if another instance is accepting connections on the socket
+	static bool isListenedOn(const sockaddr_un& addr)
+	{
+		const Socket probe = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (invalidSocket == probe) {
+			return false;
+		}
+
+		const bool connected = connect(probe, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0;
+		closeSocket(probe);
+
+		return connected;
+	}
+
+	std::string getDefaultSocketPath()
+	{
+#ifdef _WIN32
+		char tempDir[MAX_PATH + 1];
+		const DWORD length = GetTempPathA(sizeof(tempDir), tempDir);
+
+		// GetTempPath leaves the trailing backslash in
+		return (length > 0 ? std::string(tempDir, length) : std::string(".\\")) + "rendertoy.sock";
+#else
+		const char* const tempDir = getenv("TMPDIR");
+		std::string result = tempDir && *tempDir ? tempDir : "/tmp";
+		if (result.back() != '/') {
+			result += '/';
+		}
+
+		return result + "rendertoy.sock";
+#endif
+	}
+
+	bool start(const char* path)
+	{
+		sockaddr_un addr = {};
+		addr.sun_family = AF_UNIX;
+		if (strlen(path) >= sizeof(addr.sun_path)) {
+			printf("EditorLink: socket path too long: %s\n", path);
+			return false;
+		}
+
+		strcpy(addr.sun_path, path);
+
+#ifdef _WIN32
+		WSADATA wsaData;
+		if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+			printf("EditorLink: WSAStartup failed\n");
+			return false;
+		}
+#endif
+
+		// The editor stays connected to whichever instance got there first
+		if (isListenedOn(addr)) {
+			printf("EditorLink: another instance is listening on %s\n", path);
+			shutdownSockets();
+			return false;
+		}
+
+		// Left behind by an instance which didn't shut down cleanly
+		remove(path);
+
+		listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (invalidSocket == listenSocket
+			|| bind(listenSocket, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0
+			|| listen(listenSocket, 4) != 0)
+		{
+			printf("EditorLink: could not listen on %s\n", path);
+			shutdownSockets();
+			return false;
+		}
+
+		socketPath = path;
+		threadStopping = false;
+		linkThread = std::thread(&threadFunc);
+
+		return true;
+	}
+
+	void stop()
+	{
+		if (!linkThread.joinable()) {
+			return;
+		}
+
+		threadStopping = true;
+		linkThread.join();
+
+		shutdownSockets();
+		inbox.clear();
+		remove(socketPath.c_str());
+	}
+
+	void setMessageNotify(void (*notify)())
+	{
+		messageNotify = notify;
+	}
+
+	static void sendToClient(u32 clientId, const char* data, size_t size)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto client = std::find_if(clients.begin(), clients.end(), [clientId](const Client& c) { return c.id == clientId; });
+		if (client == clients.end()) {
+			return;
+		}
+
+		// Replies are small, and the editor is always reading
+		while (size > 0) {
+			const int sent = send(client->socket, data, int(size), sendFlags);
+			if (sent <= 0) {
+				return;
+			}
+
+			data += sent;
+			size -= size_t(sent);
+		}
+	}
+
+	struct Request {
+		u32 clientId;
+		s64 id;
+		std::string path;
+		shared_ptr<const vector<char>> source;	// null for reverts
+	};
+
+	static bool parseRequest(const Message& message, Request *const request)
+	{
+		rapidjson::Document doc;
+		doc.Parse(message.text.c_str(), message.text.size());
+
+		if (doc.HasParseError() || !doc.IsObject() || !doc.HasMember("type") || !doc["type"].IsString()
+			|| !doc.HasMember("path") || !doc["path"].IsString())
+		{
+			printf("EditorLink: malformed message\n");
+			return false;
+		}
+
+		request->clientId = message.clientId;
+		request->id = doc.HasMember("id") && doc["id"].IsInt64() ? doc["id"].GetInt64() : 0;
+		request->path = doc["path"].GetString();
+
+		const std::string type = doc["type"].GetString();
+		if ("source" == type && doc.HasMember("source") && doc["source"].IsString()) {
+			const rapidjson::Value& source = doc["source"];
+			shared_ptr<vector<char>> text = make_shared<vector<char>>(source.GetString(), source.GetString() + source.GetStringLength());
+			text->push_back('\0');
+			request->source = text;
+			return true;
+		}
+		else if ("revert" == type) {
+			request->source = nullptr;
+			return true;
+		}
+
+		printf("EditorLink: unknown message '%s'\n", type.c_str());
+		return false;
+	}
+
+	static void reply(const Request& request, const vector<ShaderCompileError>& errors)
+	{
+		rapidjson::StringBuffer sb;
+		rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
+
+		writer.StartObject();
+		writer.Key("type");
+		writer.String("errors");
+		writer.Key("path");
+		writer.String(request.path.c_str());
+		writer.Key("id");
+		writer.Int64(request.id);
+
+		writer.Key("errors");
+		writer.StartArray();
+		for (const ShaderCompileError& error : errors) {
+			writer.StartObject();
+			writer.Key("file");
+			writer.String(error.file.c_str());
+			writer.Key("line");
+			writer.Int(error.line);
+			writer.Key("column");
+			writer.Int(error.column);
+			writer.Key("message");
+			writer.String(error.message.c_str());
+			writer.EndObject();
+		}
+		writer.EndArray();
+
+		writer.EndObject();
+
+		std::string text(sb.GetString(), sb.GetSize());
+		text += '\n';
+		sendToClient(request.clientId, text.data(), text.size());
+	}
+
+	static void handleRequest(const Request& request)
+	{
+		vector<std::string> errorLogs;
+
+		const vector<shared_ptr<ComputeShader>> shaders = ShaderRegistry::overrideSource(request.path, request.source);
+		for (const shared_ptr<ComputeShader>& shader : shaders) {
+			errorLogs.push_back(shader->m_errorLog);
+		}
+
+		if (shaders.empty() && request.source) {
+			// Not used by any pass; compiled anyway so that the editor gets the errors
+			ComputeShader scratch(request.path);
+			scratch.m_sourceOverride = request.source;
+			scratch.reload();
+			errorLogs.push_back(scratch.m_errorLog);
+		}
+
+		// Shaders which only differ in preprocessor options tend to report the same errors
+		vector<ShaderCompileError> errors;
+		for (const std::string& log : errorLogs) {
+			for (ShaderCompileError& error : parseCompileErrors(log, request.path)) {
+				auto same = std::find_if(errors.begin(), errors.end(), [&](const ShaderCompileError& e) {
+					return e.line == error.line && e.column == error.column && e.message == error.message;
+				});
+
+				if (same == errors.end()) {
+					errors.push_back(std::move(error));
+				}
+			}
+		}
+
+		reply(request, errors);
+	}
+
+	void update()
+	{
+		vector<Message> messages;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			messages.swap(inbox);
+		}
+
+		vector<Request> requests;
+		for (const Message& message : messages) {
+			Request request;
+			if (parseRequest(message, &request)) {
+				requests.push_back(std::move(request));
+			}
+		}
+
+		// Each keystroke sends the whole buffer, so when the editor gets ahead of the compiler,
+		// only the latest source of each file is worth compiling. The editor ignores stale replies.
+		for (size_t i = 0; i < requests.size(); ++i) {
+			auto newer = std::find_if(requests.begin() + i + 1, requests.end(), [&](const Request& r) {
+				return r.path == requests[i].path;
+			});
+
+			if (newer == requests.end()) {
+				handleRequest(requests[i]);
+			}
+		}
+	}
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "Common.h"
+
+#include <string>
+
+// Lets an editor stream unsaved shader sources over a local Unix domain socket, and get structured
+// compile errors back without anything going through the disk. Messages are single lines of JSON:
+//
+//   editor:		{"type": "source", "path": "...", "source": "...", "id": 1}
+//   editor:		{"type": "revert", "path": "...", "id": 2}	(goes back to the file on disk)
+//   RenderToy:		{"type": "errors", "path": "...", "id": 1,
+//					 "errors": [{"file": "...", "line": 12, "column": 1, "message": "..."}]}
+//
+// Saved files are still picked up by the FileWatcher, and their errors still written to the
+// .errors files, for editors which don't connect.
+namespace EditorLink {
+	// <temp dir>/rendertoy.sock
+	std::string getDefaultSocketPath();
+
+	// Returns false if the socket couldn't be created. Everything else keeps working without it.
+	bool start(const char* socketPath);
+	void stop();
+
+	// Called on the link thread whenever a message arrives for update, e.g. to wake up a main
+	// loop which sleeps while idle. Null to stop calling it.
+	void setMessageNotify(void (*notify)());
+
+	// Compiles the sources received since the last call and replies with the errors.
+	// Call once per frame, after ShaderRegistry::update.
+	void update();
+}
@@ -1,390 +1,723 @@
 #include "Common.h"
 #include "FileWatcher.h"
+#include "FileUtil.h"
+#include "Hash.h"
+#include "SpscQueue.h"
 
 #include <thread>
 #include <string>
 #include <mutex>
 #include <chrono>
+#include <atomic>
 #include <algorithm>
+#include <unordered_map>
 #include <cassert>
 
+#ifdef __linux__
+	#include <sys/inotify.h>
+	#include <sys/eventfd.h>
+	#include <poll.h>
+	#include <unistd.h>
+	#include <limits.h>
+	#include <stdlib.h>
+	#include <sys/stat.h>
+#endif
+
+// The main thread and the watcher thread share only two things: the list of requested watches,
+// which the watcher copies under a short-lived lock whenever it changes, and a lock-free queue
+// of the ids of changed files going the other way. All file I/O happens on the watcher thread
+// without any lock held.
 namespace FileWatcher {
-	#define	MD5_BLOCK_LENGTH		64
-	#define	MD5_DIGEST_LENGTH		16
-	#define	MD5_DIGEST_STRING_LENGTH	(MD5_DIGEST_LENGTH * 2 + 1)
-
-	struct MD5_CTX {
-		u32	state[4];		/* state */
-		u64	count;			/* number of bits, mod 2^64 */
-		u8	buffer[MD5_BLOCK_LENGTH];	/* input buffer */
+	struct WatchRequest {
+		WatchId id;
+		std::string path;
+		bool isTree;
 	};
 
-	struct MD5Digest {
-		u8 data[MD5_DIGEST_LENGTH];
+	// Cheap to query; the contents are only hashed when this changes
+	struct FileStamp {
+		u64 size = 0;
+		u64 mtimeNs = 0;
 
-		bool operator!=(const MD5Digest& rhs) const {
-			return memcmp(data, rhs.data, sizeof(data)) != 0;
+		bool operator!=(const FileStamp& rhs) const {
+			return size != rhs.size || mtimeNs != rhs.mtimeNs;
 		}
 	};
 
-	void	 MD5Init(MD5_CTX*);
-	void	 MD5Update(MD5_CTX *, const unsigned char *, size_t);
-	void	 MD5Final(MD5Digest*, MD5_CTX*);
+	// Shared; the mutex is never held during I/O
+	std::mutex					requestMutex;
+	vector<WatchRequest>		requests;
+	std::atomic<u32>			requestsVersion(0);
 
+	typedef std::chrono::steady_clock Clock;
 
-	vector<std::string>	watchedFiles;
-	vector<MD5Digest>		fileDigests;
-	vector<bool>			fileModifiedFlags;
-	vector<Callback>		callbacks;
+	struct Change {
+		WatchId id;
+		Clock::time_point detectedTime;	// on the watcher thread
+	};
 
-	vector<u32>			callbacksQueued;
-	vector<u32>			callbacksDispatching;
+	SpscQueue<Change, 1024>		changeQueue;
+	std::atomic<void (*)()>		changeNotify(nullptr);
 
 	std::thread					watcherThread;
-	bool						threadStopping = true;
+	std::atomic<bool>			threadStopping(true);
+
+	// Main thread only
+	std::unordered_map<WatchId, Callback>	callbacks;
+	WatchId						nextWatchId = 1;
+	vector<Change>				callbacksDispatching;
+	Clock::time_point			dispatchingDetectedTime;
+
+	vector<Change>				pendingBatch;
+	Clock::time_point			batchFirstChangeTime;
+	Clock::time_point			batchLastChangeTime;
+	u32							debounceWindowMs = 50;
+
+	// Watcher thread only
+	struct WatchedFile {
+		WatchId id;
+		std::string path;
+		FileStamp stamp;
+		u64 digest = 0;
+
+		// Directory trees only report that something in them changed
+		bool isTree = false;
+		u64 treeSignature = 0;	// polling fallback
+
+#ifdef __linux__
+		std::string dir;
+		std::string name;
+		vector<std::string> treeDirs;	// the root and all of its subdirectories, resolved
+#endif
+	};
+
+	vector<WatchedFile>			watchedFiles;
+	u32							watchedFilesVersion = ~0u;	// forces a sync on start
+	vector<Change>				changesNotQueued;	// waiting for space in changeQueue
 
-	// This one is to sync the worker thread with the main thread(s)
-	std::mutex					watcherMutex;
+	// Directories are only stat'ed by the polling fallback every this many ticks
+	const u32					treePollInterval = 100;
 
-	// This one can't be used by the worker thread, and is used to make sure that only one
-	// client thread at a time can access the API.
-	std::mutex					publicApiMutex;
+#ifdef __linux__
+	// inotify backend. Parent directories are watched rather than the files themselves, so that
+	// editors which save by writing a temporary file and renaming it over the original are picked up.
+	// The polling thread remains as the fallback if inotify can't be initialized.
+	int									inotifyFd = -1;
+	int									wakeFd = -1;	// eventfd for waking the watcher up when requests change
+	std::unordered_map<std::string, int>	watchedDirs;	// directory -> inotify watch descriptor
 
-	bool calculateFileDigest(const std::string& path, MD5Digest *const res) {
-		MD5_CTX ctx;
-		MD5Init(&ctx);
+	// Directories which couldn't be watched, e.g. because they don't exist yet. The files in them
+	// are polled, and the watches retried, every this many milliseconds.
+	vector<std::string>					unwatchedDirs;
+	const int							unwatchedDirPollMs = 100;
 
-		FILE* const f = fopen(path.c_str(), "r");
-		if (f) {
-			fseek(f, 0, SEEK_END);
-			const u64 flen = ftell(f);
-			fseek(f, 0, SEEK_SET);
-			vector<u8> fileData(flen, u8(0));
-			fread(fileData.data(), 1, flen, f);
-			fclose(f);
+	const u32 inotifyMask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE;
 
-			MD5Update(&ctx, fileData.data(), flen);
+	std::string resolvePath(const std::string& path) {
+		char resolved[PATH_MAX];
+		return realpath(path.c_str(), resolved) ? resolved : path;
+	}
+
+	void findTreeDirs(WatchedFile& tree) {
+		tree.treeDirs.clear();
+		tree.treeDirs.push_back(resolvePath(tree.path));
+
+		std::error_code ec;
+		for (fs::recursive_directory_iterator it(tree.path, ec), end; !ec && it != end; it.increment(ec)) {
+			if (fs::is_directory(it->status())) {
+				tree.treeDirs.push_back(resolvePath(it->path().string()));
+			}
 		}
+	}
 
-		MD5Final(res, &ctx);
-		return f != nullptr;
+	void splitWatchedPath(const std::string& path, std::string *const dir, std::string *const name) {
+		const size_t slash = path.find_last_of('/');
+		const std::string dirPart = std::string::npos == slash ? "." : path.substr(0, 0 == slash ? 1 : slash);
+		*name = std::string::npos == slash ? path : path.substr(slash + 1);
+		*dir = resolvePath(dirPart);
 	}
 
-	void watchFile(const char* const path, const Callback& callback) {
-		MD5Digest digest;
-		calculateFileDigest(path, &digest);
-
-		publicApiMutex.lock();
-		watcherMutex.lock();
-			watchedFiles.push_back(path);
-			fileDigests.push_back(digest);
-			fileModifiedFlags.push_back(false);
-			callbacks.push_back(callback);
-		watcherMutex.unlock();
-		publicApiMutex.unlock();
+	void wakeWatcher() {
+		if (wakeFd != -1) {
+			const uint64_t one = 1;
+			ssize_t written = write(wakeFd, &one, sizeof(one));
+			(void)written;
+		}
 	}
 
-	void stopWatchingFile(const char* const path) {
-		publicApiMutex.lock();
-		watcherMutex.lock();
+	bool isUnwatchedDir(const vector<std::string>& unwatched, const std::string& dir) {
+		return std::find(unwatched.begin(), unwatched.end(), dir) != unwatched.end();
+	}
 
-		std::string pathStr = path;
-		auto found = std::find(watchedFiles.begin(), watchedFiles.end(), pathStr);
-		if (found != watchedFiles.end()) {
-			const u32 idx = found - watchedFiles.begin();
+	// Adds inotify watches for directories which gained watched files, and removes the ones left without any
+	void syncDirWatches() {
+		std::unordered_map<std::string, int> dirs;
+		unwatchedDirs.clear();
 
-			callbacksQueued.erase(
-				std::remove(callbacksQueued.begin(), callbacksQueued.end(), idx),
-				callbacksQueued.end()
-			);
+		auto keepDir = [&](const std::string& dir) {
+			if (dirs.count(dir)) {
+				return;
+			}
+
+			auto found = watchedDirs.find(dir);
+			if (found != watchedDirs.end()) {
+				dirs[dir] = found->second;
+				watchedDirs.erase(found);
+			}
+			else {
+				const int wd = inotify_add_watch(inotifyFd, dir.c_str(), inotifyMask);
+				if (wd != -1) {
+					dirs[dir] = wd;
+				}
+				else if (!isUnwatchedDir(unwatchedDirs, dir)) {
+					unwatchedDirs.push_back(dir);
+				}
+			}
+		};
 
-			watchedFiles.erase(watchedFiles.begin() + idx);
-			fileDigests.erase(fileDigests.begin() + idx);
-			fileModifiedFlags.erase(fileModifiedFlags.begin() + idx);
-			callbacks.erase(callbacks.begin() + idx);
+		for (const WatchedFile& file : watchedFiles) {
+			if (file.isTree) {
+				for (const std::string& dir : file.treeDirs) {
+					keepDir(dir);
+				}
+			}
+			else {
+				keepDir(file.dir);
+			}
 		}
 
-		watcherMutex.unlock();
-		publicApiMutex.unlock();
+		for (const auto& it : watchedDirs) {
+			inotify_rm_watch(inotifyFd, it.second);
+		}
+
+		watchedDirs.swap(dirs);
 	}
+#else
+	void wakeWatcher() {}
+#endif
 
-	void threadFunc() {
-		size_t fileIdxCounter = 0;
+	bool getFileStamp(const std::string& path, FileStamp *const res) {
+#ifdef __linux__
+		struct stat st;
+		if (stat(path.c_str(), &st) != 0) {
+			return false;
+		}
 
-		while (!threadStopping) {
-			if (watchedFiles.size() > 0) {
-				watcherMutex.lock();
+		res->size = u64(st.st_size);
+		res->mtimeNs = u64(st.st_mtim.tv_sec) * 1000000000ull + u64(st.st_mtim.tv_nsec);
+#else
+		std::error_code ec;
+		res->size = u64(fs::file_size(path, ec));
+		if (ec) {
+			return false;
+		}
 
-				const size_t i = fileIdxCounter++ % watchedFiles.size();
+		const auto mtime = fs::last_write_time(path, ec);
+		if (ec) {
+			return false;
+		}
 
-				if (!fileModifiedFlags[i]) {
-					MD5Digest digest;
-					if (calculateFileDigest(watchedFiles[i], &digest) && digest != fileDigests[i]) {
-						fileModifiedFlags[i] = true;
-						fileDigests[i] = digest;
-						callbacksQueued.push_back(u32(i));
-					}
-				}
+		res->mtimeNs = u64(std::chrono::duration_cast<std::chrono::nanoseconds>(mtime.time_since_epoch()).count());
+#endif
+		return true;
+	}
 
-				watcherMutex.unlock();
-			}
+	bool calculateFileDigest(const std::string& path, u64 *const res) {
+		// Reused between calls, so that large assets don't cause an allocation per check
+		thread_local vector<u8> fileData;
 
-			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		FILE* const f = fopen(path.c_str(), "rb");
+		if (!f) {
+			*res = 0;
+			return false;
 		}
+
+		fseek(f, 0, SEEK_END);
+		const long flen = ftell(f);
+		fseek(f, 0, SEEK_SET);
+		fileData.resize(flen > 0 ? size_t(flen) : 0);
+		fileData.resize(fread(fileData.data(), 1, fileData.size(), f));
+		fclose(f);
+
+		*res = hashBytes(fileData.data(), fileData.size());
+		return true;
 	}
 
-	void update() {
-		publicApiMutex.lock();
-			watcherMutex.lock();
-				callbacksDispatching.swap(callbacksQueued);
-			watcherMutex.unlock();
-
-			for (u32 callbackIdx : callbacksDispatching) {
-				callbacks[callbackIdx]();
-				fileModifiedFlags[callbackIdx] = false;
+	// Covers the names, sizes and modification times of everything in the tree
+	u64 calculateTreeSignature(const std::string& root) {
+		u64 signature = 0;
+
+		std::error_code ec;
+		for (fs::recursive_directory_iterator it(root, ec), end; !ec && it != end; it.increment(ec)) {
+			const std::string path = it->path().string();
+			FileStamp stamp;
+			getFileStamp(path, &stamp);
+
+			signature = hashBytes(path.data(), path.size(), signature);
+			signature = hashBytes(&stamp, sizeof(stamp), signature);
+		}
+
+		return signature;
+	}
+
+	// Adopts the latest list of requests, keeping the state of files which are still watched.
+	// New files get their baseline stamp and digest here, off the main thread.
+	void syncWatchedFiles() {
+		if (requestsVersion.load() == watchedFilesVersion) {
+			return;
+		}
+
+		vector<WatchRequest> snapshot;
+		{
+			std::lock_guard<std::mutex> lock(requestMutex);
+			snapshot = requests;
+			watchedFilesVersion = requestsVersion.load();
+		}
+
+		std::unordered_map<WatchId, size_t> previous;
+		for (size_t i = 0; i < watchedFiles.size(); ++i) {
+			previous[watchedFiles[i].id] = i;
+		}
+
+		vector<WatchedFile> files(snapshot.size());
+		for (size_t i = 0; i < snapshot.size(); ++i) {
+			WatchedFile& file = files[i];
+			auto found = previous.find(snapshot[i].id);
+
+			if (found != previous.end()) {
+				file = std::move(watchedFiles[found->second]);
+				continue;
 			}
 
-			callbacksDispatching.clear();
-		publicApiMutex.unlock();
+			file.id = snapshot[i].id;
+			file.path = std::move(snapshot[i].path);
+			file.isTree = snapshot[i].isTree;
+
+			if (file.isTree) {
+#ifdef __linux__
+				if (inotifyFd != -1) {
+					findTreeDirs(file);
+					continue;
+				}
+#endif
+				file.treeSignature = calculateTreeSignature(file.path);
+				continue;
+			}
+
+			getFileStamp(file.path, &file.stamp);
+			calculateFileDigest(file.path, &file.digest);
+
+#ifdef __linux__
+			splitWatchedPath(file.path, &file.dir, &file.name);
+#endif
+		}
+
+		watchedFiles.swap(files);
+
+#ifdef __linux__
+		if (inotifyFd != -1) {
+			syncDirWatches();
+		}
+#endif
 	}
 
-	void start() {
-		publicApiMutex.lock();
-			assert(threadStopping);
-			threadStopping = false;
-			watcherThread = std::move(std::thread(&threadFunc));
-		publicApiMutex.unlock();
+	void notifyChange() {
+		if (void (*const notify)() = changeNotify.load()) {
+			notify();
+		}
 	}
 
-	void stop() {
-		publicApiMutex.lock();
-			threadStopping = true;
-			watcherThread.join();
-		publicApiMutex.unlock();
+	void queueChange(WatchId id) {
+		const Change change = { id, Clock::now() };
+		if (!changesNotQueued.empty() || !changeQueue.push(change)) {
+			changesNotQueued.push_back(change);
+		}
+		else {
+			notifyChange();
+		}
 	}
 
+	// The main thread might not have been draining the queue for a while, e.g. during a long load
+	void flushChanges() {
+		size_t queued = 0;
+		while (queued < changesNotQueued.size() && changeQueue.push(changesNotQueued[queued])) {
+			++queued;
+		}
 
+		if (queued > 0) {
+			changesNotQueued.erase(changesNotQueued.begin(), changesNotQueued.begin() + queued);
+			notifyChange();
+		}
+	}
+
+	void checkTree(WatchedFile& tree) {
+		const u64 signature = calculateTreeSignature(tree.path);
+		if (signature != tree.treeSignature) {
+			tree.treeSignature = signature;
+			queueChange(tree.id);
+		}
+	}
 
+	void checkFile(WatchedFile& file) {
+		if (file.isTree) {
+			return;
+		}
 
+		FileStamp stamp;
+		if (!getFileStamp(file.path, &stamp) || !(stamp != file.stamp)) {
+			return;
+		}
 
+		file.stamp = stamp;
 
+		// Touched files and editors re-saving identical contents shouldn't trigger reloads
+		u64 digest;
+		if (calculateFileDigest(file.path, &digest) && digest != file.digest) {
+			file.digest = digest;
+			queueChange(file.id);
+		}
+	}
 
+#ifdef __linux__
+	// Returns true if a subdirectory of a watched tree was added or removed
+	bool handleInotifyEvent(const inotify_event& ev) {
+		if (ev.mask & IN_Q_OVERFLOW) {
+			// Events were dropped; fall back to checking everything once
+			for (WatchedFile& file : watchedFiles) {
+				if (file.isTree) {
+					queueChange(file.id);
+				}
+				else {
+					checkFile(file);
+				}
+			}
+			return true;
+		}
 
-#define PUT_64BIT_LE(cp, value) do {					\
-	(cp)[7] = u8((value) >> 56);					\
-	(cp)[6] = u8((value) >> 48);					\
-	(cp)[5] = u8((value) >> 40);					\
-	(cp)[4] = u8((value) >> 32);					\
-	(cp)[3] = u8((value) >> 24);					\
-	(cp)[2] = u8((value) >> 16);					\
-	(cp)[1] = u8((value) >> 8);						\
-	(cp)[0] = u8(value); } while (0)
+		// The directory was deleted or unmounted; it's polled for until it can be watched again
+		if (ev.mask & IN_IGNORED) {
+			for (auto it = watchedDirs.begin(); it != watchedDirs.end(); ++it) {
+				if (it->second == ev.wd) {
+					unwatchedDirs.push_back(it->first);
+					watchedDirs.erase(it);
+					break;
+				}
+			}
+			return false;
+		}
 
-#define PUT_32BIT_LE(cp, value) do {					\
-	(cp)[3] = (value) >> 24;					\
-	(cp)[2] = (value) >> 16;					\
-	(cp)[1] = (value) >> 8;						\
-	(cp)[0] = (value); } while (0)
+		if (0 == ev.len) {
+			return false;
+		}
 
-	static u8 PADDING[MD5_BLOCK_LENGTH] = {
-		0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
-	};
+		const std::string* dir = nullptr;
+		for (const auto& it : watchedDirs) {
+			if (it.second == ev.wd) {
+				dir = &it.first;
+				break;
+			}
+		}
 
-	/* The four core functions - F1 is optimized somewhat */
-
-	/* #define F1(x, y, z) (x & y | ~x & z) */
-#define F1(x, y, z) (z ^ (x & (y ^ z)))
-#define F2(x, y, z) F1(z, x, y)
-#define F3(x, y, z) (x ^ y ^ z)
-#define F4(x, y, z) (y ^ (x | ~z))
-
-	/* This is the central step in the MD5 algorithm. */
-#define MD5STEP(f, w, x, y, z, data, s) \
-	( w += f(x, y, z) + data,  w = w<<s | w>>(32-s),  w += x )
-
-	/*
-	* The core of the MD5 algorithm, this alters an existing MD5 hash to
-	* reflect the addition of 16 longwords of new data.  MD5Update blocks
-	* the data and converts bytes into longwords for this routine.
-	*/
-	static void MD5Transform(u32 state[4], const u8 block[MD5_BLOCK_LENGTH])
-	{
-		u32 a, b, c, d, in[MD5_BLOCK_LENGTH / 4];
-
-#ifndef WORDS_BIGENDIAN
-		memcpy(in, block, sizeof(in));
-#else
-		for (a = 0; a < MD5_BLOCK_LENGTH / 4; a++) {
-			in[a] = (u32)(
-				(u32)(block[a * 4 + 0]) |
-				(u32)(block[a * 4 + 1]) << 8 |
-				(u32)(block[a * 4 + 2]) << 16 |
-				(u32)(block[a * 4 + 3]) << 24);
+		if (!dir) {
+			return false;
 		}
+
+		bool treeDirsChanged = false;
+
+		for (WatchedFile& file : watchedFiles) {
+			if (file.isTree) {
+				if (std::find(file.treeDirs.begin(), file.treeDirs.end(), *dir) != file.treeDirs.end()) {
+					queueChange(file.id);
+					treeDirsChanged |= 0 != (ev.mask & IN_ISDIR);
+				}
+			}
+			else if (file.name == ev.name && file.dir == *dir) {
+				checkFile(file);
+			}
+		}
+
+		return treeDirsChanged;
+	}
+
+	// Checks the files in directories which couldn't be watched, and retries watching them.
+	// Files in directories which have just become watched are checked one last time, as they
+	// could have changed before the watch was added.
+	void pollUnwatchedDirs() {
+		const vector<std::string> previouslyUnwatched = unwatchedDirs;
+
+		for (WatchedFile& file : watchedFiles) {
+			if (file.isTree && std::any_of(file.treeDirs.begin(), file.treeDirs.end(),
+				[&](const std::string& dir) { return isUnwatchedDir(previouslyUnwatched, dir); }))
+			{
+				findTreeDirs(file);
+			}
+		}
+
+		syncDirWatches();
+
+		for (WatchedFile& file : watchedFiles) {
+			if (!file.isTree) {
+				if (isUnwatchedDir(previouslyUnwatched, file.dir)) {
+					checkFile(file);
+				}
+			}
+			else if (std::any_of(file.treeDirs.begin(), file.treeDirs.end(), [&](const std::string& dir) {
+				return isUnwatchedDir(previouslyUnwatched, dir) && watchedDirs.count(dir);
+			})) {
+				// Whatever is in the tree by now went unnoticed
+				queueChange(file.id);
+			}
+		}
+	}
+
+	// Sleeps until the kernel reports a write or rename in one of the watched directories,
+	// so the detection latency doesn't depend on the number of watched files.
+	void inotifyThreadFunc() {
+		alignas(inotify_event) char buffer[4096];
+		Clock::time_point nextUnwatchedPoll = Clock::now();
+
+		while (!threadStopping) {
+			syncWatchedFiles();
+
+			if (!unwatchedDirs.empty() && Clock::now() >= nextUnwatchedPoll) {
+				pollUnwatchedDirs();
+				nextUnwatchedPoll = Clock::now() + std::chrono::milliseconds(unwatchedDirPollMs);
+			}
+
+			flushChanges();
+
+			pollfd fds[2] = {
+				{ inotifyFd, POLLIN, 0 },
+				{ wakeFd, POLLIN, 0 },
+			};
+
+			// Only time out while there are changes the main thread hasn't made room for,
+			// or directories to poll
+			const int timeoutMs = !changesNotQueued.empty() ? 10 : !unwatchedDirs.empty() ? unwatchedDirPollMs : -1;
+			if (poll(fds, 2, timeoutMs) <= 0) {
+				continue;
+			}
+
+			if (fds[1].revents & POLLIN) {
+				uint64_t wakeCount;
+				ssize_t bytesRead = read(wakeFd, &wakeCount, sizeof(wakeCount));
+				(void)bytesRead;
+			}
+
+			if (fds[0].revents & POLLIN) {
+				const ssize_t len = read(inotifyFd, buffer, sizeof(buffer));
+
+				bool treeDirsChanged = false;
+
+				for (const char* p = buffer; len > 0 && p < buffer + len; ) {
+					const inotify_event& ev = *reinterpret_cast<const inotify_event*>(p);
+					treeDirsChanged |= handleInotifyEvent(ev);
+					p += sizeof(inotify_event) + ev.len;
+				}
+
+				// Start watching new subdirectories, and stop watching removed ones
+				if (treeDirsChanged) {
+					for (WatchedFile& file : watchedFiles) {
+						if (file.isTree) {
+							findTreeDirs(file);
+						}
+					}
+
+					syncDirWatches();
+				}
+			}
+		}
+	}
 #endif
 
-		a = state[0];
-		b = state[1];
-		c = state[2];
-		d = state[3];
-
-		MD5STEP(F1, a, b, c, d, in[0] + 0xd76aa478, 7);
-		MD5STEP(F1, d, a, b, c, in[1] + 0xe8c7b756, 12);
-		MD5STEP(F1, c, d, a, b, in[2] + 0x242070db, 17);
-		MD5STEP(F1, b, c, d, a, in[3] + 0xc1bdceee, 22);
-		MD5STEP(F1, a, b, c, d, in[4] + 0xf57c0faf, 7);
-		MD5STEP(F1, d, a, b, c, in[5] + 0x4787c62a, 12);
-		MD5STEP(F1, c, d, a, b, in[6] + 0xa8304613, 17);
-		MD5STEP(F1, b, c, d, a, in[7] + 0xfd469501, 22);
-		MD5STEP(F1, a, b, c, d, in[8] + 0x698098d8, 7);
-		MD5STEP(F1, d, a, b, c, in[9] + 0x8b44f7af, 12);
-		MD5STEP(F1, c, d, a, b, in[10] + 0xffff5bb1, 17);
-		MD5STEP(F1, b, c, d, a, in[11] + 0x895cd7be, 22);
-		MD5STEP(F1, a, b, c, d, in[12] + 0x6b901122, 7);
-		MD5STEP(F1, d, a, b, c, in[13] + 0xfd987193, 12);
-		MD5STEP(F1, c, d, a, b, in[14] + 0xa679438e, 17);
-		MD5STEP(F1, b, c, d, a, in[15] + 0x49b40821, 22);
-
-		MD5STEP(F2, a, b, c, d, in[1] + 0xf61e2562, 5);
-		MD5STEP(F2, d, a, b, c, in[6] + 0xc040b340, 9);
-		MD5STEP(F2, c, d, a, b, in[11] + 0x265e5a51, 14);
-		MD5STEP(F2, b, c, d, a, in[0] + 0xe9b6c7aa, 20);
-		MD5STEP(F2, a, b, c, d, in[5] + 0xd62f105d, 5);
-		MD5STEP(F2, d, a, b, c, in[10] + 0x02441453, 9);
-		MD5STEP(F2, c, d, a, b, in[15] + 0xd8a1e681, 14);
-		MD5STEP(F2, b, c, d, a, in[4] + 0xe7d3fbc8, 20);
-		MD5STEP(F2, a, b, c, d, in[9] + 0x21e1cde6, 5);
-		MD5STEP(F2, d, a, b, c, in[14] + 0xc33707d6, 9);
-		MD5STEP(F2, c, d, a, b, in[3] + 0xf4d50d87, 14);
-		MD5STEP(F2, b, c, d, a, in[8] + 0x455a14ed, 20);
-		MD5STEP(F2, a, b, c, d, in[13] + 0xa9e3e905, 5);
-		MD5STEP(F2, d, a, b, c, in[2] + 0xfcefa3f8, 9);
-		MD5STEP(F2, c, d, a, b, in[7] + 0x676f02d9, 14);
-		MD5STEP(F2, b, c, d, a, in[12] + 0x8d2a4c8a, 20);
-
-		MD5STEP(F3, a, b, c, d, in[5] + 0xfffa3942, 4);
-		MD5STEP(F3, d, a, b, c, in[8] + 0x8771f681, 11);
-		MD5STEP(F3, c, d, a, b, in[11] + 0x6d9d6122, 16);
-		MD5STEP(F3, b, c, d, a, in[14] + 0xfde5380c, 23);
-		MD5STEP(F3, a, b, c, d, in[1] + 0xa4beea44, 4);
-		MD5STEP(F3, d, a, b, c, in[4] + 0x4bdecfa9, 11);
-		MD5STEP(F3, c, d, a, b, in[7] + 0xf6bb4b60, 16);
-		MD5STEP(F3, b, c, d, a, in[10] + 0xbebfbc70, 23);
-		MD5STEP(F3, a, b, c, d, in[13] + 0x289b7ec6, 4);
-		MD5STEP(F3, d, a, b, c, in[0] + 0xeaa127fa, 11);
-		MD5STEP(F3, c, d, a, b, in[3] + 0xd4ef3085, 16);
-		MD5STEP(F3, b, c, d, a, in[6] + 0x04881d05, 23);
-		MD5STEP(F3, a, b, c, d, in[9] + 0xd9d4d039, 4);
-		MD5STEP(F3, d, a, b, c, in[12] + 0xe6db99e5, 11);
-		MD5STEP(F3, c, d, a, b, in[15] + 0x1fa27cf8, 16);
-		MD5STEP(F3, b, c, d, a, in[2] + 0xc4ac5665, 23);
-
-		MD5STEP(F4, a, b, c, d, in[0] + 0xf4292244, 6);
-		MD5STEP(F4, d, a, b, c, in[7] + 0x432aff97, 10);
-		MD5STEP(F4, c, d, a, b, in[14] + 0xab9423a7, 15);
-		MD5STEP(F4, b, c, d, a, in[5] + 0xfc93a039, 21);
-		MD5STEP(F4, a, b, c, d, in[12] + 0x655b59c3, 6);
-		MD5STEP(F4, d, a, b, c, in[3] + 0x8f0ccc92, 10);
-		MD5STEP(F4, c, d, a, b, in[10] + 0xffeff47d, 15);
-		MD5STEP(F4, b, c, d, a, in[1] + 0x85845dd1, 21);
-		MD5STEP(F4, a, b, c, d, in[8] + 0x6fa87e4f, 6);
-		MD5STEP(F4, d, a, b, c, in[15] + 0xfe2ce6e0, 10);
-		MD5STEP(F4, c, d, a, b, in[6] + 0xa3014314, 15);
-		MD5STEP(F4, b, c, d, a, in[13] + 0x4e0811a1, 21);
-		MD5STEP(F4, a, b, c, d, in[4] + 0xf7537e82, 6);
-		MD5STEP(F4, d, a, b, c, in[11] + 0xbd3af235, 10);
-		MD5STEP(F4, c, d, a, b, in[2] + 0x2ad7d2bb, 15);
-		MD5STEP(F4, b, c, d, a, in[9] + 0xeb86d391, 21);
-
-		state[0] += a;
-		state[1] += b;
-		state[2] += c;
-		state[3] += d;
+	// Polling fallback. Unchanged files only cost a stat, so all of them are checked every tick.
+	void threadFunc() {
+		for (u32 tick = 0; !threadStopping; ++tick) {
+			syncWatchedFiles();
+			flushChanges();
+
+			for (WatchedFile& file : watchedFiles) {
+				if (!file.isTree) {
+					checkFile(file);
+				}
+				else if (0 == tick % treePollInterval) {
+					checkTree(file);
+				}
+			}
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
 	}
 
-	/*
-	* Start MD5 accumulation.  Set bit count to 0 and buffer to mysterious
-	* initialization constants.
-	*/
-	void MD5Init(MD5_CTX *ctx)
-	{
-		ctx->count = 0;
-		ctx->state[0] = 0x67452301;
-		ctx->state[1] = 0xefcdab89;
-		ctx->state[2] = 0x98badcfe;
-		ctx->state[3] = 0x10325476;
+	WatchId addWatch(const char* const path, bool isTree, const Callback& callback) {
+		const WatchId id = nextWatchId++;
+		callbacks[id] = callback;
+
+		{
+			std::lock_guard<std::mutex> lock(requestMutex);
+			requests.push_back({ id, path, isTree });
+			++requestsVersion;
+		}
+
+		wakeWatcher();
+		return id;
 	}
 
-	/*
-	* Update context to reflect the concatenation of another buffer full
-	* of bytes.
-	*/
-	void MD5Update(MD5_CTX *ctx, const unsigned char *input, size_t len)
-	{
-		size_t have, need;
-
-		/* Check how many bytes we already have and how many more we need. */
-		have = (size_t)((ctx->count >> 3) & (MD5_BLOCK_LENGTH - 1));
-		need = MD5_BLOCK_LENGTH - have;
-
-		/* Update bitcount */
-		ctx->count += (u64)len << 3;
-
-		if (len >= need) {
-			if (have != 0) {
-				memcpy(ctx->buffer + have, input, need);
-				MD5Transform(ctx->state, ctx->buffer);
-				input += need;
-				len -= need;
-				have = 0;
+	WatchId watchFile(const char* const path, const Callback& callback) {
+		return addWatch(path, false, callback);
+	}
+
+	WatchId watchDirectoryTree(const char* const path, const Callback& callback) {
+		return addWatch(path, true, callback);
+	}
+
+	void stopWatching(WatchId id) {
+		if (0 == callbacks.erase(id)) {
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(requestMutex);
+			requests.erase(
+				std::remove_if(requests.begin(), requests.end(), [id](const WatchRequest& r) { return r.id == id; }),
+				requests.end()
+			);
+			++requestsVersion;
+		}
+
+		wakeWatcher();
+	}
+
+	void stopWatchingFile(const char* const path) {
+		vector<WatchId> ids;
+
+		{
+			std::lock_guard<std::mutex> lock(requestMutex);
+			for (const WatchRequest& r : requests) {
+				if (r.path == path && !r.isTree) {
+					ids.push_back(r.id);
+				}
+			}
+		}
+
+		for (WatchId id : ids) {
+			stopWatching(id);
+		}
+	}
+
+	void setDebounceWindow(unsigned int milliseconds) {
+		debounceWindowMs = milliseconds;
+	}
+
+	void update() {
+		const Clock::time_point now = Clock::now();
+
+		Change change;
+		while (changeQueue.pop(&change)) {
+			if (pendingBatch.empty()) {
+				batchFirstChangeTime = now;
 			}
 
-			/* Process data in MD5_BLOCK_LENGTH-byte chunks. */
-			while (len >= MD5_BLOCK_LENGTH) {
-				MD5Transform(ctx->state, input);
-				input += MD5_BLOCK_LENGTH;
-				len -= MD5_BLOCK_LENGTH;
+			batchLastChangeTime = now;
+			pendingBatch.push_back(change);
+		}
+
+		if (pendingBatch.empty()) {
+			return;
+		}
+
+		// Wait for the files to settle, but don't let a file which is being written to
+		// continuously hold back the batch forever
+		const auto window = std::chrono::milliseconds(debounceWindowMs);
+		if (now - batchLastChangeTime < window && now - batchFirstChangeTime < window * 10) {
+			return;
+		}
+
+		callbacksDispatching.clear();
+		callbacksDispatching.swap(pendingBatch);
+
+		// One callback per watch, reporting the earliest detection of the batch
+		std::sort(callbacksDispatching.begin(), callbacksDispatching.end(), [](const Change& a, const Change& b) {
+			return a.id < b.id || (a.id == b.id && a.detectedTime < b.detectedTime);
+		});
+		callbacksDispatching.erase(
+			std::unique(callbacksDispatching.begin(), callbacksDispatching.end(), [](const Change& a, const Change& b) { return a.id == b.id; }),
+			callbacksDispatching.end()
+		);
+
+		for (const Change& changed : callbacksDispatching) {
+			// Changes can arrive for watches removed since; also, a callback may add or remove
+			// watches, so it's called through a copy rather than a reference into the map.
+			auto found = callbacks.find(changed.id);
+			if (found != callbacks.end()) {
+				Callback callback = found->second;
+				dispatchingDetectedTime = changed.detectedTime;
+				callback();
 			}
 		}
+	}
+
+	void setChangeNotify(void (*notify)()) {
+		changeNotify = notify;
+	}
+
+	std::chrono::steady_clock::duration getTimeUntilDispatch() {
+		if (pendingBatch.empty()) {
+			return Clock::duration::max();
+		}
+
+		// Same rule as in update
+		const auto window = std::chrono::milliseconds(debounceWindowMs);
+		const Clock::time_point dispatchTime = std::min(batchLastChangeTime + window, batchFirstChangeTime + window * 10);
+		return std::max(dispatchTime - Clock::now(), Clock::duration::zero());
+	}
 
-		/* Handle any remaining bytes of data. */
-		if (len != 0)
-			memcpy(ctx->buffer + have, input, len);
+	std::chrono::steady_clock::time_point getChangeDetectedTime() {
+		return dispatchingDetectedTime;
 	}
 
-	/*
-	* Pad pad to 64-byte boundary with the bit pattern
-	* 1 0* (64-bit count of bits processed, MSB-first)
-	*/
-	static void MD5Pad(MD5_CTX *ctx)
-	{
-		u8 count[8];
-		size_t padlen;
-
-		/* Convert count to 8 bytes in little endian order. */
-		PUT_64BIT_LE(count, ctx->count);
-
-		/* Pad out to 56 mod 64. */
-		padlen = MD5_BLOCK_LENGTH -
-			((ctx->count >> 3) & (MD5_BLOCK_LENGTH - 1));
-		if (padlen < 1 + 8)
-			padlen += MD5_BLOCK_LENGTH;
-		MD5Update(ctx, PADDING, padlen - 8);		/* padlen - 8 <= 64 */
-		MD5Update(ctx, count, 8);
+	void start() {
+		assert(threadStopping);
+		threadStopping = false;
+
+		bool eventDriven = false;
+
+#ifdef __linux__
+		inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+		if (inotifyFd != -1 && wakeFd != -1) {
+			watcherThread = std::thread(&inotifyThreadFunc);
+			eventDriven = true;
+		}
+		else {
+			if (inotifyFd != -1) close(inotifyFd);
+			if (wakeFd != -1) close(wakeFd);
+			inotifyFd = wakeFd = -1;
+		}
+#endif
+
+		if (!eventDriven) {
+			watcherThread = std::thread(&threadFunc);
+		}
 	}
 
-	/*
-	* Final wrapup--call MD5Pad, fill in digest and zero out ctx.
-	*/
-	void MD5Final(MD5Digest* res, MD5_CTX *ctx)
-	{
-		int i;
-
-		MD5Pad(ctx);
-		for (i = 0; i < 4; i++)
-			PUT_32BIT_LE(res->data + i * 4, ctx->state[i]);
-		memset(ctx, 0, sizeof(*ctx));
+	void stop() {
+		threadStopping = true;
+		wakeWatcher();
+		watcherThread.join();
+
+		watchedFiles.clear();
+		watchedFilesVersion = ~0u;
+
+#ifdef __linux__
+		if (inotifyFd != -1) {
+			close(inotifyFd);
+			close(wakeFd);
+			inotifyFd = wakeFd = -1;
+			watchedDirs.clear();
+			unwatchedDirs.clear();
+		}
+#endif
 	}
 }
@@ -1,13 +1,46 @@
 #pragma once
 
 #include <functional>
+#include <chrono>
 
+// Must be used from a single thread; callbacks are invoked from update on that thread.
 namespace FileWatcher {
 	typedef std::function<void()> Callback;
 
-	void watchFile(const char* const path, const Callback& callback);
+	// Stays valid until the watch is removed, unlike an index into the watch list
+	typedef unsigned int WatchId;
+	const WatchId invalidWatchId = 0;
+
+	WatchId watchFile(const char* const path, const Callback& callback);
+
+	// The callback is invoked when files or directories are added, removed, renamed or written
+	// anywhere under the directory, without saying which. Without inotify, the tree is only
+	// re-scanned about once a second.
+	WatchId watchDirectoryTree(const char* const path, const Callback& callback);
+
+	void stopWatching(WatchId id);
+
+	// Removes every watch of the given path
 	void stopWatchingFile(const char* const path);
+
+	// Changes are held back until no file has changed for this long, and then all of their
+	// callbacks are invoked from the same update. Editors often write a file several times
+	// per save, and a save can touch several files at once.
+	void setDebounceWindow(unsigned int milliseconds);
+
 	void update();
+
+	// Called on the watcher thread whenever it queues changes for update, e.g. to wake up a main
+	// loop which sleeps while idle. Null to stop calling it.
+	void setChangeNotify(void (*notify)());
+
+	// How long until update invokes the callbacks of the changes it's holding back for the
+	// debounce window; duration::max() if there aren't any
+	std::chrono::steady_clock::duration getTimeUntilDispatch();
+
+	// When the watcher thread noticed the change being reported; only valid within a callback
+	std::chrono::steady_clock::time_point getChangeDetectedTime();
+
 	void start();
 	void stop();
 }
@@ -0,0 +1,47 @@
+#include "FrameProfiler.h"
+
+namespace FrameProfiler {
+	const size_t sectionCount = size_t(Section::Count);
+
+	float currentFrame[sectionCount] = {};
+	vector<float> sectionHistory[sectionCount];
+
+	const char* getSectionName(Section section)
+	{
+		static const char* const names[] = {
+			"Update graph",
+			"Sync GUI",
+			"Draw GUI",
+			"Compile",
+			"Submit",
+		};
+		static_assert(sizeof(names) / sizeof(names[0]) == sectionCount, "Section names out of sync with the enum");
+
+		return names[size_t(section)];
+	}
+
+	Scope::~Scope()
+	{
+		currentFrame[size_t(section)] += std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+	}
+
+	void endFrame()
+	{
+		for (size_t i = 0; i < sectionCount; ++i) {
+			ProfilerHistory::pushSample(sectionHistory[i], currentFrame[i]);
+			currentFrame[i] = 0;
+		}
+	}
+
+	const vector<float>& getSectionHistory(Section section)
+	{
+		return sectionHistory[size_t(section)];
+	}
+
+	void clearHistory()
+	{
+		for (vector<float>& history : sectionHistory) {
+			history.clear();
+		}
+	}
+}
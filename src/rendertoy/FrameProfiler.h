@@ -0,0 +1,38 @@
+#pragma once
+#include "Common.h"
+#include "ProfilerHistory.h"
+
+#include <chrono>
+
+// CPU time spent per frame in the parts of the main loop which scale with the size of the graph.
+// Sections are timed with Scope; time from several scopes of one section within a frame adds up.
+namespace FrameProfiler {
+	typedef std::chrono::steady_clock Clock;
+
+	enum class Section : u8 {
+		UpdateGraph,	// Package::updateGraph
+		SyncGui,		// NodeGraphGuiGlue::updateInfoFromPackage
+		DrawGui,		// nodeGraph
+		Compile,		// Package::compile
+		Submit,			// issuing the GL commands of the compiled passes
+		Count
+	};
+
+	const char* getSectionName(Section section);
+
+	struct Scope {
+		Scope(Section section) : section(section), start(Clock::now()) {}
+		~Scope();
+
+		Section section;
+		Clock::time_point start;
+	};
+
+	// Moves the current frame's times to the history. Call once per frame.
+	void endFrame();
+
+	// Milliseconds spent in a section by the most recent frames, oldest first
+	const vector<float>& getSectionHistory(Section section);
+
+	void clearHistory();
+}
@@ -0,0 +1,164 @@
+#include "GlResources.h"
+
+#include <glad/glad.h>
+#include <stdio.h>
+#include <cassert>
+#include <deque>
+#include <unordered_map>
+
+namespace GlResources {
+	struct Resource {
+		u64 byteEstimate;
+		const char* tag;
+	};
+
+	struct PendingRelease {
+		GlResourceType type;
+		GLuint name;
+	};
+
+	struct FencedFrame {
+		GLsync fence;
+		vector<PendingRelease> releases;
+	};
+
+	static u64 resourceKey(GlResourceType type, GLuint name) {
+		return (u64(type) << 32) | name;
+	}
+
+	std::unordered_map<u64, Resource>	liveResources;
+	TypeStats							typeStats[size_t(GlResourceType::Count)];
+
+	// Released during the current frame, not fenced yet
+	vector<PendingRelease>				currentFrameReleases;
+	std::deque<FencedFrame>				fencedFrames;
+
+	static void deleteObject(GlResourceType type, GLuint name)
+	{
+		switch (type) {
+			case GlResourceType::Buffer: glDeleteBuffers(1, &name); break;
+			case GlResourceType::Texture: glDeleteTextures(1, &name); break;
+			case GlResourceType::Sampler: glDeleteSamplers(1, &name); break;
+			case GlResourceType::Shader: glDeleteShader(name); break;
+			case GlResourceType::Program: glDeleteProgram(name); break;
+			case GlResourceType::VertexArray: glDeleteVertexArrays(1, &name); break;
+			default: assert(false);
+		}
+	}
+
+	static void retire(const vector<PendingRelease>& releases)
+	{
+		for (const PendingRelease& r : releases) {
+			auto found = liveResources.find(resourceKey(r.type, r.name));
+			if (found != liveResources.end()) {
+				TypeStats& stats = typeStats[size_t(r.type)];
+				--stats.pendingCount;
+				stats.pendingBytes -= found->second.byteEstimate;
+				liveResources.erase(found);
+			}
+
+			deleteObject(r.type, r.name);
+		}
+	}
+
+	void track(GlResourceType type, unsigned int name, u64 byteEstimate, const char* tag)
+	{
+		if (0 == name) {
+			return;
+		}
+
+		liveResources[resourceKey(type, name)] = Resource{ byteEstimate, tag };
+
+		TypeStats& stats = typeStats[size_t(type)];
+		++stats.liveCount;
+		stats.liveBytes += byteEstimate;
+	}
+
+	void release(GlResourceType type, unsigned int name)
+	{
+		// 0 is never a valid object, and -1 is used as "none" in some places
+		if (0 == name || GLuint(-1) == name) {
+			return;
+		}
+
+		auto found = liveResources.find(resourceKey(type, name));
+		if (found != liveResources.end()) {
+			TypeStats& stats = typeStats[size_t(type)];
+			--stats.liveCount;
+			stats.liveBytes -= found->second.byteEstimate;
+			++stats.pendingCount;
+			stats.pendingBytes += found->second.byteEstimate;
+		}
+
+		currentFrameReleases.push_back({ type, name });
+	}
+
+	void endFrame()
+	{
+		if (!currentFrameReleases.empty()) {
+			FencedFrame frame;
+			frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			frame.releases.swap(currentFrameReleases);
+			fencedFrames.push_back(std::move(frame));
+		}
+
+		while (!fencedFrames.empty()) {
+			FencedFrame& frame = fencedFrames.front();
+			const GLenum status = glClientWaitSync(frame.fence, 0, 0);
+			if (GL_ALREADY_SIGNALED != status && GL_CONDITION_SATISFIED != status) {
+				break;
+			}
+
+			glDeleteSync(frame.fence);
+			retire(frame.releases);
+			fencedFrames.pop_front();
+		}
+	}
+
+	void shutdown()
+	{
+		glFinish();
+
+		for (FencedFrame& frame : fencedFrames) {
+			glDeleteSync(frame.fence);
+			retire(frame.releases);
+		}
+		fencedFrames.clear();
+
+		retire(currentFrameReleases);
+		currentFrameReleases.clear();
+
+		if (!liveResources.empty()) {
+			fprintf(stderr, "GL resource leaks:\n");
+			for (size_t i = 0; i < size_t(GlResourceType::Count); ++i) {
+				const TypeStats& stats = typeStats[i];
+				if (stats.liveCount > 0) {
+					fprintf(stderr, "  %s: %u objects, ~%llu bytes\n", getTypeName(GlResourceType(i)), stats.liveCount, stats.liveBytes);
+				}
+			}
+
+			for (const auto& it : liveResources) {
+				const GlResourceType type = GlResourceType(it.first >> 32);
+				fprintf(stderr, "  %s %u (%s)\n", getTypeName(type), u32(it.first), it.second.tag ? it.second.tag : "?");
+			}
+		}
+	}
+
+	TypeStats getStats(GlResourceType type)
+	{
+		return typeStats[size_t(type)];
+	}
+
+	const char* getTypeName(GlResourceType type)
+	{
+		switch (type) {
+			case GlResourceType::Buffer: return "Buffer";
+			case GlResourceType::Texture: return "Texture";
+			case GlResourceType::Sampler: return "Sampler";
+			case GlResourceType::Shader: return "Shader";
+			case GlResourceType::Program: return "Program";
+			case GlResourceType::VertexArray: return "VertexArray";
+			default: return "Unknown";
+		}
+	}
+}
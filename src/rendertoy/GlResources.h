@@ -0,0 +1,76 @@
+#pragma once
+#include "Common.h"
+
+enum class GlResourceType : u8 {
+	Buffer,
+	Texture,
+	Sampler,
+	Shader,
+	Program,
+	VertexArray,
+	Count
+};
+
+// Typed wrapper for a GL object name, so that e.g. a program can't be released as a texture.
+// Converts to the raw name implicitly to keep GL calls readable.
+template <GlResourceType Type>
+struct GlHandle {
+	unsigned int name = 0;	// GLuint
+
+	GlHandle() {}
+	explicit GlHandle(unsigned int name)
+		: name(name)
+	{}
+
+	bool valid() const {
+		return name != 0;
+	}
+
+	operator unsigned int() const {
+		return name;
+	}
+};
+
+typedef GlHandle<GlResourceType::Buffer> GlBufferHandle;
+typedef GlHandle<GlResourceType::Texture> GlTextureHandle;
+typedef GlHandle<GlResourceType::Sampler> GlSamplerHandle;
+typedef GlHandle<GlResourceType::Shader> GlShaderHandle;
+typedef GlHandle<GlResourceType::Program> GlProgramHandle;
+typedef GlHandle<GlResourceType::VertexArray> GlVertexArrayHandle;
+
+// Central registry of GL objects. Objects are created by the caller with the usual GL calls,
+// and then tracked here. Released objects are only deleted once the GPU has finished every frame
+// which could still reference them.
+namespace GlResources {
+	struct TypeStats {
+		u32 liveCount = 0;
+		u64 liveBytes = 0;
+		u32 pendingCount = 0;
+		u64 pendingBytes = 0;
+	};
+
+	void track(GlResourceType type, unsigned int name, u64 byteEstimate, const char* tag);
+	void release(GlResourceType type, unsigned int name);
+
+	template <GlResourceType Type>
+	GlHandle<Type> track(GlHandle<Type> handle, u64 byteEstimate, const char* tag) {
+		track(Type, handle.name, byteEstimate, tag);
+		return handle;
+	}
+
+	template <GlResourceType Type>
+	void release(GlHandle<Type>& handle) {
+		release(Type, handle.name);
+		handle = GlHandle<Type>();
+	}
+
+	// Fences the current frame, and deletes objects whose last possible use has completed.
+	// To be called once per frame after the buffer swap.
+	void endFrame();
+
+	// Waits for the GPU, deletes everything pending, and reports objects which were never released.
+	void shutdown();
+
+	TypeStats getStats(GlResourceType type);
+	const char* getTypeName(GlResourceType type);
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include "Common.h"
+
+#include <string.h>
+
+// XXH64 (https://github.com/Cyan4973/xxHash). Used for cache keys and file change detection;
+// not meant to be cryptographically secure. Processes 32 bytes per round in four independent
+// lanes, which keeps it close to memory bandwidth without needing SIMD.
+namespace xxh64 {
+	const u64 prime1 = 11400714785074694791ull;
+	const u64 prime2 = 14029467366897019727ull;
+	const u64 prime3 = 1609587929392839161ull;
+	const u64 prime4 = 9650029242287828579ull;
+	const u64 prime5 = 2870177450012600261ull;
+
+	inline u64 rotl(u64 x, int r) {
+		return (x << r) | (x >> (64 - r));
+	}
+
+	inline u64 read64(const u8* p) {
+		u64 v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	inline u32 read32(const u8* p) {
+		u32 v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	inline u64 round(u64 acc, u64 input) {
+		acc += input * prime2;
+		acc = rotl(acc, 31);
+		return acc * prime1;
+	}
+
+	inline u64 mergeRound(u64 acc, u64 val) {
+		acc ^= round(0, val);
+		return acc * prime1 + prime4;
+	}
+}
+
+inline u64 hashBytes(const void* data, size_t size, u64 seed = 0)
+{
+	using namespace xxh64;
+
+	const u8* p = static_cast<const u8*>(data);
+	const u8* const end = p + size;
+	u64 h;
+
+	if (size >= 32) {
+		const u8* const limit = end - 32;
+		u64 v1 = seed + prime1 + prime2;
+		u64 v2 = seed + prime2;
+		u64 v3 = seed;
+		u64 v4 = seed - prime1;
+
+		do {
+			v1 = round(v1, read64(p));
+			v2 = round(v2, read64(p + 8));
+			v3 = round(v3, read64(p + 16));
+			v4 = round(v4, read64(p + 24));
+			p += 32;
+		} while (p <= limit);
+
+		h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+		h = mergeRound(h, v1);
+		h = mergeRound(h, v2);
+		h = mergeRound(h, v3);
+		h = mergeRound(h, v4);
+	}
+	else {
+		h = seed + prime5;
+	}
+
+	h += u64(size);
+
+	for (; p + 8 <= end; p += 8) {
+		h ^= round(0, read64(p));
+		h = rotl(h, 27) * prime1 + prime4;
+	}
+
+	if (p + 4 <= end) {
+		h ^= u64(read32(p)) * prime1;
+		h = rotl(h, 23) * prime2 + prime3;
+		p += 4;
+	}
+
+	for (; p < end; ++p) {
+		h ^= (*p) * prime5;
+		h = rotl(h, 11) * prime1;
+	}
+
+	h ^= h >> 33;
+	h *= prime2;
+	h ^= h >> 29;
+	h *= prime3;
+	h ^= h >> 32;
+
+	return h;
+}
@@ -8,6 +8,14 @@
 #include "Shader.h"
 #include "Texture.h"
 #include "OsUtil.h"
+#include "GlResources.h"
+#include "ShaderRegistry.h"
+#include "ShaderCache.h"
+#include "ThreadPool.h"
+#include "ShaderLibrary.h"
+#include "ReloadProfiler.h"
+#include "FrameProfiler.h"
+#include "EditorLink.h"
 
 #include <imgui.h>
 #include "imgui_impl_glfw_gl3.h"
@@ -23,6 +31,8 @@
 #include <unordered_set>
 #include <fstream>
 #include <algorithm>
+#include <chrono>
+#include <random>
 
 
 using JsonWriter = rapidjson::PrettyWriter<rapidjson::StringBuffer>;
@@ -51,28 +61,44 @@ namespace std {
 	struct hash<nodegraph::node_handle>
 	{
 		size_t operator()(const nodegraph::node_handle& k) const {
-			return size_t(k.idx) | (size_t(k.fingerprint) << 16);
+			return std::hash<u64>()(u64(k.idx) | (u64(k.fingerprint) << 32));
 		}
 	};
 }
 
 
-std::unordered_map<TextureKey, shared_ptr<CreatedTexture>> g_transientTextureCache;
+// Several textures with the same key are pooled, e.g. the intermediates of subgraph instances
+std::unordered_multimap<TextureKey, shared_ptr<CreatedTexture>> g_transientTextureCache;
+
+// Seconds since startup, as seen by the params annotated with time()
+float g_shaderTime = 0.0f;
 
 
 struct CompiledImage
 {
 	shared_ptr<CreatedTexture> tex;
 	bool owned = false;
+	bool recycled = false;
 
 	bool valid() const {
 		return tex && tex->texId != 0;
 	}
 
 	void release() {
-		g_transientTextureCache[tex->key] = tex;
+		if (!recycled) {
+			g_transientTextureCache.emplace(tex->key, tex);
+		}
+
 		tex = nullptr;
 		owned = false;
+		recycled = false;
+	}
+
+	// Returns the texture to the pool while the pass keeps using it. Only valid once every pass
+	// which reads it has been compiled, as passes compiled afterwards may be handed it again.
+	void recycle() {
+		g_transientTextureCache.emplace(tex->key, tex);
+		recycled = true;
 	}
 };
 
@@ -84,6 +110,9 @@ struct CompiledPass
 	ShaderParamIterProxy params;
 	ComputeShader* shader = nullptr;
 
+	// Passes of a subgraph instance, run before this one
+	vector<CompiledPass> fragment;
+
 	void render(u32 width, u32 height)
 	{
 		// TODO: clean up. this is only there for the Output node which doesn't have a shader
@@ -92,15 +121,13 @@ struct CompiledPass
 		}
 
 		glUseProgram(shader->m_programHandle);
-		u32 imgUnit = 0;
-		u32 texUnit = 0;
 
 		for (const auto& param : params) {
 			const auto& refl = param.refl;
 			const auto& value = param.value;
 
 			if (refl.type == ShaderParamType::Float) {
-				glUniform1f(refl.location, value.floatValue);
+				glUniform1f(refl.location, refl.annotation.has(ParamAnnotation::Flag_Time) ? g_shaderTime : value.floatValue);
 			}
 			else if (refl.type == ShaderParamType::Float2) {
 				glUniform2f(refl.location, value.float2Value.x, value.float2Value.y);
@@ -128,35 +155,32 @@ struct CompiledPass
 				if (img.valid()) {
 					const GLint level = 0;
 					const GLenum layered = GL_FALSE;
-					glBindImageTexture(imgUnit, img.tex->texId, level, layered, 0, GL_READ_ONLY, GL_RGBA16F);
-					glUniform1i(refl.location, imgUnit);
-					++imgUnit;
+					glBindImageTexture(refl.binding, img.tex->texId, level, layered, 0, GL_READ_ONLY, GL_RGBA16F);
+					glUniform1i(refl.location, refl.binding);
 				}
 			}
 			else if (refl.type == ShaderParamType::Sampler2d) {
 				CompiledImage& img = compiledImages[param.idx];
 				if (img.valid()) {
-					const GLint level = 0;
-					const GLenum layered = GL_FALSE;
-					glActiveTexture(GL_TEXTURE0 + texUnit);
+					glActiveTexture(GL_TEXTURE0 + refl.binding);
 					glBindTexture(GL_TEXTURE_2D, img.tex->texId);
-					glUniform1i(refl.location, texUnit);
+					glUniform1i(refl.location, refl.binding);
 
 					const GLuint samplerId = img.tex->samplerId;
 					glSamplerParameteri(samplerId, GL_TEXTURE_WRAP_S, value.textureValue.wrapS ? GL_REPEAT : GL_CLAMP_TO_EDGE);
 					glSamplerParameteri(samplerId, GL_TEXTURE_WRAP_T, value.textureValue.wrapT ? GL_REPEAT : GL_CLAMP_TO_EDGE);
-					glBindSampler(texUnit, samplerId);
-					++texUnit;
+					glBindSampler(refl.binding, samplerId);
 				}
 			}
 		}
 
-		GLint workGroupSize[3];
-		glGetProgramiv(shader->m_programHandle, GL_COMPUTE_WORK_GROUP_SIZE, workGroupSize);
+		const u32* const workGroupSize = shader->m_workGroupSize;
 		glDispatchCompute(
 			(width + workGroupSize[0] - 1) / workGroupSize[0],
 			(height + workGroupSize[1] - 1) / workGroupSize[1],
 			1);
+
+		ReloadProfiler::mark(shader, ReloadProfiler::Stage::FirstDispatch);
 	}
 };
 
@@ -183,6 +207,14 @@ struct IRenderPass
 {
 	virtual ~IRenderPass() {}
 	virtual ShaderParamIterProxy params() = 0;
+
+	// Called once per frame, before the graph and UI. Returns true if the params changed
+	// in a way which can affect the ports of the pass' node.
+	virtual bool update() { return takeParamsChanged(); }
+
+	// Flags such a change made from outside, e.g. by the UI changing the source of an image
+	void invalidateParams() { m_paramsChanged = true; }
+
 	virtual bool compile(const PassCompilerSettings& settings, CompiledPass *const compiled) = 0;
 	virtual int findParamByPortUid(nodegraph::port_uid uid) const = 0;
 	virtual std::string getDisplayName() const = 0;
@@ -194,6 +226,16 @@ struct IRenderPass
 		static u32 i = 0;
 		return ++i;
 	}
+
+protected:
+	bool takeParamsChanged() {
+		const bool result = m_paramsChanged;
+		m_paramsChanged = false;
+		return result;
+	}
+
+private:
+	bool m_paramsChanged = false;
 };
 
 // Create or load the image
@@ -202,30 +244,26 @@ bool compileImage(const PassCompilerSettings& settings, IRenderPass& pass, const
 	if (desc.source == TextureDesc::Source::Create) {
 		TextureKey key = { 1, 1, GL_RGBA16F };
 		if (desc.useRelativeScale) {
-			if (desc.scaleRelativeTo == "#window") {
+			if (desc.scaleRelativeToIdx == TextureDesc::RelativeToWindow) {
 				key.width = u32(std::max(0.0f, desc.relativeScale.x) * settings.windowSize.x);
 				key.height = u32(std::max(0.0f, desc.relativeScale.y) * settings.windowSize.y);
-			} else {
-				u32 otherParamIdx = 0;
-				for (const auto& param : pass.params()) {
-					if (param.refl.name == desc.scaleRelativeTo) {
-						const bool isImage = param.refl.type == ShaderParamType::Sampler2d || param.refl.type == ShaderParamType::Image2d;
-						const bool isInputImage = isImage && param.value.textureValue.source != TextureDesc::Source::Create;
-
-						if (isInputImage) {
-							auto& otherImg = compiledPass->compiledImages[otherParamIdx].tex;
-							if (!otherImg) {
-								// TODO: report an error; a required input isn't these, thus we can't compile this graph
-								return false;
-							}
-							key.width = u32(std::max(0.0f, desc.relativeScale.x) * otherImg->key.width);
-							key.height = u32(std::max(0.0f, desc.relativeScale.y) * otherImg->key.height);
-						} else {
-							// TODO: report an error. can only have scale relative to non-created textures
-						}
+			} else if (desc.scaleRelativeToIdx >= 0 && desc.scaleRelativeToIdx < int(pass.params().size())) {
+				const u32 otherParamIdx = u32(desc.scaleRelativeToIdx);
+				const auto param = pass.params()[otherParamIdx];
+
+				const bool isImage = param.refl.type == ShaderParamType::Sampler2d || param.refl.type == ShaderParamType::Image2d;
+				const bool isInputImage = isImage && param.value.textureValue.source != TextureDesc::Source::Create;
+
+				if (isInputImage) {
+					auto& otherImg = compiledPass->compiledImages[otherParamIdx].tex;
+					if (!otherImg) {
+						// TODO: report an error; a required input isn't these, thus we can't compile this graph
+						return false;
 					}
-
-					++otherParamIdx;
+					key.width = u32(std::max(0.0f, desc.relativeScale.x) * otherImg->key.width);
+					key.height = u32(std::max(0.0f, desc.relativeScale.y) * otherImg->key.height);
+				} else {
+					// TODO: report an error. can only have scale relative to non-created textures
 				}
 			}
 		} else {
@@ -303,32 +341,36 @@ struct Pass : IRenderPass
 {
 	Pass(const std::string& shaderPath)
 	{
-		m_computeShader = ComputeShader(shaderPath);
+		m_computeShader = ShaderRegistry::acquire(shaderPath);
 		updateParams();
-
-		FileWatcher::watchFile(shaderPath.c_str(), [this]()
-		{
-			if (m_computeShader.reload()) {
-				updateParams();
-			}
-		});
 	}
 
-	~Pass() {
-		FileWatcher::stopWatchingFile(m_computeShader.m_sourceFile.c_str());
+	bool update() override {
+		if (m_shaderVersionId != m_computeShader->versionId) {
+			updateParams();
+			invalidateParams();
+			ReloadProfiler::mark(m_computeShader.get(), ReloadProfiler::Stage::GraphUpdate);
+		}
+
+		return takeParamsChanged();
 	}
 
 	ShaderParamIterProxy params() override {
-		return ShaderParamIterProxy(m_computeShader.m_params, m_paramValues, m_paramUids);
+		return ShaderParamIterProxy(m_computeShader->m_params, m_paramValues, m_paramUids);
 	}
 
 	const ComputeShader& shader() const {
-		return m_computeShader;
+		return *m_computeShader;
 	}
  
 	bool compile(const PassCompilerSettings& settings, CompiledPass *const compiled) override
 	{
-		compiled->shader = &m_computeShader;
+		// Still compiling, or failed to
+		if (!m_computeShader->m_programHandle.valid()) {
+			return false;
+		}
+
+		compiled->shader = m_computeShader.get();
 		compiled->params = params();
 		compiled->paramLocations.resize(m_paramRefl.size());
 
@@ -342,8 +384,7 @@ struct Pass : IRenderPass
 		}
 
 		for (size_t i = 0; i < m_paramRefl.size(); ++i) {
-			const GLint loc = glGetUniformLocation(m_computeShader.m_programHandle, m_paramRefl[i].name.c_str());
-			compiled->paramLocations[i] = loc;
+			compiled->paramLocations[i] = m_computeShader->m_params[i].location;
 
 			if (m_paramRefl[i].type == ShaderParamType::Image2d && m_paramValues[i].textureValue.source != TextureDesc::Source::Load) {
 				if (!compileImage(settings, *this, m_paramValues[i].textureValue, &compiled->compiledImages[i], compiled)) {
@@ -357,18 +398,13 @@ struct Pass : IRenderPass
 
 	int findParamByPortUid(nodegraph::port_uid uid) const override
 	{
-		for (int i = 0; i < int(m_paramUids.size()); ++i) {
-			if (m_paramUids[i] == uid) {
-				return i;
-			}
-		}
-
-		return -1;
+		auto found = m_paramIdxByUid.find(uid);
+		return found != m_paramIdxByUid.end() ? found->second : -1;
 	}
 
 	std::string getDisplayName() const override
 	{
-		std::string filename = fs::path(m_computeShader.m_sourceFile).filename().string();
+		std::string filename = fs::path(m_computeShader->m_sourceFile).filename().string();
 		return filename.substr(0, filename.find_last_of("."));
 	}
 
@@ -382,7 +418,7 @@ struct Pass : IRenderPass
 		writer.String("Compute");
 
 		writer.String("shader");
-		writer.String(m_computeShader.m_sourceFile.c_str());
+		writer.String(m_computeShader->m_sourceFile.c_str());
 	}
 
 	void deserialize(rapidjson::Value& json) override
@@ -392,11 +428,11 @@ struct Pass : IRenderPass
 
 private:
 	void updateParams() {
-		vector<ShaderParamValue> newValues(m_computeShader.m_params.size());
-		vector<u32> newUids(m_computeShader.m_params.size());
+		vector<ShaderParamValue> newValues(m_computeShader->m_params.size());
+		vector<u32> newUids(m_computeShader->m_params.size());
 
 		for (size_t i = 0; i < newValues.size(); ++i) {
-			ShaderParamBindingRefl& newRefl = m_computeShader.m_params[i];
+			ShaderParamBindingRefl& newRefl = m_computeShader->m_params[i];
 			ShaderParamValue& newValue = newValues[i];
 			u32& newUid = newUids[i];
 
@@ -409,7 +445,7 @@ private:
 					newUid = m_paramUids[src];
 				} else {
 					// Otherwise we found the param by name, but the type changed. Use the default.
-					newValue = m_computeShader.m_params[i].defaultValue();
+					newValue = m_computeShader->m_params[i].defaultValue();
 					newUid = nextParamUid();
 				}
 
@@ -427,7 +463,7 @@ private:
 						newUid = prevMatch->uid;
 					} else {
 						// Otherwise we have found an old param, but its type is now different. Use the default.
-						newValue = m_computeShader.m_params[i].defaultValue();
+						newValue = m_computeShader->m_params[i].defaultValue();
 						newUid = nextParamUid();
 					}
 
@@ -435,7 +471,7 @@ private:
 					prevMatch->refl.name.clear();
 				} else {
 					// No match found anywhere. Just go with the default.
-					newValue = m_computeShader.m_params[i].defaultValue();
+					newValue = m_computeShader->m_params[i].defaultValue();
 					newUid = nextParamUid();
 				}
 			}
@@ -455,18 +491,35 @@ private:
 			}
 		}
 
+		// Carried over values might point at a different param index in the new shader version
+		for (size_t i = 0; i < newValues.size(); ++i) {
+			if (m_computeShader->m_params[i].type == ShaderParamType::Image2d) {
+				TextureDesc& tex = newValues[i].textureValue;
+				tex.scaleRelativeToIdx = resolveRelativeScaleTarget(m_computeShader->m_params, tex.scaleRelativeTo);
+			}
+		}
+
 		newValues.swap(m_paramValues);
 		newUids.swap(m_paramUids);
-		m_paramRefl.resize(m_computeShader.m_params.size());
+		m_paramRefl.resize(m_computeShader->m_params.size());
+
+		m_paramIdxByUid.clear();
+		for (size_t i = 0; i < m_paramUids.size(); ++i) {
+			m_paramIdxByUid[m_paramUids[i]] = int(i);
+		}
 
 		for (size_t i = 0; i < m_paramRefl.size(); ++i) {
-			m_paramRefl[i] = m_computeShader.m_params[i];
+			m_paramRefl[i] = m_computeShader->m_params[i];
 		}
+
+		m_shaderVersionId = m_computeShader->versionId;
 	}
 
-	ComputeShader m_computeShader;
+	shared_ptr<ComputeShader> m_computeShader;
+	u32 m_shaderVersionId = 0;
 	vector<ShaderParamValue> m_paramValues;
 	vector<u32> m_paramUids;
+	std::unordered_map<u32, int> m_paramIdxByUid;
 
 	// Kept around for preserving previous values across shader reload and shader modifications
 	vector<ShaderParamRefl> m_paramRefl;
@@ -507,13 +560,13 @@ void serializeGraph(nodegraph::Graph& graph, JsonWriter& writer)
 			writer.String("idx");
 			writer.Int(portHandle.idx);
 
-			const nodegraph::Port& port = graph.ports[portHandle.idx];
 			writer.String("uid");
-			writer.Int(port.uid);
+			writer.Int(graph.ports.uid[portHandle.idx]);
 
-			if (port.link != nodegraph::invalid_link_idx) {
+			const nodegraph::link_idx link = graph.ports.link[portHandle.idx];
+			if (link != nodegraph::invalid_link_idx) {
 				writer.String("link");
-				writer.Int(port.link);
+				writer.Int(link);
 			}
 
 			writer.EndObject();
@@ -528,9 +581,8 @@ void serializeGraph(nodegraph::Graph& graph, JsonWriter& writer)
 			writer.String("idx");
 			writer.Int(portHandle.idx);
 
-			const nodegraph::Port& port = graph.ports[portHandle.idx];
 			writer.String("uid");
-			writer.Int(port.uid);
+			writer.Int(graph.ports.uid[portHandle.idx]);
 
 			writer.EndObject();
 		});
@@ -575,6 +627,9 @@ void deserializeGraph(nodegraph::Graph *const graph, const rapidjson::Value& jso
 	}*/
 }
 
+// Defined with SubgraphPass, which needs the complete Package
+shared_ptr<IRenderPass> createSubgraphPass(const std::string& path);
+
 struct CompiledPackage
 {
 	vector<CompiledPass> orderedPasses;
@@ -586,10 +641,32 @@ struct Package
 	vector<shared_ptr<IRenderPass>> m_passes;
 	nodegraph::Graph graph;
 
+	// Nodes whose passes reported param changes in updatePasses
+	vector<nodegraph::node_idx> m_dirtyNodes;
+
+	// Topology the passes were last compiled against; see getSnapshot
+	shared_ptr<const nodegraph::GraphSnapshot> m_snapshot;
+
+	// Loaded links whose ports don't exist yet; see resolvePendingLinks
+	struct PendingLink {
+		nodegraph::node_handle srcNode;
+		std::string srcParam;
+		nodegraph::node_handle dstNode;
+		std::string dstParam;
+	};
+	vector<PendingLink> m_pendingLinks;
+
+	// Debug builds check the graph after every change; see updateGraph
+	u64 m_validatedGeneration = 0;
+
 	nodegraph::node_handle addOutputPass() {
 		return addPass(make_shared<OutputPass>());
 	}
 
+	nodegraph::node_handle addComputePass(const std::string& shaderPath) {
+		return addPass(make_shared<Pass>(shaderPath));
+	}
+
 	void deletePass(u32 passIndex) {
 		m_passes[passIndex] = nullptr;
 	}
@@ -608,15 +685,105 @@ struct Package
 		}
 	}
 
+	// Returns true if any of the passes changed
+	bool updatePasses()
+	{
+		const size_t prevDirtyCount = m_dirtyNodes.size();
+		for (size_t i = 0; i < m_passes.size(); ++i) {
+			if (m_passes[i] && m_passes[i]->update()) {
+				m_dirtyNodes.push_back(nodegraph::node_idx(i));
+			}
+		}
+
+		return m_dirtyNodes.size() != prevDirtyCount;
+	}
+
+	// Reconciles the ports of the nodes whose passes changed since the last call
 	void updateGraph()
 	{
-		graph.iterNodes([&](nodegraph::node_handle nodeHandle)
-		{
-			IRenderPass& pass = *m_passes[nodeHandle.idx];
-			nodegraph::NodeDesc desc;
-			getNodeDesc(pass, &desc);
+		nodegraph::NodeDesc desc;
+		for (const nodegraph::node_idx nodeIdx : m_dirtyNodes) {
+			if (!m_passes[nodeIdx]) {
+				continue;
+			}
+
+			const nodegraph::node_handle nodeHandle(nodeIdx, graph.nodes.fingerprint[nodeIdx]);
+			getNodeDesc(*m_passes[nodeIdx], &desc);
 			graph.updateNode(nodeHandle, desc);
-		});
+			graph.markNodeModified(nodeHandle);
+		}
+
+		m_dirtyNodes.clear();
+
+		if (!m_pendingLinks.empty()) {
+			resolvePendingLinks();
+		}
+
+#ifdef _DEBUG
+		// Also catches the edits made through the GUI since the last call
+		if (m_validatedGeneration != graph.generation) {
+			std::string error;
+			if (!graph.validate(&error)) {
+				fprintf(stderr, "Node graph is inconsistent: %s\n", error.c_str());
+				assert(false);
+			}
+
+			m_validatedGeneration = graph.generation;
+		}
+#endif
+	}
+
+	bool isNodeAlive(nodegraph::node_handle nodeHandle) const
+	{
+		return graph.nodes.livePos[nodeHandle.idx] != nodegraph::invalid_node_idx
+			&& graph.nodes.fingerprint[nodeHandle.idx] == nodeHandle.fingerprint;
+	}
+
+	// invalid_port_idx if the node doesn't have a port for the param
+	nodegraph::port_idx findPortByParamName(nodegraph::node_idx nodeIdx, bool isOutput, const std::string& name)
+	{
+		for (const auto& p : m_passes[nodeIdx]->params()) {
+			if (p.refl.name == name) {
+				return isOutput ? graph.findOutputPort(nodeIdx, p.uid) : graph.findInputPort(nodeIdx, p.uid);
+			}
+		}
+
+		return nodegraph::invalid_port_idx;
+	}
+
+	const char* getPortParamName(nodegraph::port_idx port)
+	{
+		IRenderPass& pass = *m_passes[graph.ports.node[port]];
+		const int paramIdx = pass.findParamByPortUid(graph.ports.uid[port]);
+		return paramIdx != -1 ? pass.params()[paramIdx].refl.name.c_str() : nullptr;
+	}
+
+	// Saved links refer to params by name, and the ports for those only appear once the shaders
+	// have been compiled. Links stay pending until then, or until either node is removed.
+	void resolvePendingLinks()
+	{
+		for (size_t i = 0; i < m_pendingLinks.size(); ) {
+			const PendingLink& link = m_pendingLinks[i];
+			bool done = !isNodeAlive(link.srcNode) || !isNodeAlive(link.dstNode);
+
+			if (!done) {
+				const nodegraph::port_idx srcPort = findPortByParamName(link.srcNode.idx, true, link.srcParam);
+				const nodegraph::port_idx dstPort = findPortByParamName(link.dstNode.idx, false, link.dstParam);
+
+				if (srcPort != nodegraph::invalid_port_idx && dstPort != nodegraph::invalid_port_idx) {
+					graph.addLink(srcPort, dstPort);
+					done = true;
+				}
+			}
+
+			if (done) {
+				m_pendingLinks[i] = m_pendingLinks.back();
+				m_pendingLinks.pop_back();
+			}
+			else {
+				++i;
+			}
+		}
 	}
 
 	void handleFileDrop(const std::string& path)
@@ -624,94 +791,132 @@ struct Package
 		if (ends_with(path, ".glsl")) {
 			addPass(make_shared<Pass>(path));
 		}
+		else if (ends_with(path, ".state")) {
+			addPass(createSubgraphPass(path));
+		}
 	}
 
-	nodegraph::node_handle getOutputPass()
+	// Rebuilt whenever the graph has changed since the last one was taken
+	shared_ptr<const nodegraph::GraphSnapshot> getSnapshot()
 	{
-		nodegraph::node_handle result;
+		if (!m_snapshot || m_snapshot->generation != graph.generation) {
+			m_snapshot = nodegraph::makeSnapshot(graph);
+		}
 
-		graph.iterNodes([&](nodegraph::node_handle nodeHandle) {
-			if (graph.nodes[nodeHandle.idx].firstOutputPort == nodegraph::invalid_port_idx) {
-				result = nodeHandle;
+		return m_snapshot;
+	}
+
+	static u32 findOutputPass(const nodegraph::GraphSnapshot& snapshot)
+	{
+		u32 result = nodegraph::GraphSnapshot::invalidIdx;
+		for (u32 i = 0; i < snapshot.size(); ++i) {
+			if (0 == snapshot.outputCount[i]) {
+				result = i;
 			}
-		});
+		}
 
 		return result;
 	}
 
-	void findPassOrder(nodegraph::node_handle outputPass, vector<nodegraph::node_idx> *const order)
+	// Orders the passes which the output depends on so that producers come before their consumers.
+	// Returns false if they form a cycle.
+	static bool findPassOrder(const nodegraph::GraphSnapshot& snapshot, u32 outputPass, vector<u32> *const order)
 	{
-		vector<bool> visited(graph.nodes.size(), false);
+		enum : u8 { Unvisited, InProgress, Done };
+		vector<u8> state(snapshot.size(), Unvisited);
+
+		// Iterative depth-first search, emitting nodes in post-order
+		struct Frame { u32 node; u32 nextSlot; };
+		vector<Frame> stack;
+		stack.push_back({ outputPass, snapshot.inputBegin[outputPass] });
+		state[outputPass] = InProgress;
+
+		while (!stack.empty()) {
+			Frame& frame = stack.back();
+
+			if (frame.nextSlot == snapshot.inputBegin[frame.node + 1]) {
+				state[frame.node] = Done;
+				order->push_back(frame.node);
+				stack.pop_back();
+				continue;
+			}
 
-		std::queue<nodegraph::node_idx> nodeq;
-		nodeq.push(outputPass.idx);
-		visited[outputPass.idx] = true;
+			// TODO: only follow valid links, return error if not all ports are connected
+			const u32 producer = snapshot.producer[frame.nextSlot++];
+			if (nodegraph::GraphSnapshot::invalidIdx == producer || Done == state[producer]) {
+				continue;
+			}
 
-		while (!nodeq.empty()) {
-			nodegraph::node_idx nodeIdx = nodeq.front();
-			nodeq.pop();
-			order->push_back(nodeIdx);
+			if (InProgress == state[producer]) {
+				return false;
+			}
 
-			// TODO: only follow valid links, return error if not all ports are connected
-			graph.iterNodeIncidentLinks(nodeIdx, [&](nodegraph::link_handle linkHandle) {
-				nodegraph::node_idx srcNode = graph.ports[graph.links[linkHandle.idx].srcPort].node;
-				if (!visited[srcNode]) {
-					visited[srcNode] = true;
-					nodeq.push(srcNode);
-				}
-			});
+			state[producer] = InProgress;
+			stack.push_back({ producer, snapshot.inputBegin[producer] });
 		}
 
-		std::reverse(order->begin(), order->end());
+		return true;
+	}
+
+	// Propagates the textures of already compiled passes to the connected inputs of a pass
+	static void bindInputs(
+		const nodegraph::GraphSnapshot& snapshot,
+		u32 node,
+		const vector<shared_ptr<IRenderPass>>& passes,
+		const vector<CompiledPass*>& compiledPasses,
+		CompiledPass *const dstCompiled)
+	{
+		IRenderPass& dstPass = *passes[snapshot.nodes[node]];
+
+		for (u32 slot = snapshot.inputBegin[node]; slot < snapshot.inputBegin[node + 1]; ++slot) {
+			const u32 producer = snapshot.producer[slot];
+			if (nodegraph::GraphSnapshot::invalidIdx == producer) {
+				continue;
+			}
+
+			IRenderPass& srcPass = *passes[snapshot.nodes[producer]];
+			CompiledPass& srcCompiled = *compiledPasses[producer];
+
+			const int srcParamIdx = srcPass.findParamByPortUid(snapshot.producerUid[slot]);
+			const int dstParamIdx = dstPass.findParamByPortUid(snapshot.inputUid[slot]);
+
+			if (srcParamIdx != -1 && dstParamIdx != -1) {
+				dstCompiled->compiledImages[dstParamIdx].tex = srcCompiled.compiledImages[srcParamIdx].tex;
+			}
+		}
 	}
 
 	bool compile(const PassCompilerSettings& settings, CompiledPackage *const compiled) {
-		u32 alivePassCount = 0;
-		graph.iterNodes([&](nodegraph::node_handle) {
-			++alivePassCount;
-		});
+		const shared_ptr<const nodegraph::GraphSnapshot> snapshotRef = getSnapshot();
+		const nodegraph::GraphSnapshot& snapshot = *snapshotRef;
 
 		compiled->orderedPasses.clear();
 
 		// Find the output pass
-		nodegraph::node_handle outputPass = getOutputPass();
-		if (!outputPass.valid()) {
+		const u32 outputPass = findOutputPass(snapshot);
+		if (nodegraph::GraphSnapshot::invalidIdx == outputPass) {
 			return false;
 		}
 
 		// Perform a topological sort, and identify the order to run passes in
-		vector<nodegraph::node_idx> passOrder;
-		findPassOrder(outputPass, &passOrder);
+		vector<u32> passOrder;
+		if (!findPassOrder(snapshot, outputPass, &passOrder)) {
+			return false;
+		}
 
 		compiled->orderedPasses.resize(passOrder.size());
-		vector<CompiledPass*> passToCompiledPass(m_passes.size(), nullptr);
+		vector<CompiledPass*> passToCompiledPass(snapshot.size(), nullptr);
 
 		// Compile passes, create and load textures
 		u32 compiledPassIdx = 0;
-		for (const nodegraph::node_idx nodeIdx : passOrder) {
-			IRenderPass& dstPass = *m_passes[nodeIdx];
+		for (const u32 node : passOrder) {
+			IRenderPass& dstPass = *m_passes[snapshot.nodes[node]];
 			CompiledPass& dstCompiled = compiled->orderedPasses[compiledPassIdx++];
-			passToCompiledPass[nodeIdx] = &dstCompiled;
+			passToCompiledPass[node] = &dstCompiled;
 
 			dstCompiled.compiledImages.clear();
 			dstCompiled.compiledImages.resize(dstPass.params().size());
-
-			// Propagate texture inputs
-			graph.iterNodeIncidentLinks(nodeIdx, [&](nodegraph::link_handle linkHandle) {
-				const nodegraph::Link& link = graph.links[linkHandle.idx];
-				IRenderPass& srcPass = *m_passes[graph.ports[link.srcPort].node];
-				CompiledPass& srcCompiled = *passToCompiledPass[graph.ports[link.srcPort].node];
-
-				const nodegraph::Port& srcPort = graph.ports[link.srcPort];
-				const nodegraph::Port& dstPort = graph.ports[link.dstPort];
-
-				const int srcParamIdx = srcPass.findParamByPortUid(srcPort.uid);
-				const int dstParamIdx = dstPass.findParamByPortUid(dstPort.uid);
-
-				if (srcParamIdx != -1 && dstParamIdx != -1) {
-					dstCompiled.compiledImages[dstParamIdx].tex = srcCompiled.compiledImages[srcParamIdx].tex;
-				}
-			});
+			bindInputs(snapshot, node, m_passes, passToCompiledPass, &dstCompiled);
 
 			if (!dstPass.compile(settings, &dstCompiled)) {
 				return false;
@@ -719,13 +924,17 @@ struct Package
 		}
 
 		compiled->outputTexture = nullptr;
-		for (auto& img : passToCompiledPass[outputPass.idx]->compiledImages) {
+		for (auto& img : passToCompiledPass[outputPass]->compiledImages) {
 			if (img.valid()) {
 				compiled->outputTexture = img.tex;
 				break;
 			}
 		}
 
+		for (const CompiledPass& pass : compiled->orderedPasses) {
+			ReloadProfiler::mark(pass.shader, ReloadProfiler::Stage::PackageCompile);
+		}
+
 		return true;
 	}
 
@@ -749,6 +958,32 @@ struct Package
 		writer.StartObject();
 		serializeGraph(graph, writer);
 		writer.EndObject();
+
+		// By param name, as port UIDs are only valid within a session
+		writer.String("links");
+		writer.StartArray();
+		graph.iterNodes([&](nodegraph::node_handle nodeHandle) {
+			graph.iterNodeIncidentLinks(nodeHandle, [&](nodegraph::link_handle linkHandle) {
+				const nodegraph::port_idx srcPort = graph.links.srcPort[linkHandle.idx];
+				const nodegraph::port_idx dstPort = graph.links.dstPort[linkHandle.idx];
+				const char* const srcParam = getPortParamName(srcPort);
+				const char* const dstParam = getPortParamName(dstPort);
+
+				if (srcParam && dstParam) {
+					writer.StartObject();
+					writer.String("src");
+					writer.Int(graph.ports.node[srcPort]);
+					writer.String("srcParam");
+					writer.String(srcParam);
+					writer.String("dst");
+					writer.Int(graph.ports.node[dstPort]);
+					writer.String("dstParam");
+					writer.String(dstParam);
+					writer.EndObject();
+				}
+			});
+		});
+		writer.EndArray();
 	}
 
 	void reset()
@@ -756,6 +991,9 @@ struct Package
 		resetNodeGraphGui(graph);
 		graph = nodegraph::Graph();
 		m_passes.clear();
+		m_dirtyNodes.clear();
+		m_snapshot.reset();
+		m_pendingLinks.clear();
 	}
 
 	nodegraph::node_handle deserializeNode(rapidjson::Value& json)
@@ -767,6 +1005,8 @@ struct Package
 			pass = make_shared<OutputPass>();
 		} else if (0 == strcmp(nodeType, "Compute")) {
 			pass = make_shared<Pass>(json["shader"].GetString());
+		} else if (0 == strcmp(nodeType, "Subgraph")) {
+			pass = createSubgraphPass(json["package"].GetString());
 		} else {
 			assert(false);
 		}
@@ -780,6 +1020,17 @@ struct Package
 		auto& passArray = doc["passes"];
 		const size_t passCount = passArray.Size();
 
+		// Kick off all shader compilation up front; passes go live as their programs finish
+		vector<std::string> shaderPaths;
+		for (size_t i = 0; i < passCount; ++i) {
+			auto& node = passArray[i];
+			if (0 == strcmp(node["type"].GetString(), "Compute")) {
+				shaderPaths.push_back(node["shader"].GetString());
+			}
+		}
+
+		const vector<shared_ptr<ComputeShader>> prefetchedShaders = ShaderRegistry::prefetch(shaderPaths);
+
 		for (size_t i = 0; i < passCount; ++i ) {
 			auto& node = passArray[i];
 			const int idx = node["idx"].GetInt();
@@ -789,6 +1040,19 @@ struct Package
 		}
 	
 		deserializeGraph(&graph, doc["graph"], *nodeMap);
+
+		if (doc.HasMember("links")) {
+			const rapidjson::Value& links = doc["links"];
+			for (rapidjson::SizeType i = 0; i < links.Size(); ++i) {
+				const rapidjson::Value& link = links[i];
+				auto srcNode = nodeMap->find(link["src"].GetInt());
+				auto dstNode = nodeMap->find(link["dst"].GetInt());
+
+				if (srcNode != nodeMap->end() && dstNode != nodeMap->end()) {
+					m_pendingLinks.push_back({ srcNode->second, link["srcParam"].GetString(), dstNode->second, link["dstParam"].GetString() });
+				}
+			}
+		}
 	}
 
 private:
@@ -810,113 +1074,526 @@ private:
 	}
 };
 
-struct Project
+// A package saved to disk, referenced by subgraph nodes. It's loaded and scheduled once, and every
+// instance runs the same passes and programs, with its own input textures and param values.
+struct SubgraphDef
 {
-	vector<shared_ptr<Package>> m_packages;
+	std::string path;
+	Package package;
+	bool loading = false;
+
+	// Schedule of the package, rebuilt when its graph changes; version is bumped when it is
+	shared_ptr<const nodegraph::GraphSnapshot> snapshot;
+	vector<u32> passOrder;
+	u32 outputPass = nodegraph::GraphSnapshot::invalidIdx;
+	u32 version = 0;
+
+	// Unconnected inputs of the scheduled passes, which instances expose as their own
+	struct ExposedInput {
+		u32 slot;			// in the input arrays of the snapshot
+		u64 key;			// identifies the input across schedule rebuilds
+		std::string name;
+	};
+	vector<ExposedInput> exposedInputs;
 
-	void handleFileDrop(const std::string& path)
+	bool valid() const {
+		return outputPass != nodegraph::GraphSnapshot::invalidIdx;
+	}
+
+	void update()
 	{
-		m_packages.back()->handleFileDrop(path);
+		package.updatePasses();
+		package.updateGraph();
+
+		if (!snapshot || snapshot->generation != package.graph.generation) {
+			updateSchedule();
+		}
+	}
+
+private:
+	void updateSchedule()
+	{
+		snapshot = package.getSnapshot();
+		passOrder.clear();
+		exposedInputs.clear();
+		++version;
+
+		outputPass = Package::findOutputPass(*snapshot);
+		if (!valid() || !Package::findPassOrder(*snapshot, outputPass, &passOrder)) {
+			outputPass = nodegraph::GraphSnapshot::invalidIdx;
+			return;
+		}
+
+		for (const u32 node : passOrder) {
+			if (node == outputPass) {
+				continue;
+			}
+
+			IRenderPass& pass = *package.m_passes[snapshot->nodes[node]];
+			for (u32 slot = snapshot->inputBegin[node]; slot < snapshot->inputBegin[node + 1]; ++slot) {
+				const int paramIdx = pass.findParamByPortUid(snapshot->inputUid[slot]);
+				if (nodegraph::GraphSnapshot::invalidIdx == snapshot->producer[slot] && paramIdx != -1) {
+					const u64 key = (u64(snapshot->nodes[node]) << 32) | snapshot->inputUid[slot];
+					exposedInputs.push_back({ slot, key, pass.params()[paramIdx].refl.name });
+				}
+			}
+		}
 	}
 };
 
-Project g_project;
+// By path; definitions live as long as any of their instances
+std::unordered_map<std::string, std::weak_ptr<SubgraphDef>> g_subgraphDefs;
 
-void doTextureLoadUi(ShaderParamValue& value)
+shared_ptr<SubgraphDef> acquireSubgraphDef(const std::string& path)
 {
-	if (ImGui::Button("Browse...")) {
-		openFileDialog("Select an image", "Image Files\0*.exr\0", &value.textureValue.path);
+	std::weak_ptr<SubgraphDef>& entry = g_subgraphDefs[path];
+	if (shared_ptr<SubgraphDef> existing = entry.lock()) {
+		if (existing->loading) {
+			fprintf(stderr, "Subgraph %s references itself\n", path.c_str());
+			return make_shared<SubgraphDef>();
+		}
+
+		return existing;
 	}
 
-	ImGui::SameLine();
-	ImGui::Text(value.textureValue.path.c_str());
+	shared_ptr<SubgraphDef> def = make_shared<SubgraphDef>();
+	def->path = path;
+	entry = def;
+
+	std::error_code ec;
+	vector<char> data = fs::exists(path, ec) ? loadTextFileZ(path.c_str()) : vector<char>(1, '\0');
+	rapidjson::Document doc;
+	doc.Parse(data.data(), data.size());
+
+	if (!doc.HasParseError() && doc.IsObject() && doc.HasMember("passes") && doc.HasMember("graph")) {
+		std::unordered_map<int, nodegraph::node_handle> nodeMap;
+		def->loading = true;
+		def->package.deserialize(doc, &nodeMap);
+		def->loading = false;
+	}
+	else {
+		fprintf(stderr, "Could not load subgraph %s\n", path.c_str());
+	}
+
+	return def;
 }
 
-void doPassUi(Pass& pass)
+struct SubgraphPass : IRenderPass
 {
-	int maxLabelWidth = 0;
-	for (auto& param : pass.params()) {
-		maxLabelWidth = std::max(maxLabelWidth, (int)ImGui::CalcTextSize(param.refl.name.c_str()).x);
+	SubgraphPass(const std::string& path)
+		: m_def(acquireSubgraphDef(path))
+	{
+		updateParams();
 	}
-	maxLabelWidth += 10;
 
-	for (auto& param : pass.params()) {
-		const auto& refl = param.refl;
-		auto& value = param.value;
+	bool update() override {
+		if (m_defVersion != m_def->version) {
+			updateParams();
+			invalidateParams();
+		}
 
-		ImGui::PushID(refl.name.c_str());
-		ImGui::Columns(2);
-		{
-			const int textWidth = (int)ImGui::CalcTextSize(refl.name.c_str()).x;
-			ImGui::SetCursorPosX(maxLabelWidth - textWidth);
-			ImGui::Text(refl.name.c_str());
+		return takeParamsChanged();
+	}
+
+	ShaderParamIterProxy params() override {
+		return ShaderParamIterProxy(m_paramRefl, m_paramValues, m_paramUids);
+	}
+
+	bool compile(const PassCompilerSettings& settings, CompiledPass *const compiled) override
+	{
+		const SubgraphDef& def = *m_def;
+		if (!def.valid() || m_defVersion != def.version) {
+			return false;
 		}
 
-		ImGui::SetColumnOffset(1, maxLabelWidth + 10);
-		ImGui::NextColumn();
+		const nodegraph::GraphSnapshot& snapshot = *def.snapshot;
+		compiled->fragment.clear();
+		compiled->fragment.resize(def.passOrder.size());
+		vector<CompiledPass*> nodeToCompiledPass(snapshot.size(), nullptr);
+
+		u32 fragmentIdx = 0;
+		for (const u32 node : def.passOrder) {
+			const nodegraph::node_idx nodeIdx = snapshot.nodes[node];
+			IRenderPass& pass = *def.package.m_passes[nodeIdx];
+			CompiledPass& passCompiled = compiled->fragment[fragmentIdx++];
+			nodeToCompiledPass[node] = &passCompiled;
+
+			passCompiled.compiledImages.resize(pass.params().size());
+			Package::bindInputs(snapshot, node, def.package.m_passes, nodeToCompiledPass, &passCompiled);
+
+			// The exposed inputs were bound to the params of this node by the enclosing package
+			for (u32 slot = snapshot.inputBegin[node]; slot < snapshot.inputBegin[node + 1]; ++slot) {
+				const int paramIdx = m_paramIdxBySlot[slot];
+				const int passParamIdx = pass.findParamByPortUid(snapshot.inputUid[slot]);
+				if (paramIdx != -1 && passParamIdx != -1) {
+					passCompiled.compiledImages[passParamIdx].tex = compiled->compiledImages[paramIdx].tex;
+				}
+			}
 
-		if (refl.type == ShaderParamType::Float) {
-			ImGui::SliderFloat("", &value.floatValue, refl.annotation.get("min", 0.0f), refl.annotation.get("max", 1.0f));
-		} else if (refl.type == ShaderParamType::Float2) {
-			ImGui::SliderFloat2("", &value.float2Value.x, refl.annotation.get("min", 0.0f), refl.annotation.get("max", 1.0f));
-		} else if (refl.type == ShaderParamType::Float3) {
-			if (refl.annotation.has("color")) {
-				ImGui::ColorEdit3("", &value.float3Value.x);
-			} else {
-				ImGui::SliderFloat3("", &value.float3Value.x, refl.annotation.get("min", 0.0f), refl.annotation.get("max", 1.0f));
+			if (!pass.compile(settings, &passCompiled)) {
+				return false;
 			}
-		} else if (refl.type == ShaderParamType::Float4) {
-			if (refl.annotation.has("color")) {
-				ImGui::ColorEdit4("", &value.float4Value.x);
-			} else {
-				ImGui::SliderFloat4("", &value.float4Value.x, refl.annotation.get("min", 0.0f), refl.annotation.get("max", 1.0f));
-			}
-		} else if (refl.type == ShaderParamType::Int) {
-			ImGui::SliderInt("", &value.intValue, refl.annotation.get("min", 0), refl.annotation.get("max", 16));
-		} else if (refl.type == ShaderParamType::Int2) {
-			ImGui::SliderInt2("", &value.int2Value.x, refl.annotation.get("min", 0), refl.annotation.get("max", 16));
-		} else if (refl.type == ShaderParamType::Int3) {
-			ImGui::SliderInt3("", &value.int3Value.x, refl.annotation.get("min", 0), refl.annotation.get("max", 16));
-		} else if (refl.type == ShaderParamType::Int4) {
-			ImGui::SliderInt4("", &value.int4Value.x, refl.annotation.get("min", 0), refl.annotation.get("max", 16));
-		} else if (refl.type == ShaderParamType::Sampler2d) {
-			{
-				ImGui::PushID("wrapS");
-				int wrapS = value.textureValue.wrapS ? 0 : 1;
-				const char* const wrapSValues[] = {
-					"Wrap S",
-					"Clamp S",
-				};
-				ImGui::PushItemWidth(100);
-				ImGui::Combo("", &wrapS, wrapSValues, sizeof(wrapSValues) / sizeof(*wrapSValues));
-				value.textureValue.wrapS = !wrapS;
-				ImGui::PopID();
+
+			if (passCompiled.shader) {
+				passCompiled.params = passCompiled.params.withValues(getInstanceValues(nodeIdx, pass.params()));
 			}
+		}
 
-			ImGui::SameLine();
+		shared_ptr<CreatedTexture> outputTexture;
+		for (auto& img : nodeToCompiledPass[def.outputPass]->compiledImages) {
+			if (img.valid()) {
+				outputTexture = img.tex;
+				break;
+			}
+		}
 
-			{
-				ImGui::PushID("wrapT");
-				int wrapT = value.textureValue.wrapT ? 0 : 1;
-				const char* const wrapTValues[] = {
-					"Wrap T",
-					"Clamp T",
-				};
-				ImGui::PushItemWidth(100);
-				ImGui::Combo("", &wrapT, wrapTValues, sizeof(wrapTValues) / sizeof(*wrapTValues));
-				value.textureValue.wrapT = !wrapT;
-				ImGui::PopID();
+		compiled->compiledImages[m_outputParamIdx].tex = outputTexture;
+
+		// Nothing outside the fragment reads the intermediates, so the next instances can reuse them
+		for (CompiledPass& pass : compiled->fragment) {
+			for (CompiledImage& img : pass.compiledImages) {
+				if (img.owned && img.tex != outputTexture) {
+					img.recycle();
+				}
 			}
+		}
 
-			ImGui::SameLine();
-			doTextureLoadUi(value);
-		} else if (refl.type == ShaderParamType::Image2d) {
-			ImGui::BeginGroup();
-			int sourceIdx = int(value.textureValue.source);
-			const char* const sources[] = {
-				"Load",
-				"Create",
-				"Input",
+		return true;
+	}
+
+	int findParamByPortUid(nodegraph::port_uid uid) const override
+	{
+		auto found = m_paramIdxByUid.find(uid);
+		return found != m_paramIdxByUid.end() ? found->second : -1;
+	}
+
+	std::string getDisplayName() const override
+	{
+		return fs::path(m_def->path).stem().string();
+	}
+
+	bool canBeRemoved() const override {
+		return true;
+	}
+
+	void serialize(JsonWriter& writer) override
+	{
+		writer.String("type");
+		writer.String("Subgraph");
+
+		writer.String("package");
+		writer.String(m_def->path.c_str());
+	}
+
+	void deserialize(rapidjson::Value& json) override
+	{
+		assert(0 == strcmp(json["type"].GetString(), "Subgraph"));
+	}
+
+	const SubgraphDef& def() const {
+		return *m_def;
+	}
+
+	// This instance's values for the params of a pass in the subgraph. They start off as the
+	// pass' own, and are carried over by UID when its shader changes.
+	vector<ShaderParamValue>& getInstanceValues(nodegraph::node_idx nodeIdx, ShaderParamIterProxy passParams)
+	{
+		InstanceValues& inst = m_instanceValues[nodeIdx];
+
+		bool upToDate = inst.uids.size() == passParams.size();
+		for (size_t i = 0; upToDate && i < inst.uids.size(); ++i) {
+			upToDate = inst.uids[i] == passParams[i].uid;
+		}
+
+		if (!upToDate) {
+			InstanceValues prev;
+			std::swap(prev, inst);
+
+			for (const auto& p : passParams) {
+				auto prevUid = std::find(prev.uids.begin(), prev.uids.end(), p.uid);
+				inst.uids.push_back(p.uid);
+				inst.values.push_back(prevUid != prev.uids.end() ? prev.values[prevUid - prev.uids.begin()] : p.value);
+			}
+		}
+
+		return inst.values;
+	}
+
+private:
+	void updateParams()
+	{
+		const SubgraphDef& def = *m_def;
+
+		m_paramRefl.clear();
+		m_paramValues.clear();
+		m_paramUids.clear();
+		m_paramIdxByUid.clear();
+		m_paramIdxBySlot.assign(def.snapshot ? def.snapshot->inputUid.size() : 0, -1);
+
+		for (const SubgraphDef::ExposedInput& input : def.exposedInputs) {
+			m_paramIdxBySlot[input.slot] = int(m_paramRefl.size());
+			addParam(input.name, TextureDesc::Source::Input, input.key);
+		}
+
+		m_outputParamIdx = int(m_paramRefl.size());
+		addParam("output", TextureDesc::Source::Create, u64(-1));
+
+		m_defVersion = def.version;
+	}
+
+	void addParam(const std::string& name, TextureDesc::Source source, u64 key)
+	{
+		// Keep the UIDs stable, so that links to the node survive changes to the subgraph
+		auto uid = m_uidByKey.find(key);
+		if (uid == m_uidByKey.end()) {
+			uid = m_uidByKey.emplace(key, nextParamUid()).first;
+		}
+
+		ShaderParamBindingRefl refl;
+		refl.name = name;
+		refl.type = ShaderParamType::Image2d;
+
+		ShaderParamValue value;
+		value.textureValue.source = source;
+
+		m_paramIdxByUid[uid->second] = int(m_paramRefl.size());
+		m_paramRefl.push_back(refl);
+		m_paramValues.push_back(value);
+		m_paramUids.push_back(uid->second);
+	}
+
+	shared_ptr<SubgraphDef> m_def;
+	u32 m_defVersion = 0;
+
+	vector<ShaderParamBindingRefl> m_paramRefl;
+	vector<ShaderParamValue> m_paramValues;
+	vector<u32> m_paramUids;
+	std::unordered_map<u32, int> m_paramIdxByUid;
+	std::unordered_map<u64, u32> m_uidByKey;
+	vector<int> m_paramIdxBySlot;
+	int m_outputParamIdx = 0;
+
+	struct InstanceValues {
+		vector<u32> uids;
+		vector<ShaderParamValue> values;
+	};
+	std::unordered_map<nodegraph::node_idx, InstanceValues> m_instanceValues;
+};
+
+shared_ptr<IRenderPass> createSubgraphPass(const std::string& path)
+{
+	return make_shared<SubgraphPass>(path);
+}
+
+struct Project
+{
+	vector<shared_ptr<Package>> m_packages;
+
+	void handleFileDrop(const std::string& path)
+	{
+		m_packages.back()->handleFileDrop(path);
+	}
+
+	// Returns true if any of the passes changed. Changes to subgraphs show up through their instances.
+	bool updatePasses()
+	{
+		// Before the packages, so that subgraph instances see the latest schedules
+		for (auto& it : g_subgraphDefs) {
+			if (shared_ptr<SubgraphDef> def = it.second.lock()) {
+				def->update();
+			}
+		}
+
+		bool changed = false;
+		for (auto& package : m_packages) {
+			changed |= package->updatePasses();
+		}
+
+		return changed;
+	}
+};
+
+Project g_project;
+
+// Measures the time from opening a project until all of its shaders are compiled and a frame is out
+struct ProjectOpenTimer
+{
+	std::chrono::high_resolution_clock::time_point startTime;
+	bool active = false;
+
+	void start()
+	{
+		startTime = std::chrono::high_resolution_clock::now();
+		active = true;
+	}
+
+	void frameRendered()
+	{
+		if (active && 0 == ShaderRegistry::getPendingCount()) {
+			const auto elapsed = std::chrono::high_resolution_clock::now() - startTime;
+			const double ms = std::chrono::duration<double, std::milli>(elapsed).count();
+			printf("Time to first frame after opening the project: %.1f ms (%d shaders)\n", ms, int(ShaderRegistry::getShaderCount()));
+			active = false;
+		}
+	}
+};
+
+ProjectOpenTimer g_projectOpenTimer;
+
+// Lets the main loop stop drawing when nothing changes, e.g. once the user has walked away. Input
+// redraws the UI for a few frames, but the project is only dispatched again when something which
+// affects its output changed, or on every frame while any of its passes reads the time.
+struct IdleTracker
+{
+	// ImGui needs a couple of frames to settle after input, e.g. for hover states and layout
+	static const int settleFrames = 3;
+
+	// File changes and editor messages wake the loop up as they arrive, through glfwPostEmptyEvent.
+	// This is only a backstop for work which doesn't, such as the shader library being rescanned.
+	static constexpr double maxIdleWait = 1.0;
+
+	int uiFramesLeft = settleFrames;
+	bool projectDirty = true;
+	bool timeVarying = false;	// as of the last dispatch
+
+	// Keeps the project dispatched on every frame, e.g. while shaders are compiling
+	bool busy = false;
+
+	// Input which can't change the project, such as moving the mouse
+	void invalidateUi() {
+		uiFramesLeft = settleFrames;
+	}
+
+	// Params, shaders, the graph or the size of the output
+	void invalidateProject() {
+		invalidateUi();
+		projectDirty = true;
+	}
+
+	bool shouldDispatchProject() const {
+		return projectDirty || timeVarying || busy;
+	}
+
+	bool shouldDrawFrame() const {
+		return uiFramesLeft > 0 || shouldDispatchProject();
+	}
+
+	void frameDrawn(bool dispatched, bool dispatchTimeVarying) {
+		if (uiFramesLeft > 0) {
+			--uiFramesLeft;
+		}
+
+		if (dispatched) {
+			projectDirty = false;
+			timeVarying = dispatchTimeVarying;
+		}
+	}
+};
+
+IdleTracker g_idleTracker;
+
+void doTextureLoadUi(ShaderParamValue& value)
+{
+	if (ImGui::Button("Browse...")) {
+		openFileDialog("Select an image", "Image Files\0*.exr\0", &value.textureValue.path);
+	}
+
+	ImGui::SameLine();
+	ImGui::Text(value.textureValue.path.c_str());
+}
+
+void doScalarParamUi(const ShaderParamBindingRefl& refl, ShaderParamValue& value)
+{
+	if (refl.annotation.has(ParamAnnotation::Flag_Time)) {
+		ImGui::Text("%.2f s", g_shaderTime);
+	} else if (refl.type == ShaderParamType::Float) {
+		ImGui::SliderFloat("", &value.floatValue, refl.annotation.minFloat, refl.annotation.maxFloat);
+	} else if (refl.type == ShaderParamType::Float2) {
+		ImGui::SliderFloat2("", &value.float2Value.x, refl.annotation.minFloat, refl.annotation.maxFloat);
+	} else if (refl.type == ShaderParamType::Float3) {
+		if (refl.annotation.has(ParamAnnotation::Flag_Color)) {
+			ImGui::ColorEdit3("", &value.float3Value.x);
+		} else {
+			ImGui::SliderFloat3("", &value.float3Value.x, refl.annotation.minFloat, refl.annotation.maxFloat);
+		}
+	} else if (refl.type == ShaderParamType::Float4) {
+		if (refl.annotation.has(ParamAnnotation::Flag_Color)) {
+			ImGui::ColorEdit4("", &value.float4Value.x);
+		} else {
+			ImGui::SliderFloat4("", &value.float4Value.x, refl.annotation.minFloat, refl.annotation.maxFloat);
+		}
+	} else if (refl.type == ShaderParamType::Int) {
+		ImGui::SliderInt("", &value.intValue, refl.annotation.minInt, refl.annotation.maxInt);
+	} else if (refl.type == ShaderParamType::Int2) {
+		ImGui::SliderInt2("", &value.int2Value.x, refl.annotation.minInt, refl.annotation.maxInt);
+	} else if (refl.type == ShaderParamType::Int3) {
+		ImGui::SliderInt3("", &value.int3Value.x, refl.annotation.minInt, refl.annotation.maxInt);
+	} else if (refl.type == ShaderParamType::Int4) {
+		ImGui::SliderInt4("", &value.int4Value.x, refl.annotation.minInt, refl.annotation.maxInt);
+	}
+}
+
+void doPassUi(Pass& pass)
+{
+	int maxLabelWidth = 0;
+	for (auto& param : pass.params()) {
+		maxLabelWidth = std::max(maxLabelWidth, (int)ImGui::CalcTextSize(param.refl.name.c_str()).x);
+	}
+	maxLabelWidth += 10;
+
+	for (auto& param : pass.params()) {
+		const auto& refl = param.refl;
+		auto& value = param.value;
+
+		ImGui::PushID(refl.name.c_str());
+		ImGui::Columns(2);
+		{
+			const int textWidth = (int)ImGui::CalcTextSize(refl.name.c_str()).x;
+			ImGui::SetCursorPosX(maxLabelWidth - textWidth);
+			ImGui::Text(refl.name.c_str());
+		}
+
+		ImGui::SetColumnOffset(1, maxLabelWidth + 10);
+		ImGui::NextColumn();
+
+		if (refl.type == ShaderParamType::Sampler2d) {
+			{
+				ImGui::PushID("wrapS");
+				int wrapS = value.textureValue.wrapS ? 0 : 1;
+				const char* const wrapSValues[] = {
+					"Wrap S",
+					"Clamp S",
+				};
+				ImGui::PushItemWidth(100);
+				ImGui::Combo("", &wrapS, wrapSValues, sizeof(wrapSValues) / sizeof(*wrapSValues));
+				value.textureValue.wrapS = !wrapS;
+				ImGui::PopID();
+			}
+
+			ImGui::SameLine();
+
+			{
+				ImGui::PushID("wrapT");
+				int wrapT = value.textureValue.wrapT ? 0 : 1;
+				const char* const wrapTValues[] = {
+					"Wrap T",
+					"Clamp T",
+				};
+				ImGui::PushItemWidth(100);
+				ImGui::Combo("", &wrapT, wrapTValues, sizeof(wrapTValues) / sizeof(*wrapTValues));
+				value.textureValue.wrapT = !wrapT;
+				ImGui::PopID();
+			}
+
+			ImGui::SameLine();
+			doTextureLoadUi(value);
+		} else if (refl.type == ShaderParamType::Image2d) {
+			ImGui::BeginGroup();
+			int sourceIdx = int(value.textureValue.source);
+			const char* const sources[] = {
+				"Load",
+				"Create",
+				"Input",
 			};
 			ImGui::PushID("source");
 			ImGui::PushItemWidth(100);
@@ -924,6 +1601,9 @@ void doPassUi(Pass& pass)
 			ImGui::PopID();
 			const auto prevSource = value.textureValue.source;
 			value.textureValue.source = TextureDesc::Source(sourceIdx);
+			if (prevSource != value.textureValue.source) {
+				pass.invalidateParams();
+			}
 
 			if (TextureDesc::Source::Load == value.textureValue.source) {
 				ImGui::SameLine();
@@ -952,16 +1632,19 @@ void doPassUi(Pass& pass)
 					ImGui::SameLine();
 
 					static vector<const char*> targetNames;
+					static vector<int> targetParamIndices;
 					targetNames = { "#window" };
+					targetParamIndices = { TextureDesc::RelativeToWindow };
 
 					int targetIdx = 0;
 
 					for (auto& otherParam : pass.params()) {
 						if (otherParam.refl.type == ShaderParamType::Image2d && otherParam.value.textureValue.source != TextureDesc::Source::Create) {
-							if (otherParam.refl.name == value.textureValue.scaleRelativeTo) {
+							if (int(otherParam.idx) == value.textureValue.scaleRelativeToIdx) {
 								targetIdx = int(targetNames.size());
 							}
 							targetNames.push_back(otherParam.refl.name.c_str());
+							targetParamIndices.push_back(int(otherParam.idx));
 						}
 					}
 
@@ -976,7 +1659,10 @@ void doPassUi(Pass& pass)
 					ImGui::Combo("", &targetIdx, targetNames.data(), targetNames.size());
 					ImGui::PopID();
 
-					value.textureValue.scaleRelativeTo = targetNames[targetIdx];
+					if (value.textureValue.scaleRelativeToIdx != targetParamIndices[targetIdx]) {
+						value.textureValue.scaleRelativeTo = targetNames[targetIdx];
+						value.textureValue.scaleRelativeToIdx = targetParamIndices[targetIdx];
+					}
 				} else {
 					ImGui::PushItemWidth(100);
 					ImGui::SameLine();
@@ -985,6 +1671,8 @@ void doPassUi(Pass& pass)
 			}
 
 			ImGui::EndGroup();
+		} else {
+			doScalarParamUi(refl, value);
 		}
 
 		ImGui::Columns(1);
@@ -1002,11 +1690,48 @@ void doPassUi(Pass& pass)
 	}
 }
 
+// Only the scalar params of the passes in the subgraph; images are set up in the subgraph itself
+void doSubgraphUi(SubgraphPass& pass)
+{
+	const SubgraphDef& def = pass.def();
+	if (!def.valid()) {
+		ImGui::Text("Subgraph %s has no output, or its passes form a cycle", def.path.c_str());
+		return;
+	}
+
+	for (const u32 node : def.passOrder) {
+		const nodegraph::node_idx nodeIdx = def.snapshot->nodes[node];
+		IRenderPass& innerPass = *def.package.m_passes[nodeIdx];
+		ShaderParamIterProxy params = innerPass.params().withValues(pass.getInstanceValues(nodeIdx, innerPass.params()));
+
+		ImGui::PushID(int(nodeIdx));
+		if (node != def.outputPass && ImGui::CollapsingHeader(innerPass.getDisplayName().c_str(), ImGuiTreeNodeFlags_DefaultOpen)) {
+			for (const auto& param : params) {
+				if (param.refl.type == ShaderParamType::Image2d || param.refl.type == ShaderParamType::Sampler2d) {
+					continue;
+				}
+
+				ImGui::PushID(param.refl.name.c_str());
+				ImGui::Columns(2);
+				ImGui::Text(param.refl.name.c_str());
+				ImGui::NextColumn();
+				doScalarParamUi(param.refl, param.value);
+				ImGui::Columns(1);
+				ImGui::PopID();
+			}
+		}
+		ImGui::PopID();
+	}
+}
+
 void doPassUi(IRenderPass& pass)
 {
 	if (auto p = dynamic_cast<Pass*>(&pass)) {
 		doPassUi(*p);
 	}
+	else if (auto p = dynamic_cast<SubgraphPass*>(&pass)) {
+		doSubgraphUi(*p);
+	}
 }
 
 static void windowErrorCallback(int error, const char* description)
@@ -1018,6 +1743,8 @@ vector<std::string> editorFileDrops;
 
 static void windowDropCallback(GLFWwindow* window, int count, const char** files)
 {
+	g_idleTracker.invalidateProject();
+
 	if (nullptr == g_editedPass) {
 		while (count--) {
 			editorFileDrops.push_back(*files++);
@@ -1051,6 +1778,11 @@ struct NodeGraphGuiGlue : INodeGraphGuiGlue
 	nodegraph::node_handle triggeredNode;
 	std::unordered_map<nodegraph::node_handle, vec2> desiredNodePositions;
 
+	// The graph generation which the names and port info are up to date with
+	u64 syncedGeneration = 0;
+	vector<nodegraph::node_idx> nodesToSync;
+
+	// Only the nodes which the graph journal reports as added or changed are synced
 	void updateInfoFromPackage(Package& package)
 	{
 		nodegraph::Graph& graph = package.graph;
@@ -1059,49 +1791,77 @@ struct NodeGraphGuiGlue : INodeGraphGuiGlue
 		nodePositions.resize(graph.nodes.size());
 		triggeredNode = nodegraph::node_handle();
 
-		graph.iterNodes([&](nodegraph::node_handle nodeHandle)
-		{
-			IRenderPass& pass = *package.m_passes[nodeHandle.idx];
-			nodeNames[nodeHandle.idx] = pass.getDisplayName();
-
-			graph.iterNodeInputPorts(nodeHandle, [&](nodegraph::port_handle portHandle) {
-				const nodegraph::Port& port = graph.ports[portHandle.idx];
-				auto param = std::find_if(pass.params().begin(), pass.params().end(), [&](auto param) {
-					return param.uid == port.uid;
-				});
-
-				if (param != pass.params().end()) {
-					if (needsInputPort(*param)) {
-						portInfo[portHandle.idx] = PortInfo{ param->refl.name, true };
-					}
-					else {
-						// This parameter should not be exposed anymore
-						graph.removePort(portHandle);
-					}
+		nodesToSync.clear();
+		const bool incremental = graph.iterChangesSince(syncedGeneration, [&](const nodegraph::Graph::Change& change) {
+			typedef nodegraph::Graph::ChangeType ChangeType;
+			if (ChangeType::NodeAdded == change.type || ChangeType::NodeModified == change.type) {
+				nodesToSync.push_back(change.idx);
+			}
+			else if (ChangeType::PortAdded == change.type && graph.ports.node[change.idx] != nodegraph::invalid_node_idx) {
+				nodesToSync.push_back(graph.ports.node[change.idx]);
+			}
+		});
+
+		// Syncing can remove ports; the info doesn't depend on removals, so those can be skipped
+		syncedGeneration = graph.generation;
+
+		if (incremental) {
+			std::sort(nodesToSync.begin(), nodesToSync.end());
+			nodesToSync.erase(std::unique(nodesToSync.begin(), nodesToSync.end()), nodesToSync.end());
+
+			for (const nodegraph::node_idx nodeIdx : nodesToSync) {
+				if (graph.nodes.livePos[nodeIdx] != nodegraph::invalid_node_idx) {
+					syncNodeInfo(package, nodegraph::node_handle(nodeIdx, graph.nodes.fingerprint[nodeIdx]));
+				}
+			}
+		}
+		else {
+			graph.iterNodes([&](nodegraph::node_handle nodeHandle) {
+				syncNodeInfo(package, nodeHandle);
+			});
+		}
+	}
+
+	void syncNodeInfo(Package& package, nodegraph::node_handle nodeHandle)
+	{
+		nodegraph::Graph& graph = package.graph;
+		IRenderPass& pass = *package.m_passes[nodeHandle.idx];
+		nodeNames[nodeHandle.idx] = pass.getDisplayName();
+
+		ShaderParamIterProxy params = pass.params();
+
+		graph.iterNodeInputPorts(nodeHandle, [&](nodegraph::port_handle portHandle) {
+			const int paramIdx = pass.findParamByPortUid(graph.ports.uid[portHandle.idx]);
+			if (paramIdx != -1) {
+				const ShaderParamProxy param = params[paramIdx];
+				if (needsInputPort(param)) {
+					portInfo[portHandle.idx] = PortInfo{ param.refl.name, true };
 				}
 				else {
-					portInfo[portHandle.idx].valid = false;
+					// This parameter should not be exposed anymore
+					graph.removePort(portHandle);
 				}
-			});
+			}
+			else {
+				portInfo[portHandle.idx].valid = false;
+			}
+		});
 
-			graph.iterNodeOutputPorts(nodeHandle, [&](nodegraph::port_handle portHandle) {
-				const nodegraph::Port& port = graph.ports[portHandle.idx];
-				auto param = std::find_if(pass.params().begin(), pass.params().end(), [&](auto param) {
-					return param.uid == port.uid;
-				});
-				if (param != pass.params().end()) {
-					if (needsOutputPort(*param)) {
-						portInfo[portHandle.idx] = PortInfo{ param->refl.name, true };
-					}
-					else {
-						// This parameter should not be exposed anymore
-						graph.removePort(portHandle);
-					}
+		graph.iterNodeOutputPorts(nodeHandle, [&](nodegraph::port_handle portHandle) {
+			const int paramIdx = pass.findParamByPortUid(graph.ports.uid[portHandle.idx]);
+			if (paramIdx != -1) {
+				const ShaderParamProxy param = params[paramIdx];
+				if (needsOutputPort(param)) {
+					portInfo[portHandle.idx] = PortInfo{ param.refl.name, true };
 				}
 				else {
-					portInfo[portHandle.idx].valid = false;
+					// This parameter should not be exposed anymore
+					graph.removePort(portHandle);
 				}
-			});
+			}
+			else {
+				portInfo[portHandle.idx].valid = false;
+			}
 		});
 	}
 
@@ -1117,30 +1877,20 @@ struct NodeGraphGuiGlue : INodeGraphGuiGlue
 
 	void onContextMenu() override
 	{
-		vector<std::string> items;
-		getGlobalContextMenuItems(&items);
-
-		for (std::string& it : items) {
-			if (ImGui::MenuItem(it.c_str(), NULL, false, true)) {
+		// Only reads the in-memory index; the library is scanned in the background
+		for (const ShaderLibrary::Entry& it : ShaderLibrary::getIndex()) {
+			// Shaders in different subdirectories can share a name
+			ImGui::PushID(it.path.c_str());
+			if (ImGui::MenuItem(it.name.c_str(), NULL, false, true)) {
 				onGlobalContextMenuSelected(it);
 			}
+			ImGui::PopID();
 		}
 	}
 
-	void getGlobalContextMenuItems(vector<std::string> *const items)
-	{
-		vector<fs::path> files;
-		getFilesMatchingExtension("data", ".glsl", files);
-
-		for (const fs::path& f : files) {
-			std::string filename = f.filename().string();
-			items->push_back(filename.substr(0, filename.find_last_of(".")));
-		}
-	}
-
-	void onGlobalContextMenuSelected(const std::string& shaderFile)
+	void onGlobalContextMenuSelected(const ShaderLibrary::Entry& shader)
 	{
-		g_project.handleFileDrop("data/" + shaderFile + ".glsl");
+		g_project.handleFileDrop(shader.path);
 	}
 
 	void onTriggered(nodegraph::node_handle node) override {
@@ -1228,12 +1978,67 @@ NodeGraphGuiGlue guiGlue;
 extern void ImGui_ImplGlfwGL3_KeyCallback(GLFWwindow*, int, int, int, int);
 static void windowKeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
+	g_idleTracker.invalidateProject();
+
 	WindowEvent e = { WindowEvent::Type::Keyboard };
 	e.keyboard = WindowEvent::Keyboard { key, scancode, action, mods };
 	g_windowEvents.emplace(e);
 	ImGui_ImplGlfwGL3_KeyCallback(window, key, scancode, action, mods);
 }
 
+// The rest of the input only wakes up the idle loop, and is passed on to ImGui where it needs it.
+// Input which can edit params or the graph marks the project dirty; see IdleTracker.
+static void windowMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
+{
+	g_idleTracker.invalidateProject();
+	ImGui_ImplGlfwGL3_MouseButtonCallback(window, button, action, mods);
+}
+
+static void windowScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
+{
+	g_idleTracker.invalidateUi();
+	ImGui_ImplGlfwGL3_ScrollCallback(window, xoffset, yoffset);
+}
+
+static void windowCharCallback(GLFWwindow* window, unsigned int c)
+{
+	g_idleTracker.invalidateProject();
+	ImGui_ImplGlfwGL3_CharCallback(window, c);
+}
+
+static void windowCursorPosCallback(GLFWwindow* window, double x, double y)
+{
+	// Dragging a slider or a node
+	const bool dragging = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT)
+		|| glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT)
+		|| glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_MIDDLE);
+
+	if (dragging) {
+		g_idleTracker.invalidateProject();
+	} else {
+		g_idleTracker.invalidateUi();
+	}
+}
+
+static void windowCursorEnterCallback(GLFWwindow* window, int entered)
+{
+	g_idleTracker.invalidateUi();
+}
+
+static void windowFocusCallback(GLFWwindow* window, int focused)
+{
+	g_idleTracker.invalidateUi();
+}
+
+static void windowRefreshCallback(GLFWwindow* window)
+{
+	g_idleTracker.invalidateUi();
+}
+
+bool g_showGlResources = false;
+bool g_showReloadLatency = false;
+bool g_showGraphBenchmark = false;
+
 void doMainMenu()
 {
 	if (ImGui::BeginMenu("File")) {
@@ -1241,6 +2046,7 @@ void doMainMenu()
 
 		}
 		if (ImGui::MenuItem("Open", nullptr)) {
+			g_projectOpenTimer.start();
 			vector<char> data = loadTextFileZ("rendertoy.state");
 
 			rapidjson::Document doc;
@@ -1277,95 +2083,541 @@ void doMainMenu()
 
 		ImGui::EndMenu();
 	}
+
+	if (ImGui::BeginMenu("Debug")) {
+		ImGui::MenuItem("GL resources", nullptr, &g_showGlResources);
+		ImGui::MenuItem("Reload latency", nullptr, &g_showReloadLatency);
+		ImGui::MenuItem("Graph benchmark", nullptr, &g_showGraphBenchmark);
+		ImGui::EndMenu();
+	}
+}
+
+void doGlResourcesWindow()
+{
+	if (!g_showGlResources) {
+		return;
+	}
+
+	ImGui::SetNextWindowSize(ImVec2(360, 180), ImGuiSetCond_FirstUseEver);
+	if (ImGui::Begin("GL resources", &g_showGlResources)) {
+		ImGui::Columns(3);
+		ImGui::Text("Type"); ImGui::NextColumn();
+		ImGui::Text("Live"); ImGui::NextColumn();
+		ImGui::Text("Pending deletion"); ImGui::NextColumn();
+		ImGui::Separator();
+
+		for (size_t i = 0; i < size_t(GlResourceType::Count); ++i) {
+			const GlResourceType type = GlResourceType(i);
+			const GlResources::TypeStats stats = GlResources::getStats(type);
+			ImGui::Text("%s", GlResources::getTypeName(type)); ImGui::NextColumn();
+			ImGui::Text("%u (%.2f MB)", stats.liveCount, stats.liveBytes / (1024.0 * 1024.0)); ImGui::NextColumn();
+			ImGui::Text("%u (%.2f MB)", stats.pendingCount, stats.pendingBytes / (1024.0 * 1024.0)); ImGui::NextColumn();
+		}
+
+		ImGui::Columns(1);
+	}
+	ImGui::End();
+}
+
+void doReloadLatencyWindow()
+{
+	if (!g_showReloadLatency) {
+		return;
+	}
+
+	ImGui::SetNextWindowSize(ImVec2(520, 320), ImGuiSetCond_FirstUseEver);
+	if (ImGui::Begin("Reload latency", &g_showReloadLatency)) {
+		const vector<float>& total = ReloadProfiler::getTotalHistory();
+		const ProfilerHistory::Stats totalStats = ProfilerHistory::calculateStats(total);
+
+		ImGui::Text("Save to screen, last %d reloads", int(total.size()));
+		ImGui::PlotHistogram("##total", total.data(), int(total.size()), 0, nullptr, 0.0f, totalStats.maxMs, ImVec2(0, 60));
+
+		if (ImGui::Button("Export JSON")) {
+			ReloadProfiler::exportJson("reload_latency.json");
+		}
+
+		ImGui::Separator();
+		ImGui::Columns(6);
+		ImGui::Text("Stage"); ImGui::NextColumn();
+		ImGui::Text("Last"); ImGui::NextColumn();
+		ImGui::Text("Mean"); ImGui::NextColumn();
+		ImGui::Text("p50"); ImGui::NextColumn();
+		ImGui::Text("p95"); ImGui::NextColumn();
+		ImGui::Text("Max"); ImGui::NextColumn();
+		ImGui::Separator();
+
+		auto statsRow = [](const char* name, const ProfilerHistory::Stats& stats) {
+			ImGui::Text("%s", name); ImGui::NextColumn();
+			ImGui::Text("%.2f ms", stats.lastMs); ImGui::NextColumn();
+			ImGui::Text("%.2f ms", stats.meanMs); ImGui::NextColumn();
+			ImGui::Text("%.2f ms", stats.p50Ms); ImGui::NextColumn();
+			ImGui::Text("%.2f ms", stats.p95Ms); ImGui::NextColumn();
+			ImGui::Text("%.2f ms", stats.maxMs); ImGui::NextColumn();
+		};
+
+		// Detect is where the clock starts, so it doesn't have a duration of its own
+		for (size_t i = 1; i < size_t(ReloadProfiler::Stage::Count); ++i) {
+			const ReloadProfiler::Stage stage = ReloadProfiler::Stage(i);
+			statsRow(ReloadProfiler::getStageName(stage), ProfilerHistory::calculateStats(ReloadProfiler::getStageHistory(stage)));
+		}
+
+		ImGui::Separator();
+		statsRow("Total", totalStats);
+		ImGui::Columns(1);
+	}
+	ImGui::End();
 }
 
+enum class SyntheticShape : int {
+	Chain,		// each pass reads the previous one
+	Wide,		// one source fanned out to many passes, then added up pairwise
+	Diamonds,	// a chain of two passes reading the same input and added together
+	Random,		// every pass reads one or two random earlier ones
+	Count
+};
+
+const char* const g_syntheticShapeNames[] = { "Chain", "Wide", "Diamonds", "Random DAG" };
+
+// Replaces the package with about nodeCount passes in the given shape, ending in the output. The
+// links are made once the shaders have compiled; see Package::resolvePendingLinks.
+vector<nodegraph::node_handle> generateSyntheticPackage(Package& package, SyntheticShape shape, u32 nodeCount, u32 seed)
+{
+	typedef nodegraph::node_handle node_handle;
+
+	const char* const sourceShader = "data/gradients.glsl";
+	const char* const unaryShader = "data/blur.glsl";
+	const char* const binaryShader = "data/add.glsl";
+
+	package.reset();
+	vector<node_handle> nodes;
+
+	auto link = [&](node_handle src, node_handle dst, const char* dstParam) {
+		package.m_pendingLinks.push_back({ src, "outputTex", dst, dstParam });
+	};
+
+	auto unary = [&](node_handle input) {
+		const node_handle node = package.addComputePass(unaryShader);
+		link(input, node, "inputImage");
+		nodes.push_back(node);
+		return node;
+	};
+
+	auto binary = [&](node_handle input1, node_handle input2) {
+		const node_handle node = package.addComputePass(binaryShader);
+		link(input1, node, "inputImage1");
+		link(input2, node, "inputImage2");
+		nodes.push_back(node);
+		return node;
+	};
+
+	// Leaves room for the output
+	const size_t count = std::max(nodeCount, 4u) - 1;
+	nodes.push_back(package.addComputePass(sourceShader));
+	node_handle last = nodes[0];
+
+	// Every other image is relative to the source's. Wide graphs keep half of them alive at once,
+	// which wouldn't fit in memory at 256x256 past a few thousand nodes.
+	for (auto param : package.m_passes[nodes[0].idx]->params()) {
+		if (param.refl.name == "outputTex") {
+			param.value.textureValue.resolution = ivec2(16, 16);
+		}
+	}
+
+	if (SyntheticShape::Chain == shape) {
+		while (nodes.size() < count) {
+			last = unary(last);
+		}
+	}
+	else if (SyntheticShape::Wide == shape) {
+		vector<node_handle> layer;
+		for (size_t i = 0; i < count / 2; ++i) {
+			layer.push_back(unary(nodes[0]));
+		}
+
+		while (layer.size() > 1) {
+			vector<node_handle> next;
+			for (size_t i = 0; i + 1 < layer.size(); i += 2) {
+				next.push_back(binary(layer[i], layer[i + 1]));
+			}
+			if (layer.size() % 2) {
+				next.push_back(layer.back());
+			}
+			layer.swap(next);
+		}
+
+		last = layer[0];
+	}
+	else if (SyntheticShape::Diamonds == shape) {
+		while (nodes.size() + 3 <= count) {
+			const node_handle left = unary(last);
+			const node_handle right = unary(last);
+			last = binary(left, right);
+		}
+	}
+	else {
+		std::mt19937 rng(seed);
+		while (nodes.size() < count) {
+			const node_handle input1 = nodes[rng() % nodes.size()];
+			const node_handle input2 = nodes[rng() % nodes.size()];
+			last = (rng() % 3) ? unary(input1) : binary(input1, input2);
+		}
+	}
+
+	const node_handle output = package.addOutputPass();
+	package.m_pendingLinks.push_back({ last, "outputTex", output, "image" });
+	nodes.push_back(output);
+
+	return nodes;
+}
+
+void loadSyntheticPackage(SyntheticShape shape, u32 nodeCount)
+{
+	g_editedPass = nullptr;
+	guiGlue = NodeGraphGuiGlue();
+	const vector<nodegraph::node_handle> nodes = generateSyntheticPackage(*g_project.m_packages[0], shape, nodeCount, 1);
+
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		guiGlue.setDesiredNodePosition(nodes[i], vec2(40 + (i / 32) * 200, 40 + (i % 32) * 80));
+	}
+}
+
+// Loads every synthetic shape at a range of sizes in turn, and writes the median time of every
+// frame section for each to a CSV file, giving the scaling curve of the graph, compiler and GUI.
+// Run with --graph-benchmark to sweep in a hidden window and exit; see the README for running it
+// on a machine without a GPU.
+struct GraphBenchmarkSweep
+{
+	enum class State { Idle, Settling, Measuring };
+
+	State state = State::Idle;
+	size_t step = 0;
+	int frames = 0;
+	bool exitWhenDone = false;
+	std::string outputPath;
+	std::string csv;
+
+	static const int settleFrames = 10;
+	static const int measureFrames = 60;
+	static const int timeoutFrames = 1200;
+
+	static const u32* getSizes(size_t *const count) {
+		static const u32 sizes[] = { 125, 250, 500, 1000, 2000, 4000, 10000, 30000, 100000 };
+		*count = sizeof(sizes) / sizeof(sizes[0]);
+		return sizes;
+	}
+
+	size_t getStepCount() const {
+		size_t sizeCount;
+		getSizes(&sizeCount);
+		return sizeCount * size_t(SyntheticShape::Count);
+	}
+
+	bool active() const {
+		return state != State::Idle;
+	}
+
+	void start(const char* path, bool exit)
+	{
+		outputPath = path;
+		exitWhenDone = exit;
+		csv = "shape,nodes";
+		for (size_t i = 0; i < size_t(FrameProfiler::Section::Count); ++i) {
+			csv += std::string(",") + FrameProfiler::getSectionName(FrameProfiler::Section(i)) + " p50 ms";
+		}
+		csv += "\n";
+
+		step = 0;
+		beginStep();
+	}
+
+	// Call once per frame, after FrameProfiler::endFrame
+	void update()
+	{
+		if (State::Idle == state) {
+			return;
+		}
+
+		++frames;
+		const Package& package = *g_project.m_packages[0];
+		const bool settled = package.m_pendingLinks.empty() && 0 == ShaderRegistry::getPendingCount();
+
+		if (State::Settling == state) {
+			if (settled && frames >= settleFrames) {
+				FrameProfiler::clearHistory();
+				state = State::Measuring;
+				frames = 0;
+			}
+			else if (frames >= timeoutFrames) {
+				fprintf(stderr, "Graph benchmark: step %d didn't settle, skipping it\n", int(step));
+				nextStep();
+			}
+		}
+		else if (frames >= measureFrames) {
+			size_t sizeCount;
+			const u32* const sizes = getSizes(&sizeCount);
+
+			char row[64];
+			snprintf(row, sizeof(row), "%s,%u", g_syntheticShapeNames[step / sizeCount], sizes[step % sizeCount]);
+			csv += row;
+
+			for (size_t i = 0; i < size_t(FrameProfiler::Section::Count); ++i) {
+				const auto& history = FrameProfiler::getSectionHistory(FrameProfiler::Section(i));
+				snprintf(row, sizeof(row), ",%.3f", ProfilerHistory::calculateStats(history).p50Ms);
+				csv += row;
+			}
+
+			csv += "\n";
+			nextStep();
+		}
+	}
+
+private:
+	void beginStep()
+	{
+		size_t sizeCount;
+		const u32* const sizes = getSizes(&sizeCount);
+
+		loadSyntheticPackage(SyntheticShape(step / sizeCount), sizes[step % sizeCount]);
+		state = State::Settling;
+		frames = 0;
+	}
+
+	void nextStep()
+	{
+		if (++step < getStepCount()) {
+			beginStep();
+			return;
+		}
+
+		std::ofstream(outputPath).write(csv.data(), csv.size());
+		printf("Graph benchmark written to %s\n", outputPath.c_str());
+		state = State::Idle;
+
+		if (exitWhenDone) {
+			glfwSetWindowShouldClose(g_mainWindow, 1);
+		}
+	}
+};
+
+GraphBenchmarkSweep g_graphBenchmarkSweep;
+
+void doGraphBenchmarkWindow()
+{
+	if (!g_showGraphBenchmark) {
+		return;
+	}
+
+	static int shapeIdx = 0;
+	static int nodeCount = 1000;
+
+	ImGui::SetNextWindowSize(ImVec2(520, 320), ImGuiSetCond_FirstUseEver);
+	if (ImGui::Begin("Graph benchmark", &g_showGraphBenchmark)) {
+		ImGui::PushItemWidth(120);
+		ImGui::Combo("shape", &shapeIdx, g_syntheticShapeNames, int(SyntheticShape::Count));
+		ImGui::SameLine();
+		ImGui::InputInt("nodes", &nodeCount, 100, 1000);
+		nodeCount = std::max(4, std::min(nodeCount, 100000));
+		ImGui::PopItemWidth();
+
+		if (g_graphBenchmarkSweep.active()) {
+			ImGui::Text("Sweeping, step %d of %d", int(g_graphBenchmarkSweep.step + 1), int(g_graphBenchmarkSweep.getStepCount()));
+		}
+		else {
+			if (ImGui::Button("Generate")) {
+				loadSyntheticPackage(SyntheticShape(shapeIdx), u32(nodeCount));
+			}
+
+			ImGui::SameLine();
+			if (ImGui::Button("Run sweep")) {
+				g_graphBenchmarkSweep.start("graph_benchmark.csv", false);
+			}
+		}
+
+		ImGui::Separator();
+		ImGui::Columns(5);
+		ImGui::Text("Section"); ImGui::NextColumn();
+		ImGui::Text("Last"); ImGui::NextColumn();
+		ImGui::Text("Mean"); ImGui::NextColumn();
+		ImGui::Text("p50"); ImGui::NextColumn();
+		ImGui::Text("p95"); ImGui::NextColumn();
+		ImGui::Separator();
+
+		for (size_t i = 0; i < size_t(FrameProfiler::Section::Count); ++i) {
+			const FrameProfiler::Section section = FrameProfiler::Section(i);
+			const ProfilerHistory::Stats stats = ProfilerHistory::calculateStats(FrameProfiler::getSectionHistory(section));
+
+			ImGui::Text("%s", FrameProfiler::getSectionName(section)); ImGui::NextColumn();
+			ImGui::Text("%.2f ms", stats.lastMs); ImGui::NextColumn();
+			ImGui::Text("%.2f ms", stats.meanMs); ImGui::NextColumn();
+			ImGui::Text("%.2f ms", stats.p50Ms); ImGui::NextColumn();
+			ImGui::Text("%.2f ms", stats.p95Ms); ImGui::NextColumn();
+		}
+
+		ImGui::Columns(1);
+	}
+	ImGui::End();
+}
+
+GlProgramHandle g_fullscreenQuadProgram;
+
 void drawFullscreenQuad(GLuint tex)
 {
-	const GLchar *vertex_shader =
-		"#version 330\n"
-		"out vec2 Frag_UV;\n"
-		"void main()\n"
-		"{\n"
-		"	Frag_UV = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0;\n"
-		"	gl_Position = vec4(Frag_UV * 2.0 - 1.0, 0, 1);\n"
-		"}\n";
-
-	const GLchar* fragment_shader =
-		"#version 330\n"
-		"uniform sampler2D Texture;\n"
-		"in vec2 Frag_UV;\n"
-		"out vec4 Out_Color;\n"
-		"void main()\n"
-		"{\n"
-		//"	Out_Color = vec4(Frag_UV, 0, 1);\n"
-		"	Out_Color = texture(Texture, Frag_UV);\n"
-		"}\n";
-
-	static GLuint g_ShaderHandle = -1, g_VertHandle, g_FragHandle;
-
-	if (-1 == g_ShaderHandle) {
-		g_ShaderHandle = glCreateProgram();
-		g_VertHandle = glCreateShader(GL_VERTEX_SHADER);
-		g_FragHandle = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(g_VertHandle, 1, &vertex_shader, 0);
-		glShaderSource(g_FragHandle, 1, &fragment_shader, 0);
-		glCompileShader(g_VertHandle);
-		glCompileShader(g_FragHandle);
-		glAttachShader(g_ShaderHandle, g_VertHandle);
-		glAttachShader(g_ShaderHandle, g_FragHandle);
-		glLinkProgram(g_ShaderHandle);
-	}
-
-	glUseProgram(g_ShaderHandle);
-
-	glActiveTexture(0);
-	glBindTexture(GL_TEXTURE_2D, tex);
-
-	const GLint loc = glGetUniformLocation(g_ShaderHandle, "Texture");
+	const GLchar *vertex_shader =
+		"#version 330\n"
+		"out vec2 Frag_UV;\n"
+		"void main()\n"
+		"{\n"
+		"	Frag_UV = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0;\n"
+		"	gl_Position = vec4(Frag_UV * 2.0 - 1.0, 0, 1);\n"
+		"}\n";
+
+	const GLchar* fragment_shader =
+		"#version 330\n"
+		"uniform sampler2D Texture;\n"
+		"in vec2 Frag_UV;\n"
+		"out vec4 Out_Color;\n"
+		"void main()\n"
+		"{\n"
+		//"	Out_Color = vec4(Frag_UV, 0, 1);\n"
+		"	Out_Color = texture(Texture, Frag_UV);\n"
+		"}\n";
+
+	if (!g_fullscreenQuadProgram.valid()) {
+		GLuint program = glCreateProgram();
+		GLuint vertHandle = glCreateShader(GL_VERTEX_SHADER);
+		GLuint fragHandle = glCreateShader(GL_FRAGMENT_SHADER);
+		glShaderSource(vertHandle, 1, &vertex_shader, 0);
+		glShaderSource(fragHandle, 1, &fragment_shader, 0);
+		glCompileShader(vertHandle);
+		glCompileShader(fragHandle);
+		glAttachShader(program, vertHandle);
+		glAttachShader(program, fragHandle);
+		glLinkProgram(program);
+
+		// Only flagged for deletion; they go away together with the program
+		glDeleteShader(vertHandle);
+		glDeleteShader(fragHandle);
+
+		g_fullscreenQuadProgram = GlResources::track(GlProgramHandle(program), 0, "fullscreen quad program");
+	}
+
+	glUseProgram(g_fullscreenQuadProgram);
+
+	glActiveTexture(0);
+	glBindTexture(GL_TEXTURE_2D, tex);
+
+	const GLint loc = glGetUniformLocation(g_fullscreenQuadProgram, "Texture");
 	const GLint img_unit = 0;
 	glUniform1i(loc, img_unit);
-
-	glDrawArrays(GL_TRIANGLES, 0, 3);
-	glUseProgram(0);
+
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glUseProgram(0);
+}
+
+void renderPasses(vector<CompiledPass>& passes, int width, int height)
+{
+	for (auto& pass : passes) {
+		renderPasses(pass.fragment, width, height);
+
+		int dispatchWidth = width;
+		int dispatchHeight = height;
+
+		// TODO: proper dispatch size setting
+		// For now, we get the dispatch size from the first output image of the shader
+		for (auto& img : pass.compiledImages) {
+			if (img.owned) {
+				dispatchWidth = img.tex->key.width;
+				dispatchHeight = img.tex->key.height;
+				break;
+			}
+		}
+
+		pass.render(dispatchWidth, dispatchHeight);
+	}
+}
+
+void releasePasses(vector<CompiledPass>& passes)
+{
+	for (auto& pass : passes) {
+		releasePasses(pass.fragment);
+
+		for (auto& img : pass.compiledImages) {
+			if (img.owned) {
+				img.release();
+			}
+		}
+	}
+}
+
+// Whether any of the passes reads the time, and so has to be dispatched every frame
+bool readsTime(vector<CompiledPass>& passes)
+{
+	for (auto& pass : passes) {
+		if (readsTime(pass.fragment)) {
+			return true;
+		}
+
+		for (const auto& param : pass.params) {
+			if (param.refl.annotation.has(ParamAnnotation::Flag_Time)) {
+				return true;
+			}
+		}
+	}
+
+	return false;
 }
 
-void renderProject(int width, int height)
+// Output of the last package rendered, shown again by frames which don't dispatch the project
+shared_ptr<CreatedTexture> g_presentedOutput;
+
+// Returns true if the output changes with time; see readsTime
+bool renderProject(int width, int height)
 {
+	bool timeVarying = false;
+	g_presentedOutput = nullptr;
+
 	for (shared_ptr<Package>& package : g_project.m_packages) {
 		PassCompilerSettings settings;
 		settings.windowSize = ivec2(width, height);
 
 		CompiledPackage compiled;
-		if (!package->compile(settings, &compiled) || !compiled.outputTexture) {
-			continue;
+		{
+			FrameProfiler::Scope scope(FrameProfiler::Section::Compile);
+			if (!package->compile(settings, &compiled) || !compiled.outputTexture) {
+				continue;
+			}
 		}
 
-		for (auto& pass : compiled.orderedPasses) {
-			int dispatchWidth = width;
-			int dispatchHeight = height;
+		{
+			FrameProfiler::Scope scope(FrameProfiler::Section::Submit);
+			renderPasses(compiled.orderedPasses, width, height);
+			drawFullscreenQuad(compiled.outputTexture->texId);
+		}
 
-			// TODO: proper dispatch size setting
-			// For now, we get the dispatch size from the first output image of the shader
-			for (auto& img : pass.compiledImages) {
-				if (img.owned) {
-					dispatchWidth = img.tex->key.width;
-					dispatchHeight = img.tex->key.height;
-					break;
-				}
-			}
+		g_projectOpenTimer.frameRendered();
 
-			pass.render(dispatchWidth, dispatchHeight);
-		}
+		// Released textures stay in the pool until the next compile, which dispatches anyway
+		g_presentedOutput = compiled.outputTexture;
+		timeVarying |= readsTime(compiled.orderedPasses);
 
-		drawFullscreenQuad(compiled.outputTexture->texId);
+		releasePasses(compiled.orderedPasses);
+	}
 
-		for (auto& pass : compiled.orderedPasses) {
-			for (auto& img : pass.compiledImages) {
-				if (img.owned) {
-					img.release();
-				}
-			}
-		}
+	return timeVarying;
+}
+
+// Picks up file changes, sources from the editor and finished compiles. Called on every iteration
+// of the main loop, including the ones which don't draw.
+void pollProjectChanges()
+{
+	FileWatcher::update();
+	ShaderRegistry::update();
+	EditorLink::update();
+	ShaderLibrary::update();
+
+	if (g_project.updatePasses()) {
+		g_idleTracker.invalidateProject();
 	}
 }
 
@@ -1397,21 +2649,35 @@ int CALLBACK WinMain(
 	// Setup window
 	glfwSetErrorCallback(&windowErrorCallback);
 	FileWatcher::start();
+	ThreadPool::start();
+	ShaderLibrary::start("data");
+	EditorLink::start(EditorLink::getDefaultSocketPath().c_str());
 
 	if (!glfwInit()) {
 		return 1;
 	}
 
+	// Both are called from their own threads, so the main loop can sleep until there's work
+	FileWatcher::setChangeNotify(&glfwPostEmptyEvent);
+	EditorLink::setMessageNotify(&glfwPostEmptyEvent);
+
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_COMPAT_PROFILE);
 
+	// Measures the graph at a range of sizes, then exits. Nothing needs to be seen meanwhile.
+	const bool graphBenchmark = strstr(lpCmdLine, "--graph-benchmark") != nullptr;
+	if (graphBenchmark) {
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	}
+
 	GLFWmonitor* monitor = glfwGetPrimaryMonitor();
 	const GLFWvidmode* vidMode = glfwGetVideoMode(monitor);
 	g_mainWindow = glfwCreateWindow(vidMode->width / 2, vidMode->height, "RenderToy", NULL, NULL);
 	GLFWwindow*& window = g_mainWindow;
 
-	{
+	// Restoring would show the window
+	if (!graphBenchmark) {
 		int x, y;
 		glfwGetWindowPos(window, &x, &y);
 		glfwRestoreWindow(window);
@@ -1421,17 +2687,27 @@ int CALLBACK WinMain(
 	glfwSetInputMode(window, GLFW_STICKY_KEYS, 1);
 	glfwSetDropCallback(window, &windowDropCallback);
 	glfwSetKeyCallback(window, &windowKeyCallback);
+	glfwSetMouseButtonCallback(window, &windowMouseButtonCallback);
+	glfwSetScrollCallback(window, &windowScrollCallback);
+	glfwSetCharCallback(window, &windowCharCallback);
+	glfwSetCursorPosCallback(window, &windowCursorPosCallback);
+	glfwSetCursorEnterCallback(window, &windowCursorEnterCallback);
+	glfwSetWindowFocusCallback(window, &windowFocusCallback);
+	glfwSetWindowRefreshCallback(window, &windowRefreshCallback);
 
 	glfwMakeContextCurrent(window);
-	glfwSwapInterval(1);
+	glfwSwapInterval(graphBenchmark ? 0 : 1);
 	gladLoadGL();
 
 	glDebugMessageCallback(&openGLDebugCallback, nullptr);
 	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, 1);
 	glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
 
-	// Setup ImGui binding
-	ImGui_ImplGlfwGL3_Init(window, true);
+	ShaderCache::init();
+	initParallelShaderCompile([](const char* name) { return reinterpret_cast<void*>(glfwGetProcAddress(name)); });
+
+	// Setup ImGui binding. Its callbacks are called from the ones above.
+	ImGui_ImplGlfwGL3_Init(window, false);
 
 	g_project.m_packages.push_back(make_shared<Package>());
 	{
@@ -1439,14 +2715,43 @@ int CALLBACK WinMain(
 		guiGlue.setDesiredNodePosition(outputNode, vec2(vidMode->width / 2 * 0.7, vidMode->height / 2 * 0.5 - 30));
 	}
 
+	if (graphBenchmark) {
+		g_graphBenchmarkSweep.start("graph_benchmark.csv", true);
+	}
+
 	ImVec4 clearColor = ImColor(75, 75, 75);
 	bool fullscreen = false;
 	bool maximized = false;
 	float f;
+	ivec2 renderSize(0, 0);
 
 	// Main loop
 	while (!glfwWindowShouldClose(window)) {
-		glfwPollEvents();
+		// While idle, sleeps until there's input, a change arrives, or the changes held back
+		// by the FileWatcher are due
+		if (g_idleTracker.shouldDrawFrame()) {
+			glfwPollEvents();
+		} else {
+			const double untilDispatch = std::chrono::duration<double>(FileWatcher::getTimeUntilDispatch()).count();
+			glfwWaitEventsTimeout(std::min(untilDispatch, double(IdleTracker::maxIdleWait)));
+		}
+
+		int display_w, display_h;
+		glfwGetFramebufferSize(window, &display_w, &display_h);
+		const u32 renderHeight = (fullscreen || maximized) ? display_h : display_h / 2;
+
+		if (renderSize != ivec2(display_w, renderHeight)) {
+			renderSize = ivec2(display_w, renderHeight);
+			g_idleTracker.invalidateProject();
+		}
+
+		g_idleTracker.busy = g_graphBenchmarkSweep.active() || ShaderRegistry::getPendingCount() > 0;
+
+		if (!g_idleTracker.shouldDrawFrame()) {
+			pollProjectChanges();
+			continue;
+		}
+
 		ImGui_ImplGlfwGL3_NewFrame();
 
 		bool toggleFullscreen = false;
@@ -1472,24 +2777,29 @@ int CALLBACK WinMain(
 			g_windowEvents.pop();
 		}
 
-		if (!fullscreen && !maximized)
-		{
+		if (!fullscreen && !maximized)
+		{
 			ImGui::BeginMainMenuBar();
 			const int mainMenuHeight = ImGui::GetWindowHeight();
 			doMainMenu();
 			ImGui::EndMainMenuBar();
-
+
 			int windowWidth, windowHeight;
 			glfwGetWindowSize(window, &windowWidth, &windowHeight);
 			ImGui::SetNextWindowSize(ImVec2(windowWidth, windowHeight / 2 - mainMenuHeight), ImGuiSetCond_Always);
 			ImGui::SetNextWindowPos(ImVec2(0, mainMenuHeight), ImGuiSetCond_Always);
-
-			ImGuiWindowFlags windowFlags = 0;
-			windowFlags |= ImGuiWindowFlags_NoTitleBar;
-			windowFlags |= ImGuiWindowFlags_NoResize;
-			windowFlags |= ImGuiWindowFlags_NoMove;
+
+			ImGuiWindowFlags windowFlags = 0;
+			windowFlags |= ImGuiWindowFlags_NoTitleBar;
+			windowFlags |= ImGuiWindowFlags_NoResize;
+			windowFlags |= ImGuiWindowFlags_NoMove;
 			windowFlags |= ImGuiWindowFlags_NoCollapse;
 
+			// The node graph zooms with the mouse wheel instead
+			if (!g_editedPass) {
+				windowFlags |= ImGuiWindowFlags_NoScrollWithMouse;
+			}
+
 			ImGui::PushStyleColor(ImGuiCol_WindowBg, ImColor(40, 40, 40, 255));
 			bool windowOpen = true;
 			ImGui::Begin("Another Window", &windowOpen, windowFlags);
@@ -1501,9 +2811,18 @@ int CALLBACK WinMain(
 				ImGui::End();
 			} else if (g_project.m_packages.size() > 0) {
 				Package& package = *g_project.m_packages[0];
-				package.updateGraph();
-				guiGlue.updateInfoFromPackage(package);
-				nodeGraph(package.graph, guiGlue);
+				{
+					FrameProfiler::Scope scope(FrameProfiler::Section::UpdateGraph);
+					package.updateGraph();
+				}
+				{
+					FrameProfiler::Scope scope(FrameProfiler::Section::SyncGui);
+					guiGlue.updateInfoFromPackage(package);
+				}
+				{
+					FrameProfiler::Scope scope(FrameProfiler::Section::DrawGui);
+					nodeGraph(package.graph, guiGlue);
+				}
 
 				if (guiGlue.triggeredNode.valid()) {
 					g_editedPass = package.m_passes[guiGlue.triggeredNode.idx];
@@ -1513,20 +2832,30 @@ int CALLBACK WinMain(
 
 			ImGui::End();
 			ImGui::PopStyleColor();
+
+			doGlResourcesWindow();
+			doReloadLatencyWindow();
+			doGraphBenchmarkWindow();
 		}
 
 		// Rendering
-		int display_w, display_h;
-		glfwGetFramebufferSize(window, &display_w, &display_h);
 		glViewport(0, 0, display_w, display_h);
 		glClearColor(clearColor.x, clearColor.y, clearColor.z, clearColor.w);
 		glClear(GL_COLOR_BUFFER_BIT);
 
-		const u32 renderHeight = (fullscreen || maximized) ? display_h : display_h / 2;
 		glViewport(0, 0, display_w, renderHeight);
 		glScissor(0, 0, display_w, renderHeight);
 		glEnable(GL_FRAMEBUFFER_SRGB);
-		renderProject(display_w, renderHeight);
+
+		const bool dispatched = g_idleTracker.shouldDispatchProject();
+		bool timeVarying = false;
+		if (dispatched) {
+			g_shaderTime = float(glfwGetTime());
+			timeVarying = renderProject(display_w, renderHeight);
+		} else if (g_presentedOutput) {
+			drawFullscreenQuad(g_presentedOutput->texId);
+		}
+
 		glDisable(GL_FRAMEBUFFER_SRGB);
 
 		glViewport(0, 0, display_w, display_h);
@@ -1534,7 +2863,12 @@ int CALLBACK WinMain(
 		ImGui::Render();
 
 		glfwSwapBuffers(window);
-		FileWatcher::update();
+		g_idleTracker.frameDrawn(dispatched, timeVarying);
+		ReloadProfiler::frameSwapped();
+		FrameProfiler::endFrame();
+		g_graphBenchmarkSweep.update();
+		GlResources::endFrame();
+		pollProjectChanges();
 
 		if (!fullscreen && toggleMaximized) {
 			static int prevX, prevY, prevW, prevH;
@@ -1571,18 +2905,33 @@ int CALLBACK WinMain(
 			glfwFocusWindow(window);
 		}
 
-		if (ImGui::GetMousePos().x > -9000) {
+		if (ImGui::GetMousePos().x > -9000 && !editorFileDrops.empty()) {
 			for (auto& file : editorFileDrops) {
 				g_project.handleFileDrop(file);
 			}
 			editorFileDrops.clear();
+			g_idleTracker.invalidateProject();
 		}
 	}
 
 	// Cleanup
+	g_editedPass = nullptr;
+	g_presentedOutput = nullptr;
+	g_project.m_packages.clear();
+	g_transientTextureCache.clear();
+	g_loadedTextures.clear();
+	GlResources::release(g_fullscreenQuadProgram);
+	GlResources::shutdown();
+
 	ImGui_ImplGlfwGL3_Shutdown();
+
+	FileWatcher::setChangeNotify(nullptr);
+	EditorLink::setMessageNotify(nullptr);
 	glfwTerminate();
 
+	EditorLink::stop();
+	ShaderLibrary::stop();
+	ThreadPool::stop();
 	FileWatcher::stop();
 
 	return 0;
@@ -1,313 +1,755 @@
 #include "NodeGraph.h"
+#include <algorithm>
+#include <atomic>
+#include <stdio.h>
 
 
 namespace nodegraph
 {
-	node_handle Graph::getPortNode(port_handle portHandle) const {
-		const node_idx idx = ports[portHandle.idx].node;
-		return{ idx, nodes[idx].fingerprint };
+	u64 allocGenerationBase()
+	{
+		// Leaves room for 2^40 changes per graph
+		static std::atomic<u64> nextBase(0);
+		return (nextBase += 1) << 40;
 	}
 
-	port_handle Graph::addPort(node_idx node, port_uid uid)
+	template <typename I, typename F>
+	void GraphT<I, F>::recordChange(ChangeType type, I idx, F fingerprint)
 	{
-		port_idx idx;
-		if (deadPorts.size() > 0) {
-			idx = deadPorts.back().idx;
-			ports[idx].fingerprint = deadPorts.back().fingerprint + 1;
-			deadPorts.pop_back();
-		}
-		else {
-			idx = port_idx(ports.size());
-			ports.push_back(Port());
+		if (journal.size() >= maxJournalLength) {
+			journal.erase(journal.begin(), journal.begin() + maxJournalLength / 2);
 		}
 
-		Port& port = ports[idx];
-		port.node = node;
-		port.uid = uid;
-		port.link = invalid_link_idx;
-		return{ idx, port.fingerprint };
+		journal.push_back({ type, idx, fingerprint });
+		++generation;
 	}
 
-	void Graph::addInputPortToNode(Node& node, port_idx port)
+	// Pops a dead slot for reuse, or grows the arrays by one. The fingerprint is bumped on reuse.
+	template <typename Idx, typename Fingerprint, typename Grow>
+	static Idx allocSlot(vector<handle<Idx, Fingerprint>>& dead, vector<Fingerprint>& fingerprints, Grow grow)
 	{
-		ports[port].nextInNode = node.firstInputPort;
-		if (node.firstInputPort != invalid_port_idx) ports[node.firstInputPort].prevInNode = port;
-		node.firstInputPort = port;
+		if (dead.size() > 0) {
+			const Idx idx = dead.back().idx;
+			fingerprints[idx] = Fingerprint(dead.back().fingerprint + 1);
+			dead.pop_back();
+			return idx;
+		}
+		else {
+			const Idx idx = Idx(fingerprints.size());
+			assert(idx != Idx(-1) && "graph index space exhausted");
+			fingerprints.push_back(0);
+			grow();
+			return idx;
+		}
 	}
 
-	void Graph::addOutputPortToNode(Node& node, port_idx port)
+	static u32 ceilLog2(u32 value)
 	{
-		ports[port].nextInNode = node.firstOutputPort;
-		if (node.firstOutputPort != invalid_port_idx) ports[node.firstOutputPort].prevInNode = port;
-		node.firstOutputPort = port;
+		u32 result = 0;
+		while ((u32(1) << result) < value) {
+			++result;
+		}
+		return result;
 	}
 
-	void Graph::addLink(port_idx srcPort, port_idx dstPort)
+	template <typename Idx>
+	void IdxListPool<Idx>::reserve(List& list, u32 capacity)
 	{
-		// Input ports can only have one link
-		if (ports[dstPort].link != invalid_link_idx) {
-			removeLink(ports[dstPort].link);
+		if (capacity <= list.capacity) {
+			return;
 		}
 
-		link_idx idx;
-		if (deadLinks.size() > 0) {
-			idx = deadLinks.back().idx;
-			links[idx].fingerprint = deadLinks.back().fingerprint + 1;
-			deadLinks.pop_back();
+		const u32 sizeClass = ceilLog2(capacity);
+		u32 offset;
+
+		vector<u32>& vacated = freeRanges[sizeClass];
+		if (!vacated.empty()) {
+			offset = vacated.back();
+			vacated.pop_back();
 		}
 		else {
-			idx = link_idx(links.size());
-			links.push_back(Link());
+			offset = u32(items.size());
+			items.resize(items.size() + (size_t(1) << sizeClass));
 		}
 
-		Link& link = links[idx];
-		link.srcPort = srcPort;
-		link.dstPort = dstPort;
+		const u32 count = list.count;
+		std::copy(items.begin() + list.offset, items.begin() + list.offset + count, items.begin() + offset);
+		release(list);
 
-		// Connect the src links list
-		link.nextInSrcPort = ports[srcPort].link;
-		if (link.nextInSrcPort != invalid_link_idx) links[link.nextInSrcPort].prevInSrcPort = idx;
-		ports[srcPort].link = idx;
+		list.offset = offset;
+		list.count = count;
+		list.capacity = u32(1) << sizeClass;
+	}
+
+	template <typename Idx>
+	void IdxListPool<Idx>::push(List& list, Idx value)
+	{
+		if (list.count == list.capacity) {
+			reserve(list, list.capacity > 0 ? list.capacity * 2 : 1);
+		}
 
-		ports[dstPort].link = idx;
+		items[list.offset + list.count++] = value;
 	}
 
-	void Graph::addLink(const LinkDesc& desc)
+	template <typename Idx>
+	void IdxListPool<Idx>::erase(List& list, u32 i)
 	{
-		addLink(desc.srcPort.idx, desc.dstPort.idx);
+		assert(i < list.count);
+		const auto first = items.begin() + list.offset;
+		std::copy(first + i + 1, first + list.count, first + i);
+		--list.count;
 	}
 
-	void Graph::removeLink(link_idx idx)
+	template <typename Idx>
+	void IdxListPool<Idx>::release(List& list)
 	{
-		Link& link = links[idx];
-		if (link.nextInSrcPort != invalid_link_idx) links[link.nextInSrcPort].prevInSrcPort = link.prevInSrcPort;
-		if (link.prevInSrcPort != invalid_link_idx) {
-			links[link.prevInSrcPort].nextInSrcPort = link.nextInSrcPort;
+		if (list.capacity > 0) {
+			freeRanges[ceilLog2(list.capacity)].push_back(list.offset);
 		}
-		else {
-			// Update head
-			ports[link.srcPort].link = link.nextInSrcPort;
+
+		list = List();
+	}
+
+	template struct IdxListPool<u32>;
+	template struct IdxListPool<u16>;
+
+	template <typename I, typename F>
+	typename GraphT<I, F>::port_idx GraphT<I, F>::findInputPort(node_idx node, port_uid uid) const
+	{
+		auto found = portsByUid.find(portKey(node, false, uid));
+		return found != portsByUid.end() ? found->second : invalid_port_idx;
+	}
+
+	template <typename I, typename F>
+	typename GraphT<I, F>::port_idx GraphT<I, F>::findOutputPort(node_idx node, port_uid uid) const
+	{
+		auto found = portsByUid.find(portKey(node, true, uid));
+		return found != portsByUid.end() ? found->second : invalid_port_idx;
+	}
+
+	template <typename I, typename F>
+	typename GraphT<I, F>::node_handle GraphT<I, F>::getPortNode(port_handle portHandle) const {
+		const node_idx idx = ports.node[portHandle.idx];
+		return{ idx, nodes.fingerprint[idx] };
+	}
+
+	template <typename I, typename F>
+	typename GraphT<I, F>::port_handle GraphT<I, F>::addPort(node_idx node, port_uid uid)
+	{
+		const port_idx idx = allocSlot(deadPorts, ports.fingerprint, [&]() {
+			ports.uid.emplace_back();
+			ports.node.emplace_back();
+			ports.link.emplace_back();
+			ports.outputLinks.emplace_back();
+			ports.isOutput.emplace_back();
+			ports.referencedStamp.emplace_back();
+		});
+
+		ports.node[idx] = node;
+		ports.uid[idx] = uid;
+		ports.link[idx] = invalid_link_idx;
+		return{ idx, ports.fingerprint[idx] };
+	}
+
+	template <typename I, typename F>
+	void GraphT<I, F>::attachPort(node_idx node, port_idx port, bool isOutput)
+	{
+		portLists.push(isOutput ? nodes.outputPorts[node] : nodes.inputPorts[node], port);
+
+		ports.isOutput[port] = isOutput;
+		portsByUid[portKey(node, isOutput, ports.uid[port])] = port;
+
+		recordChange(ChangeType::PortAdded, port, ports.fingerprint[port]);
+	}
+
+	template <typename I, typename F>
+	void GraphT<I, F>::addInputPortToNode(node_idx node, port_idx port)
+	{
+		attachPort(node, port, false);
+	}
+
+	template <typename I, typename F>
+	void GraphT<I, F>::addOutputPortToNode(node_idx node, port_idx port)
+	{
+		attachPort(node, port, true);
+	}
+
+	template <typename I, typename F>
+	bool GraphT<I, F>::searchDownstream(node_idx start, node_idx target)
+	{
+		// Nodes ordered after the target can't reach it
+		const u32 upperBound = nodes.topoOrder[target];
+		const u32 stamp = ++searchStamp;
+
+		topoDownstream.clear();
+		topoDownstream.push_back(start);
+		nodes.searchStamp[start] = stamp;
+
+		for (size_t i = 0; i < topoDownstream.size(); ++i) {
+			for (const port_idx port : getOutputPorts(topoDownstream[i])) {
+				for (const link_idx link : getOutputLinks(port)) {
+					const node_idx next = ports.node[links.dstPort[link]];
+					if (next == target) {
+						return true;
+					}
+
+					if (nodes.searchStamp[next] != stamp && nodes.topoOrder[next] < upperBound) {
+						nodes.searchStamp[next] = stamp;
+						topoDownstream.push_back(next);
+					}
+				}
+			}
 		}
 
-		ports[link.dstPort].link = invalid_link_idx;
-		deadLinks.push_back({ idx, links[idx].fingerprint });
-		links[idx] = Link();
+		return false;
+	}
+
+	template <typename I, typename F>
+	void GraphT<I, F>::searchUpstream(node_idx start, u32 lowerBound)
+	{
+		const u32 stamp = ++searchStamp;
+
+		topoUpstream.clear();
+		topoUpstream.push_back(start);
+		nodes.searchStamp[start] = stamp;
+
+		for (size_t i = 0; i < topoUpstream.size(); ++i) {
+			for (const port_idx port : getInputPorts(topoUpstream[i])) {
+				const link_idx link = ports.link[port];
+				if (link == invalid_link_idx) {
+					continue;
+				}
+
+				const node_idx prev = ports.node[links.srcPort[link]];
+				if (nodes.searchStamp[prev] != stamp && nodes.topoOrder[prev] > lowerBound) {
+					nodes.searchStamp[prev] = stamp;
+					topoUpstream.push_back(prev);
+				}
+			}
+		}
 	}
 
-	void Graph::removePort(port_idx idx)
+	template <typename I, typename F>
+	void GraphT<I, F>::reorderForLink(node_idx srcNode, node_idx dstNode)
 	{
-		Port& port = ports[idx];
+		// topoDownstream holds what dstNode reaches before srcNode in the order, from wouldCreateCycle
+		searchUpstream(srcNode, nodes.topoOrder[dstNode]);
+
+		auto byOrder = [&](node_idx a, node_idx b) {
+			return nodes.topoOrder[a] < nodes.topoOrder[b];
+		};
 
-		while (port.link != invalid_link_idx) {
-			removeLink(port.link);
+		std::sort(topoUpstream.begin(), topoUpstream.end(), byOrder);
+		std::sort(topoDownstream.begin(), topoDownstream.end(), byOrder);
+
+		// Hand out the orders which the affected nodes had between them, upstream ones first
+		topoPool.clear();
+		for (const node_idx node : topoUpstream) {
+			topoPool.push_back(nodes.topoOrder[node]);
+		}
+		for (const node_idx node : topoDownstream) {
+			topoPool.push_back(nodes.topoOrder[node]);
 		}
 
-		if (port.nextInNode != invalid_port_idx) ports[port.nextInNode].prevInNode = port.prevInNode;
-		if (port.prevInNode != invalid_port_idx) {
-			ports[port.prevInNode].nextInNode = port.nextInNode;
+		std::sort(topoPool.begin(), topoPool.end());
+
+		size_t next = 0;
+		for (const node_idx node : topoUpstream) {
+			nodes.topoOrder[node] = topoPool[next++];
 		}
-		else {
-			// Update head
-			auto& node = nodes[port.node];
-			if (node.firstInputPort == idx) node.firstInputPort = port.nextInNode;
-			else if (node.firstOutputPort == idx) node.firstOutputPort = port.nextInNode;
+		for (const node_idx node : topoDownstream) {
+			nodes.topoOrder[node] = topoPool[next++];
+		}
+	}
+
+	template <typename I, typename F>
+	void GraphT<I, F>::renumberTopoOrder()
+	{
+		vector<node_idx> sorted = liveNodes;
+		std::sort(sorted.begin(), sorted.end(), [&](node_idx a, node_idx b) {
+			return nodes.topoOrder[a] < nodes.topoOrder[b];
+		});
+
+		for (size_t i = 0; i < sorted.size(); ++i) {
+			nodes.topoOrder[sorted[i]] = u32(i);
 		}
 
-		deadPorts.push_back({ idx, ports[idx].fingerprint });
-		ports[idx] = Port();
+		nextTopoOrder = u32(sorted.size());
 	}
 
-	void Graph::removeNode(node_handle nodeHandle)
+	template <typename I, typename F>
+	bool GraphT<I, F>::wouldCreateCycle(node_idx srcNode, node_idx dstNode)
 	{
-		Node& node = nodes[nodeHandle.idx];
+		if (srcNode == dstNode) {
+			return true;
+		}
 
-		while (node.firstInputPort != invalid_port_idx) {
-			removePort(node.firstInputPort);
+		if (nodes.topoOrder[srcNode] < nodes.topoOrder[dstNode]) {
+			return false;
 		}
 
-		while (node.firstOutputPort != invalid_port_idx) {
-			removePort(node.firstOutputPort);
+		return searchDownstream(dstNode, srcNode);
+	}
+
+	template <typename I, typename F>
+	bool GraphT<I, F>::addLink(port_idx srcPort, port_idx dstPort)
+	{
+		const node_idx srcNode = ports.node[srcPort];
+		const node_idx dstNode = ports.node[dstPort];
+
+		if (wouldCreateCycle(srcNode, dstNode)) {
+			return false;
 		}
 
-		if (node.nextNode != invalid_node_idx) nodes[node.nextNode].prevNode = node.prevNode;
-		if (node.prevNode != invalid_port_idx) {
-			nodes[node.prevNode].nextNode = node.nextNode;
+		if (nodes.topoOrder[srcNode] > nodes.topoOrder[dstNode]) {
+			reorderForLink(srcNode, dstNode);
 		}
-		else {
-			// Update head
-			if (firstLiveNode == nodeHandle.idx) {
-				firstLiveNode = node.nextNode;
-			}
+
+		// Input ports can only have one link
+		if (ports.link[dstPort] != invalid_link_idx) {
+			removeLink(ports.link[dstPort]);
 		}
 
-		deadNodes.push_back({ nodeHandle.idx, node.fingerprint });
-		nodes[nodeHandle.idx] = Node();
+		const link_idx idx = allocSlot(deadLinks, links.fingerprint, [&]() {
+			links.srcPort.emplace_back();
+			links.dstPort.emplace_back();
+			links.srcSlot.emplace_back();
+		});
+
+		LinkList& srcLinks = ports.outputLinks[srcPort];
+		links.srcPort[idx] = srcPort;
+		links.dstPort[idx] = dstPort;
+		links.srcSlot[idx] = srcLinks.count;
+		linkLists.push(srcLinks, idx);
+
+		ports.link[dstPort] = idx;
+
+		recordChange(ChangeType::LinkAdded, idx, links.fingerprint[idx]);
+		return true;
 	}
 
-	void Graph::removeUnreferencedInputPorts(Node& node, NodeDesc& desc)
+	template <typename I, typename F>
+	bool GraphT<I, F>::addLink(const LinkDesc& desc)
 	{
-		port_idx lastInputPort = node.firstInputPort;
-		if (lastInputPort != invalid_port_idx) {
-			// Find the last input port
-			while (true) {
-				port_idx next = ports[lastInputPort].nextInNode;
-				if (next != invalid_port_idx) lastInputPort = next;
-				else break;
-			}
+		return addLink(desc.srcPort.idx, desc.dstPort.idx);
+	}
 
-			// Iterate backwards, removing items missing from the new desc
-			for (port_idx it = lastInputPort; it != invalid_port_idx; it = ports[it].prevInNode) {
-				if (ports[it].link == invalid_link_idx) {
-					bool found = false;
-					auto portUid = ports[it].uid;
-
-					for (auto& d : desc.inputs) {
-						if (d == portUid) {
-							found = true;
-							break;
-						}
-					}
+	template <typename I, typename F>
+	void GraphT<I, F>::removeLink(link_idx idx)
+	{
+		// The last link of the source port takes the place of this one
+		LinkList& srcLinks = ports.outputLinks[links.srcPort[idx]];
+		const u32 slot = links.srcSlot[idx];
+		const link_idx last = linkLists.at(srcLinks, srcLinks.count - 1);
+		linkLists.at(srcLinks, slot) = last;
+		links.srcSlot[last] = slot;
+		--srcLinks.count;
+
+		ports.link[links.dstPort[idx]] = invalid_link_idx;
+
+		recordChange(ChangeType::LinkRemoved, idx, links.fingerprint[idx]);
+		deadLinks.push_back({ idx, links.fingerprint[idx] });
+		links.srcPort[idx] = invalid_port_idx;
+		links.dstPort[idx] = invalid_port_idx;
+	}
 
-					if (!found) {
-						removePort(it);
-					}
-				}
-			}
+	template <typename I, typename F>
+	void GraphT<I, F>::removePort(port_idx idx)
+	{
+		if (ports.link[idx] != invalid_link_idx) {
+			removeLink(ports.link[idx]);
+		}
+
+		while (ports.outputLinks[idx].count > 0) {
+			removeLink(getOutputLinks(idx).back());
+		}
+
+		linkLists.release(ports.outputLinks[idx]);
+
+		const node_idx node = ports.node[idx];
+		const bool isOutput = ports.isOutput[idx] != 0;
+		PortList& nodePorts = isOutput ? nodes.outputPorts[node] : nodes.inputPorts[node];
+		const IdxRange<port_idx> nodePortRange = portLists.range(nodePorts);
+		const auto found = std::find(nodePortRange.begin(), nodePortRange.end(), idx);
+		assert(found != nodePortRange.end());
+		portLists.erase(nodePorts, u32(found - nodePortRange.begin()));
+
+		auto indexed = portsByUid.find(portKey(node, isOutput, ports.uid[idx]));
+		if (indexed != portsByUid.end() && indexed->second == idx) {
+			portsByUid.erase(indexed);
 		}
+
+		recordChange(ChangeType::PortRemoved, idx, ports.fingerprint[idx]);
+		deadPorts.push_back({ idx, ports.fingerprint[idx] });
+		ports.uid[idx] = 0;
+		ports.node[idx] = invalid_node_idx;
 	}
 
-	void Graph::removeUnreferencedOutputPorts(Node& node, NodeDesc& desc)
+	template <typename I, typename F>
+	void GraphT<I, F>::removeNode(node_handle nodeHandle)
 	{
-		port_idx lastOutputPort = node.firstOutputPort;
-		if (lastOutputPort != invalid_port_idx) {
-			// Find the last input port
-			while (true) {
-				port_idx next = ports[lastOutputPort].nextInNode;
-				if (next != invalid_port_idx) lastOutputPort = next;
-				else break;
-			}
+		const node_idx idx = nodeHandle.idx;
+		assert(nodes.fingerprint[idx] == nodeHandle.fingerprint);
 
-			// Iterate backwards, removing items missing from the new desc
-			for (port_idx it = lastOutputPort; it != invalid_port_idx; it = ports[it].prevInNode) {
-				if (ports[it].link == invalid_link_idx) {
-					bool found = false;
-					auto portUid = ports[it].uid;
-
-					for (auto& d : desc.outputs) {
-						if (d == portUid) {
-							found = true;
-							break;
-						}
-					}
+		while (nodes.inputPorts[idx].count > 0) {
+			removePort(getInputPorts(idx).back());
+		}
 
-					if (!found) {
-						removePort(it);
-					}
-				}
-			}
+		while (nodes.outputPorts[idx].count > 0) {
+			removePort(getOutputPorts(idx).back());
 		}
+
+		portLists.release(nodes.inputPorts[idx]);
+		portLists.release(nodes.outputPorts[idx]);
+
+		// Swap with the last live node
+		const node_idx pos = nodes.livePos[idx];
+		const node_idx last = liveNodes.back();
+		liveNodes[pos] = last;
+		nodes.livePos[last] = pos;
+		liveNodes.pop_back();
+		nodes.livePos[idx] = invalid_node_idx;
+
+		recordChange(ChangeType::NodeRemoved, idx, nodes.fingerprint[idx]);
+		deadNodes.push_back({ idx, nodes.fingerprint[idx] });
 	}
 
-	void Graph::addMissingInputPorts(Node& node, NodeDesc& desc)
+	template <typename I, typename F>
+	void GraphT<I, F>::removeUnreferencedPorts(node_idx node, bool isOutput, const vector<port_uid>& uids)
 	{
-		for (u32 descInputIdx = 0; descInputIdx < desc.inputs.size(); ++descInputIdx) {
-			const auto uid = desc.inputs[descInputIdx];
+		// Stamp the ports which the desc refers to, then sweep the rest
+		const u32 stamp = ++updateStamp;
+		for (const port_uid uid : uids) {
+			const port_idx port = isOutput ? findOutputPort(node, uid) : findInputPort(node, uid);
+			if (port != invalid_port_idx) {
+				ports.referencedStamp[port] = stamp;
+			}
+		}
 
-			bool found = false;
-			for (auto it = node.firstInputPort; it != invalid_port_idx; it = ports[it].nextInNode) {
-				if (ports[it].uid == uid) {
-					found = true;
-					break;
-				}
+		// Iterate backwards, removing items missing from the new desc
+		const PortList& nodePorts = isOutput ? nodes.outputPorts[node] : nodes.inputPorts[node];
+		for (u32 i = nodePorts.count; i-- > 0; ) {
+			const port_idx it = portLists.at(nodePorts, i);
+			if (ports.link[it] == invalid_link_idx && 0 == ports.outputLinks[it].count && ports.referencedStamp[it] != stamp) {
+				removePort(it);
 			}
+		}
+	}
 
-			if (!found) {
-				port_idx port = addPort(std::distance(nodes.data(), &node), desc.inputs[descInputIdx]).idx;
-				addInputPortToNode(node, port);
+	template <typename I, typename F>
+	void GraphT<I, F>::addMissingPorts(node_idx node, bool isOutput, const vector<port_uid>& uids)
+	{
+		for (const port_uid uid : uids) {
+			const port_idx found = isOutput ? findOutputPort(node, uid) : findInputPort(node, uid);
+			if (found == invalid_port_idx) {
+				attachPort(node, addPort(node, uid).idx, isOutput);
 			}
 		}
 	}
 
-	void Graph::addMissingOutputPorts(Node& node, NodeDesc& desc)
+	template <typename I, typename F>
+	void GraphT<I, F>::updateNode(node_handle h, NodeDesc& desc)
 	{
-		for (u32 descOutputIdx = 0; descOutputIdx < desc.outputs.size(); ++descOutputIdx) {
-			const auto uid = desc.outputs[descOutputIdx];
+		assert(nodes.fingerprint[h.idx] == h.fingerprint);
+		removeUnreferencedPorts(h.idx, false, desc.inputs);
+		removeUnreferencedPorts(h.idx, true, desc.outputs);
+		addMissingPorts(h.idx, false, desc.inputs);
+		addMissingPorts(h.idx, true, desc.outputs);
+	}
 
-			bool found = false;
-			for (auto it = node.firstOutputPort; it != invalid_port_idx; it = ports[it].nextInNode) {
-				if (ports[it].uid == uid) {
-					found = true;
-					break;
-				}
-			}
+	template <typename I, typename F>
+	typename GraphT<I, F>::node_handle GraphT<I, F>::addNode(NodeDesc& desc)
+	{
+		const node_idx idx = allocSlot(deadNodes, nodes.fingerprint, [&]() {
+			nodes.inputPorts.emplace_back();
+			nodes.outputPorts.emplace_back();
+			nodes.livePos.emplace_back();
+			nodes.topoOrder.emplace_back();
+			nodes.searchStamp.emplace_back();
+		});
+
+		// Unlinked nodes can go anywhere in the order, so simply append
+		if (nextTopoOrder == u32(-1)) {
+			renumberTopoOrder();
+		}
+
+		nodes.topoOrder[idx] = nextTopoOrder++;
+		nodes.livePos[idx] = node_idx(liveNodes.size());
+		liveNodes.push_back(idx);
+
+		// Before the ports, so that consumers see the node first
+		recordChange(ChangeType::NodeAdded, idx, nodes.fingerprint[idx]);
+
+		// Sized up front, so that the lists don't move while they're filled
+		portLists.reserve(nodes.inputPorts[idx], u32(desc.inputs.size()));
+		for (const port_uid uid : desc.inputs) {
+			attachPort(idx, addPort(idx, uid).idx, false);
+		}
+
+		portLists.reserve(nodes.outputPorts[idx], u32(desc.outputs.size()));
+		for (const port_uid uid : desc.outputs) {
+			attachPort(idx, addPort(idx, uid).idx, true);
+		}
 
-			if (!found) {
-				port_idx port = addPort(std::distance(nodes.data(), &node), desc.outputs[descOutputIdx]).idx;
-				addOutputPortToNode(node, port);
+		return{ idx, nodes.fingerprint[idx] };
+	}
+
+	template <typename I, typename F>
+	void GraphT<I, F>::markNodeModified(node_handle h)
+	{
+		assert(nodes.fingerprint[h.idx] == h.fingerprint);
+		recordChange(ChangeType::NodeModified, h.idx, h.fingerprint);
+	}
+
+	// Marks the elements of a list's range as claimed. False if the range is malformed, lies outside
+	// the pool, or overlaps a range claimed before.
+	template <typename Idx>
+	static bool claimListRange(const IdxListPool<Idx>& pool, const typename IdxListPool<Idx>::List& list, vector<u8>& claimed)
+	{
+		if (list.count > list.capacity || (list.capacity & (list.capacity - 1)) != 0) {
+			return false;
+		}
+
+		if (size_t(list.offset) + list.capacity > pool.items.size()) {
+			return false;
+		}
+
+		for (u32 i = 0; i < list.capacity; ++i) {
+			if (claimed[list.offset + i]++) {
+				return false;
 			}
 		}
+
+		return true;
 	}
 
-	void Graph::updateNode(node_handle h, NodeDesc& desc)
+	template <typename Idx>
+	static bool claimVacatedRanges(const IdxListPool<Idx>& pool, vector<u8>& claimed)
 	{
-		Node& node = nodes[h.idx];
-		assert(node.fingerprint == h.fingerprint);
-		removeUnreferencedInputPorts(node, desc);
-		removeUnreferencedOutputPorts(node, desc);
-		addMissingInputPorts(node, desc);
-		addMissingOutputPorts(node, desc);
+		for (u32 sizeClass = 0; sizeClass < 32; ++sizeClass) {
+			for (const u32 offset : pool.freeRanges[sizeClass]) {
+				typename IdxListPool<Idx>::List range;
+				range.offset = offset;
+				range.capacity = u32(1) << sizeClass;
+
+				if (!claimListRange(pool, range, claimed)) {
+					return false;
+				}
+			}
+		}
+
+		return true;
 	}
 
-	node_handle Graph::addNode(NodeDesc& desc)
+	template <typename I, typename F>
+	bool GraphT<I, F>::validate(std::string *const error) const
 	{
-		node_idx idx;
-		if (deadNodes.size() > 0) {
-			idx = deadNodes.back().idx;
-			nodes[idx].fingerprint = deadNodes.back().fingerprint + 1;
-			deadNodes.pop_back();
+		char message[256];
+		auto fail = [&](const char* what, size_t idx) {
+			snprintf(message, sizeof(message), "%s (%u)", what, unsigned(idx));
+			*error = message;
+			return false;
+		};
+
+		if (ports.uid.size() != ports.size() || ports.node.size() != ports.size() || ports.link.size() != ports.size()
+			|| ports.outputLinks.size() != ports.size() || ports.isOutput.size() != ports.size() || ports.referencedStamp.size() != ports.size()) {
+			return fail("port arrays differ in size", ports.size());
 		}
-		else {
-			idx = node_idx(nodes.size());
-			nodes.push_back(Node());
+
+		if (links.srcPort.size() != links.size() || links.dstPort.size() != links.size() || links.srcSlot.size() != links.size()) {
+			return fail("link arrays differ in size", links.size());
+		}
+
+		if (nodes.inputPorts.size() != nodes.size() || nodes.outputPorts.size() != nodes.size() || nodes.livePos.size() != nodes.size()
+			|| nodes.topoOrder.size() != nodes.size() || nodes.searchStamp.size() != nodes.size()) {
+			return fail("node arrays differ in size", nodes.size());
+		}
+
+		if (journal.size() > maxJournalLength) {
+			return fail("journal wasn't trimmed", journal.size());
+		}
+
+		// Every slot is either live or in its free list, exactly once
+		vector<u8> nodeSeen(nodes.size(), 0);
+		vector<u8> portSeen(ports.size(), 0);
+		vector<u8> linkSeen(links.size(), 0);
+
+		for (const node_handle& dead : deadNodes) {
+			if (dead.idx >= nodes.size() || nodeSeen[dead.idx]++) return fail("bad or repeated dead node", dead.idx);
+			if (dead.fingerprint != nodes.fingerprint[dead.idx]) return fail("dead node fingerprint mismatch", dead.idx);
+			if (nodes.livePos[dead.idx] != invalid_node_idx) return fail("dead node has a live position", dead.idx);
+			if (nodes.inputPorts[dead.idx].capacity != 0 || nodes.outputPorts[dead.idx].capacity != 0) return fail("dead node holds on to its port lists", dead.idx);
 		}
 
-		Node& node = nodes[idx];
-		node.nextNode = firstLiveNode;
-		if (firstLiveNode != invalid_node_idx) nodes[firstLiveNode].prevNode = idx;
-		firstLiveNode = idx;
+		for (const port_handle& dead : deadPorts) {
+			if (dead.idx >= ports.size() || portSeen[dead.idx]++) return fail("bad or repeated dead port", dead.idx);
+			if (dead.fingerprint != ports.fingerprint[dead.idx]) return fail("dead port fingerprint mismatch", dead.idx);
+			if (ports.node[dead.idx] != invalid_node_idx) return fail("dead port still refers to a node", dead.idx);
+			if (ports.outputLinks[dead.idx].capacity != 0) return fail("dead port holds on to its link list", dead.idx);
+		}
+
+		// The ranges of the lists and the vacated ones cover the pools without overlapping
+		vector<u8> portItemClaimed(portLists.items.size(), 0);
+		vector<u8> linkItemClaimed(linkLists.items.size(), 0);
+
+		for (size_t i = 0; i < nodes.size(); ++i) {
+			if (!claimListRange(portLists, nodes.inputPorts[i], portItemClaimed)) return fail("bad input port list range", i);
+			if (!claimListRange(portLists, nodes.outputPorts[i], portItemClaimed)) return fail("bad output port list range", i);
+		}
+
+		for (size_t i = 0; i < ports.size(); ++i) {
+			if (!claimListRange(linkLists, ports.outputLinks[i], linkItemClaimed)) return fail("bad output link list range", i);
+		}
+
+		if (!claimVacatedRanges(portLists, portItemClaimed)) return fail("bad vacated port list range", portLists.items.size());
+		if (!claimVacatedRanges(linkLists, linkItemClaimed)) return fail("bad vacated link list range", linkLists.items.size());
+
+		if (std::find(portItemClaimed.begin(), portItemClaimed.end(), 0) != portItemClaimed.end()) {
+			return fail("port list pool leaks a range", portLists.items.size());
+		}
+
+		if (std::find(linkItemClaimed.begin(), linkItemClaimed.end(), 0) != linkItemClaimed.end()) {
+			return fail("link list pool leaks a range", linkLists.items.size());
+		}
+
+		for (const link_handle& dead : deadLinks) {
+			if (dead.idx >= links.size() || linkSeen[dead.idx]++) return fail("bad or repeated dead link", dead.idx);
+			if (dead.fingerprint != links.fingerprint[dead.idx]) return fail("dead link fingerprint mismatch", dead.idx);
+			if (links.srcPort[dead.idx] != invalid_port_idx) return fail("dead link still refers to a port", dead.idx);
+		}
+
+		vector<u32> topoOrders;
+		size_t attachedPortCount = 0;
+
+		for (size_t pos = 0; pos < liveNodes.size(); ++pos) {
+			const node_idx node = liveNodes[pos];
+			if (node >= nodes.size() || nodeSeen[node]++) return fail("bad or repeated live node", node);
+			if (nodes.livePos[node] != pos) return fail("live node position mismatch", node);
+			if (nodes.topoOrder[node] >= nextTopoOrder) return fail("topological order out of range", node);
+			topoOrders.push_back(nodes.topoOrder[node]);
 
-		if (desc.inputs.size() > 0) {
-			node.firstInputPort = addPort(idx, desc.inputs.back()).idx;
-			for (int i = desc.inputs.size() - 2; i >= 0; --i) {
-				port_idx p = addPort(idx, desc.inputs[i]).idx;
-				addInputPortToNode(node, p);
+			for (int isOutput = 0; isOutput < 2; ++isOutput) {
+				for (const port_idx port : isOutput ? getOutputPorts(node) : getInputPorts(node)) {
+					if (port >= ports.size() || portSeen[port]++) return fail("bad or repeated attached port", port);
+					if (ports.node[port] != node) return fail("port attached to another node", port);
+					if (ports.isOutput[port] != isOutput) return fail("port direction mismatch", port);
+
+					auto indexed = portsByUid.find(portKey(node, isOutput != 0, ports.uid[port]));
+					if (indexed == portsByUid.end() || indexed->second != port) return fail("port missing from the UID index", port);
+
+					++attachedPortCount;
+				}
 			}
 		}
-		else {
-			node.firstInputPort = invalid_port_idx;
+
+		if (portsByUid.size() != attachedPortCount) {
+			return fail("stale entries in the UID index", portsByUid.size());
+		}
+
+		for (size_t i = 0; i < nodes.size(); ++i) {
+			if (!nodeSeen[i]) return fail("node slot neither live nor dead", i);
+		}
+
+		for (size_t i = 0; i < ports.size(); ++i) {
+			if (!portSeen[i]) return fail("port slot neither attached nor dead", i);
 		}
 
-		if (desc.outputs.size() > 0) {
-			node.firstOutputPort = addPort(idx, desc.outputs.back()).idx;
-			for (int i = desc.outputs.size() - 2; i >= 0; --i) {
-				port_idx p = addPort(idx, desc.outputs[i]).idx;
-				addOutputPortToNode(node, p);
+		std::sort(topoOrders.begin(), topoOrders.end());
+		if (std::adjacent_find(topoOrders.begin(), topoOrders.end()) != topoOrders.end()) {
+			return fail("repeated topological order", liveNodes.size());
+		}
+
+		// Links are reached through the ports on both of their ends
+		for (const node_idx node : liveNodes) {
+			for (const port_idx port : getInputPorts(node)) {
+				const link_idx link = ports.link[port];
+				if (link != invalid_link_idx && (link >= links.size() || links.dstPort[link] != port)) {
+					return fail("input port link mismatch", port);
+				}
+
+				if (ports.outputLinks[port].count != 0) return fail("input port has outgoing links", port);
+			}
+
+			for (const port_idx port : getOutputPorts(node)) {
+				if (ports.link[port] != invalid_link_idx) return fail("output port has an incoming link", port);
+
+				const IdxRange<link_idx> outputLinks = getOutputLinks(port);
+				for (size_t slot = 0; slot < outputLinks.size(); ++slot) {
+					const link_idx link = outputLinks[slot];
+					if (link >= links.size() || linkSeen[link]++) return fail("bad or repeated output link", link);
+					if (links.srcPort[link] != port) return fail("output link source mismatch", link);
+					if (links.srcSlot[link] != slot) return fail("output link position mismatch", link);
+
+					const port_idx dstPort = links.dstPort[link];
+					if (dstPort >= ports.size() || ports.isOutput[dstPort] || ports.link[dstPort] != link) {
+						return fail("link destination mismatch", link);
+					}
+
+					if (nodes.topoOrder[node] >= nodes.topoOrder[ports.node[dstPort]]) {
+						return fail("link against the topological order", link);
+					}
+				}
 			}
 		}
-		else {
-			node.firstOutputPort = invalid_port_idx;
+
+		for (size_t i = 0; i < links.size(); ++i) {
+			if (!linkSeen[i]) return fail("link slot neither live nor dead", i);
 		}
 
-		return{ idx, nodes[idx].fingerprint };
+		return true;
 	}
 
-	void Graph::removePort(port_handle portHandle)
+	template <typename I, typename F>
+	void GraphT<I, F>::removePort(port_handle portHandle)
 	{
-		assert(ports[portHandle.idx].fingerprint == portHandle.fingerprint);
+		assert(ports.fingerprint[portHandle.idx] == portHandle.fingerprint);
 		removePort(portHandle.idx);
 	}
 
-	port_handle Graph::portHandle(port_idx idx) {
-		return port_handle(idx, ports[idx].fingerprint);
+	template <typename I, typename F>
+	typename GraphT<I, F>::port_handle GraphT<I, F>::portHandle(port_idx idx) {
+		return port_handle(idx, ports.fingerprint[idx]);
+	}
+
+	template struct GraphT<u32, u32>;
+	template struct GraphT<u16, u16>;
+
+	const u32 GraphSnapshot::invalidIdx;
+
+	shared_ptr<const GraphSnapshot> makeSnapshot(const Graph& graph)
+	{
+		shared_ptr<GraphSnapshot> result = make_shared<GraphSnapshot>();
+		GraphSnapshot& snapshot = *result;
+
+		// Positions in liveNodes are dense already, so they double as the snapshot numbering
+		const size_t nodeCount = graph.liveNodes.size();
+		snapshot.generation = graph.generation;
+		snapshot.nodes = graph.liveNodes;
+		snapshot.outputCount.resize(nodeCount);
+		snapshot.inputBegin.resize(nodeCount + 1);
+
+		for (size_t i = 0; i < nodeCount; ++i) {
+			const node_idx nodeIdx = graph.liveNodes[i];
+			snapshot.outputCount[i] = graph.nodes.outputPorts[nodeIdx].count;
+			snapshot.inputBegin[i] = u32(snapshot.inputUid.size());
+
+			for (const port_idx dstPort : graph.getInputPorts(nodeIdx)) {
+				const link_idx link = graph.ports.link[dstPort];
+				snapshot.inputUid.push_back(graph.ports.uid[dstPort]);
+
+				if (link != invalid_link_idx) {
+					const port_idx srcPort = graph.links.srcPort[link];
+					snapshot.producer.push_back(graph.nodes.livePos[graph.ports.node[srcPort]]);
+					snapshot.producerUid.push_back(graph.ports.uid[srcPort]);
+				}
+				else {
+					snapshot.producer.push_back(GraphSnapshot::invalidIdx);
+					snapshot.producerUid.push_back(0);
+				}
+			}
+		}
+
+		snapshot.inputBegin[nodeCount] = u32(snapshot.inputUid.size());
+		return result;
 	}
-}
\ No newline at end of file
+}
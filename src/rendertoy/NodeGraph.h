@@ -1,26 +1,21 @@
 #pragma once
 #include "Common.h"
 #include <cassert>
+#include <string>
+#include <unordered_map>
 
 
 
 namespace nodegraph {
 	typedef u32 port_uid;
-	typedef u16 port_idx;
-	typedef u16 link_idx;
-	typedef u16 node_idx;
 
-	constexpr port_idx invalid_port_idx = -1;
-	constexpr link_idx invalid_link_idx = -1;
-	constexpr node_idx invalid_node_idx = -1;
-
-	template <typename idx_type>
+	template <typename idx_type, typename fingerprint_type>
 	struct handle {
-		idx_type idx = -1;
-		u16 fingerprint = -1;
+		idx_type idx = idx_type(-1);
+		fingerprint_type fingerprint = fingerprint_type(-1);
 
 		handle() {}
-		handle(idx_type idx, u16 fingerprint)
+		handle(idx_type idx, fingerprint_type fingerprint)
 			: idx(idx)
 			, fingerprint(fingerprint)
 		{}
@@ -37,34 +32,8 @@ namespace nodegraph {
 		}
 	};
 
-	typedef handle<port_idx> port_handle;
-	typedef handle<link_idx> link_handle;
-	typedef handle<node_idx> node_handle;
-
-	struct Port {
-		port_uid uid = 0;
-		node_idx node = invalid_node_idx;
-		link_idx link = invalid_link_idx;
-		port_idx nextInNode = invalid_port_idx;
-		port_idx prevInNode = invalid_port_idx;
-		u16 fingerprint = 0;
-	};
-
-	struct Link {
-		port_idx srcPort = invalid_port_idx;
-		port_idx dstPort = invalid_port_idx;
-		link_idx nextInSrcPort = invalid_link_idx;
-		link_idx prevInSrcPort = invalid_link_idx;
-		u16 fingerprint = 0;
-	};
-
-	struct Node {
-		port_idx firstInputPort = invalid_port_idx;
-		port_idx firstOutputPort = invalid_port_idx;
-		node_idx nextNode = invalid_node_idx;
-		node_idx prevNode = invalid_node_idx;
-		u16 fingerprint = 0;
-	};
+	// Generations of each graph start at a different base; see GraphT::generation
+	u64 allocGenerationBase();
 
 	struct NodeDesc
 	{
@@ -72,94 +41,271 @@ namespace nodegraph {
 		vector<port_uid> outputs;
 	};
 
-	struct LinkDesc {
-		port_handle srcPort;
-		port_handle dstPort;
+	// Contiguous run of indices in an IdxListPool
+	template <typename Idx>
+	struct IdxRange {
+		const Idx* first;
+		const Idx* last;
+
+		const Idx* begin() const { return first; }
+		const Idx* end() const { return last; }
+		size_t size() const { return size_t(last - first); }
+		bool empty() const { return first == last; }
+		Idx operator[](size_t i) const { return first[i]; }
+		Idx back() const { return last[-1]; }
 	};
 
-	struct Graph {
-		vector<Port> ports;
-		vector<Link> links;
-		vector<Node> nodes;
+	// Lists of indices, such as the ports of every node, packed into one shared array. Each list owns
+	// a range of the array with room for a power of two elements, and moves to a range twice the size
+	// when it outgrows it. Vacated ranges are reused by later lists of the same capacity. A list is
+	// thus always contiguous, and the lists of elements created together sit next to each other.
+	template <typename Idx>
+	struct IdxListPool {
+		struct List {
+			u32 offset = 0;
+			u32 count = 0;
+			u32 capacity = 0;
+		};
+
+		vector<Idx> items;
+		vector<u32> freeRanges[32];		// offsets of vacated ranges, by log2 of their capacity
+
+		IdxRange<Idx> range(const List& list) const {
+			const Idx* const first = items.data() + list.offset;
+			return{ first, first + list.count };
+		}
+
+		Idx& at(const List& list, u32 i) {
+			assert(i < list.count);
+			return items[list.offset + i];
+		}
+
+		Idx at(const List& list, u32 i) const {
+			assert(i < list.count);
+			return items[list.offset + i];
+		}
+
+		// Makes room for at least `capacity` elements without moving the list again
+		void reserve(List& list, u32 capacity);
+		void push(List& list, Idx value);
 
-		node_idx firstLiveNode = invalid_node_idx;
+		// Keeps the order of the remaining elements
+		void erase(List& list, u32 i);
+
+		// Returns the range to the pool and empties the list
+		void release(List& list);
+	};
+
+	// Ports, links and nodes live in slots which are reused after removal. Handles pair a slot index
+	// with the slot's fingerprint, which is bumped on every reuse, so that stale handles can be caught.
+	// Index and fingerprint widths are template parameters; a slot can be reused 2^32 times before
+	// its handles alias with the 32-bit default.
+	//
+	// Each field is stored in an array of its own, so that passes over the graph only touch the
+	// fields they need. The ports of a node and the links of an output port are kept in pooled
+	// ranges (see IdxListPool) rather than threaded through the elements, so that iterating them
+	// reads consecutive memory instead of chasing pointers, and doesn't need an allocation per list.
+	// Ports are listed in the order they were added. Links of an output port are in no particular
+	// order; each link knows its position in the list, so that it can be removed in constant time
+	// however many links the port has.
+	//
+	// Links may not form cycles. The nodes are kept in an online topological order (Pearce & Kelly),
+	// where every link goes from a lower nodes.topoOrder to a higher one. A new link which already
+	// respects the order is accepted in constant time. Otherwise only the nodes ordered between its
+	// two ends are searched for a cycle, and then reordered.
+	template <typename IdxType = u32, typename FingerprintType = u32>
+	struct GraphT {
+		typedef IdxType port_idx;
+		typedef IdxType link_idx;
+		typedef IdxType node_idx;
+		typedef FingerprintType fingerprint_type;
+
+		typedef handle<port_idx, fingerprint_type> port_handle;
+		typedef handle<link_idx, fingerprint_type> link_handle;
+		typedef handle<node_idx, fingerprint_type> node_handle;
+
+		static constexpr port_idx invalid_port_idx = port_idx(-1);
+		static constexpr link_idx invalid_link_idx = link_idx(-1);
+		static constexpr node_idx invalid_node_idx = node_idx(-1);
+
+		struct LinkDesc {
+			port_handle srcPort;
+			port_handle dstPort;
+		};
+
+		enum class ChangeType : u8 {
+			NodeAdded,
+			NodeRemoved,
+			NodeModified,	// only recorded through markNodeModified
+			PortAdded,
+			PortRemoved,
+			LinkAdded,
+			LinkRemoved,
+		};
+
+		struct Change {
+			ChangeType type;
+			IdxType idx;	// of the node, port or link
+			fingerprint_type fingerprint;
+		};
+
+		typedef typename IdxListPool<port_idx>::List PortList;
+		typedef typename IdxListPool<link_idx>::List LinkList;
+
+		struct PortArrays {
+			vector<port_uid> uid;
+			vector<node_idx> node;
+			vector<link_idx> link;					// incoming link of an input port
+			vector<LinkList> outputLinks;			// outgoing links of an output port, in linkLists
+			vector<u8> isOutput;
+			vector<u32> referencedStamp;			// scratch for updateNode
+			vector<fingerprint_type> fingerprint;
+
+			size_t size() const { return fingerprint.size(); }
+		};
+
+		struct LinkArrays {
+			vector<port_idx> srcPort;
+			vector<port_idx> dstPort;
+			vector<u32> srcSlot;					// position in ports.outputLinks of the source
+			vector<fingerprint_type> fingerprint;
+
+			size_t size() const { return fingerprint.size(); }
+		};
+
+		struct NodeArrays {
+			vector<PortList> inputPorts;			// in portLists
+			vector<PortList> outputPorts;
+			vector<node_idx> livePos;				// position in liveNodes; invalid_node_idx in dead slots
+			vector<u32> topoOrder;					// distinct across live nodes, but not dense
+			vector<u32> searchStamp;				// scratch for the cycle searches
+			vector<fingerprint_type> fingerprint;
+
+			size_t size() const { return fingerprint.size(); }
+		};
+
+		// Indexed by slot, including dead ones
+		PortArrays ports;
+		LinkArrays links;
+		NodeArrays nodes;
+
+		IdxListPool<port_idx> portLists;
+		IdxListPool<link_idx> linkLists;
+
+		// Slots of the live nodes, in no particular order
+		vector<node_idx> liveNodes;
 
 		vector<port_handle> deadPorts;
 		vector<link_handle> deadLinks;
 		vector<node_handle> deadNodes;
 
+		// The ports attached to nodes, by node, direction and UID; see portKey
+		std::unordered_map<u64, port_idx> portsByUid;
+		u32 updateStamp = 0;
+
+		u32 nextTopoOrder = 0;
+		u32 searchStamp = 0;
+
+		// Results of searchDownstream and searchUpstream
+		vector<node_idx> topoDownstream;
+		vector<node_idx> topoUpstream;
+		vector<u32> topoPool;
+
+		// Every change is appended to the journal and bumps the generation, so that consumers can
+		// catch up on what happened since the generation they last saw, instead of rescanning the
+		// graph. Generations are unique across graphs, so a cursor into a replaced graph is stale.
+		vector<Change> journal;
+		u64 generation = allocGenerationBase();
+
+		// Oldest half of the journal is dropped when it grows past this
+		static const size_t maxJournalLength = 1 << 16;
+
+		// Calls fn for every change after the `since` generation and returns true. Returns false without
+		// calling fn if the journal doesn't go back that far; the consumer has to resync from scratch.
 		template <typename Fn>
-		void iterNodes(Fn fn) const {
-			node_idx next;
-			for (node_idx it = firstLiveNode; it != invalid_node_idx; it = next) {
-				next = nodes[it].nextNode;
-				fn(node_handle(it, nodes[it].fingerprint));
+		bool iterChangesSince(u64 since, Fn fn) const {
+			const u64 first = generation - journal.size();
+			if (since < first || since > generation) {
+				return false;
+			}
 
-				// Removal of the same element is not supported during iteration
-				assert(next == nodes[it].nextNode);
+			for (size_t i = size_t(since - first); i < journal.size(); ++i) {
+				fn(journal[i]);
 			}
+
+			return true;
 		}
 
+		void recordChange(ChangeType type, IdxType idx, fingerprint_type fingerprint);
+
+		// The callbacks of the iterators below may remove the element they were given, but nothing else
+
 		template <typename Fn>
-		void iterNodeInputPorts(node_idx nodeIdx, Fn fn) const {
-			const Node& node = nodes[nodeIdx];
+		void iterNodes(Fn fn) const {
+			for (size_t i = 0; i < liveNodes.size(); ) {
+				const node_idx it = liveNodes[i];
+				fn(node_handle(it, nodes.fingerprint[it]));
 
-			port_idx next;
-			for (port_idx it = node.firstInputPort; it != invalid_port_idx; it = next) {
-				next = ports[it].nextInNode;
-				fn(port_handle(it, ports[it].fingerprint));
+				// Removal swaps the last node into this position
+				if (i < liveNodes.size() && liveNodes[i] == it) {
+					++i;
+				}
+			}
+		}
+
+		template <typename Fn>
+		void iterPorts(const PortList& list, Fn fn) const {
+			for (u32 i = 0; i < list.count; ) {
+				const port_idx it = portLists.at(list, i);
+				fn(port_handle(it, ports.fingerprint[it]));
 
-				// Removal of the same element is not supported during iteration
-				assert(next == ports[it].nextInNode);
+				if (i < list.count && portLists.at(list, i) == it) {
+					++i;
+				}
 			}
 		}
 
 		template <typename Fn>
-		void iterNodeInputPorts(node_handle nodeHandle, Fn fn) const {
-			const Node& node = nodes[nodeHandle.idx];
-			assert(node.fingerprint == nodeHandle.fingerprint);
+		void iterNodeInputPorts(node_idx nodeIdx, Fn fn) const {
+			iterPorts(nodes.inputPorts[nodeIdx], fn);
+		}
 
+		template <typename Fn>
+		void iterNodeInputPorts(node_handle nodeHandle, Fn fn) const {
+			assert(nodes.fingerprint[nodeHandle.idx] == nodeHandle.fingerprint);
 			iterNodeInputPorts(nodeHandle.idx, fn);
 		}
 
 		template <typename Fn>
 		void iterNodeOutputPorts(node_handle nodeHandle, Fn fn) const {
-			const Node& node = nodes[nodeHandle.idx];
-			assert(node.fingerprint == nodeHandle.fingerprint);
-
-			port_idx next;
-			for (port_idx it = node.firstOutputPort; it != invalid_port_idx; it = next) {
-				next = ports[it].nextInNode;
-				fn(port_handle(it, ports[it].fingerprint));
-
-				// Removal of the same element is not supported during iteration
-				assert(next == ports[it].nextInNode);
-			}
+			assert(nodes.fingerprint[nodeHandle.idx] == nodeHandle.fingerprint);
+			iterPorts(nodes.outputPorts[nodeHandle.idx], fn);
 		}
 
 		template <typename Fn>
 		void iterOutputPortLinks(port_handle portHandle, Fn fn) const {
-			const Port& port = ports[portHandle.idx];
-			assert(port.fingerprint == portHandle.fingerprint);
+			assert(ports.fingerprint[portHandle.idx] == portHandle.fingerprint);
 
-			link_idx next;
-			for (link_idx it = port.link; it != invalid_link_idx; it = next) {
-				next = links[it].nextInSrcPort;
-				fn(link_handle(it, links[it].fingerprint));
+			// Removal moves the last link into the removed one's place
+			const LinkList& list = ports.outputLinks[portHandle.idx];
+			for (u32 i = 0; i < list.count; ) {
+				const link_idx it = linkLists.at(list, i);
+				fn(link_handle(it, links.fingerprint[it]));
 
-				// Removal of the same element is not supported during iteration
-				assert(next == links[it].nextInSrcPort);
+				if (i < list.count && linkLists.at(list, i) == it) {
+					++i;
+				}
 			}
 		}
 
 		template <typename Fn>
 		void iterNodeIncidentLinks(node_idx nodeIdx, Fn fn) const {
-			iterNodeInputPorts(nodeIdx, [&](nodegraph::port_handle portHandle) {
-				const Port& dstPort = ports[portHandle.idx];
-				if (dstPort.link != invalid_link_idx) {
-					fn(link_handle(dstPort.link, links[dstPort.link].fingerprint));
+			for (const port_idx dstPort : getInputPorts(nodeIdx)) {
+				const link_idx link = ports.link[dstPort];
+				if (link != invalid_link_idx) {
+					fn(link_handle(link, links.fingerprint[link]));
 				}
-			});
+			}
 		}
 
 		template <typename Fn>
@@ -167,31 +313,121 @@ namespace nodegraph {
 			iterNodeIncidentLinks(nodeHandle.idx, fn);
 		}
 
+		// Direct views of the lists, for loops which don't edit the graph; any edit may move them
+		IdxRange<port_idx> getInputPorts(node_idx node) const {
+			return portLists.range(nodes.inputPorts[node]);
+		}
+
+		IdxRange<port_idx> getOutputPorts(node_idx node) const {
+			return portLists.range(nodes.outputPorts[node]);
+		}
+
+		IdxRange<link_idx> getOutputLinks(port_idx port) const {
+			return linkLists.range(ports.outputLinks[port]);
+		}
+
+		static u64 portKey(node_idx node, bool isOutput, port_uid uid) {
+			return (u64(node) << 33) | (u64(isOutput) << 32) | u64(uid);
+		}
+
+		// invalid_port_idx if the node doesn't have such a port
+		port_idx findInputPort(node_idx node, port_uid uid) const;
+		port_idx findOutputPort(node_idx node, port_uid uid) const;
+
 		node_handle getPortNode(port_handle portHandle) const;
 		port_handle addPort(node_idx node, port_uid uid);
 
-		void addInputPortToNode(Node& node, port_idx port);
-		void addOutputPortToNode(Node& node, port_idx port);
+		// Ports only become visible to lookups and iteration once attached to a node
+		void attachPort(node_idx node, port_idx port, bool isOutput);
+		void addInputPortToNode(node_idx node, port_idx port);
+		void addOutputPortToNode(node_idx node, port_idx port);
+
+		// Nodes reachable from start and ordered before target, in topoDownstream; true if target is reachable
+		bool searchDownstream(node_idx start, node_idx target);
+		// Nodes which reach start and are ordered after lowerBound, in topoUpstream
+		void searchUpstream(node_idx start, u32 lowerBound);
+		void reorderForLink(node_idx srcNode, node_idx dstNode);
+		void renumberTopoOrder();
+
+		// Whether a link from an output of srcNode to an input of dstNode would close a cycle
+		bool wouldCreateCycle(node_idx srcNode, node_idx dstNode);
 
-		void addLink(port_idx srcPort, port_idx dstPort);
-		void addLink(const LinkDesc& desc);
+		// Leaves the graph untouched and returns false if the link would close a cycle
+		bool addLink(port_idx srcPort, port_idx dstPort);
+		bool addLink(const LinkDesc& desc);
 
 		void removeLink(link_idx idx);
 		void removePort(port_idx idx);
 		void removeNode(node_handle nodeHandle);
 
-		void removeUnreferencedInputPorts(Node& node, NodeDesc& desc);
-		void removeUnreferencedOutputPorts(Node& node, NodeDesc& desc);
-
-		void addMissingInputPorts(Node& node, NodeDesc& desc);
-		void addMissingOutputPorts(Node& node, NodeDesc& desc);
+		void removeUnreferencedPorts(node_idx node, bool isOutput, const vector<port_uid>& uids);
+		void addMissingPorts(node_idx node, bool isOutput, const vector<port_uid>& uids);
 
 		// Public
 
 		void updateNode(node_handle h, NodeDesc& desc);
 		node_handle addNode(NodeDesc& desc);
 
+		// For changes to the data which the graph's users associate with a node
+		void markNodeModified(node_handle h);
+
+		// Checks the consistency of all the arrays, indices and free lists, in time linear in the size
+		// of the graph. On failure, describes the first broken invariant in `error`.
+		bool validate(std::string *const error) const;
+
 		void removePort(port_handle portHandle);
 		port_handle portHandle(port_idx idx);
 	};
+
+	template <typename IdxType, typename FingerprintType>
+	constexpr typename GraphT<IdxType, FingerprintType>::port_idx GraphT<IdxType, FingerprintType>::invalid_port_idx;
+	template <typename IdxType, typename FingerprintType>
+	constexpr typename GraphT<IdxType, FingerprintType>::link_idx GraphT<IdxType, FingerprintType>::invalid_link_idx;
+	template <typename IdxType, typename FingerprintType>
+	constexpr typename GraphT<IdxType, FingerprintType>::node_idx GraphT<IdxType, FingerprintType>::invalid_node_idx;
+
+	// Instantiated in NodeGraph.cpp
+	extern template struct IdxListPool<u32>;
+	extern template struct IdxListPool<u16>;
+	extern template struct GraphT<u32, u32>;
+	extern template struct GraphT<u16, u16>;
+
+	typedef GraphT<> Graph;
+
+	typedef Graph::port_idx port_idx;
+	typedef Graph::link_idx link_idx;
+	typedef Graph::node_idx node_idx;
+
+	constexpr port_idx invalid_port_idx = Graph::invalid_port_idx;
+	constexpr link_idx invalid_link_idx = Graph::invalid_link_idx;
+	constexpr node_idx invalid_node_idx = Graph::invalid_node_idx;
+
+	typedef Graph::port_handle port_handle;
+	typedef Graph::link_handle link_handle;
+	typedef Graph::node_handle node_handle;
+
+	typedef Graph::LinkDesc LinkDesc;
+
+	// Immutable copy of the topology of a Graph in flat arrays. Nodes are numbered densely, and the
+	// input slots of every node form a contiguous range (compressed sparse rows). It doesn't refer
+	// back to the graph, so it can be handed to another thread while the graph is being edited.
+	struct GraphSnapshot {
+		static const u32 invalidIdx = u32(-1);
+
+		u64 generation = 0;				// of the graph when the snapshot was taken
+
+		vector<node_idx> nodes;			// graph slot of every node
+		vector<u32> outputCount;		// number of output ports of every node
+
+		// The input slots of node i are [inputBegin[i], inputBegin[i + 1])
+		vector<u32> inputBegin;
+		vector<port_uid> inputUid;		// of the input port
+		vector<u32> producer;			// node feeding the slot, or invalidIdx if it's not connected
+		vector<port_uid> producerUid;	// of the output port feeding the slot
+
+		size_t size() const { return nodes.size(); }
+	};
+
+	// One linear pass over the live nodes and their input ports
+	shared_ptr<const GraphSnapshot> makeSnapshot(const Graph& graph);
 }
@@ -7,9 +7,11 @@
 #include <algorithm>
 #include <unordered_map>
 #include <stdint.h>
+#include <limits.h>
 
 const static ImColor defaultPortColor = ImColor(150, 150, 150, 255);
 const static ImColor invalidPortColor = ImColor(255, 32, 8, 255);
+const static ImColor blockedPortColor = ImColor(70, 70, 70, 255);
 
 const static ImColor defaultPortLabelColor = ImColor(255, 255, 255, 255);
 const static ImColor invalidPortLabelColor = ImColor(255, 32, 8, 255);
@@ -22,7 +24,8 @@ namespace ImGui {
 static inline ImVec2 operator+(const ImVec2& lhs, const ImVec2& rhs) { return ImVec2(lhs.x + rhs.x, lhs.y + rhs.y); }
 static inline ImVec2 operator-(const ImVec2& lhs, const ImVec2& rhs) { return ImVec2(lhs.x - rhs.x, lhs.y - rhs.y); }
 static inline ImVec2 operator*(const ImVec2& lhs, const ImVec2& rhs) { return ImVec2(lhs.x * rhs.x, lhs.y * rhs.y); }
-static inline ImVec2 operator*(const ImVec2& lhs, const float rhs) { return ImVec2(lhs.x*rhs, lhs.y*rhs); }
+static inline ImVec2 operator*(const ImVec2& lhs, const float rhs) { return ImVec2(lhs.x*rhs, lhs.y*rhs); }
+static inline bool operator!=(const ImVec2& lhs, const ImVec2& rhs) { return lhs.x != rhs.x || lhs.y != rhs.y; }
 
 static float dot(const ImVec2& a, const ImVec2& b) {
 	return a.x * b.x + a.y * b.y;
@@ -55,14 +58,230 @@ static float minimumDistance(const ImVec2& v, const ImVec2& w, const ImVec2& p)
 }
 
 struct PortState {
-	ImVec2 pos;
+	ImVec2 pos;		// relative to the top left corner of its node
 	bool valid = true;
 };
 
+// Vertices and indices recorded from ImDrawList calls once, and replayed at an offset on later
+// frames instead of tessellating the same shapes over again.
+struct RetainedMesh
+{
+	std::vector<ImDrawVert> vtx;
+	std::vector<ImDrawIdx> idx;
+	u32 epoch = 0;		// of the style settings it was recorded with; 0 if never recorded
+
+	template <typename Fn>
+	void record(u32 currentEpoch, Fn fn)
+	{
+		static ImDrawList scratch;
+		scratch.Clear();
+		scratch.AddDrawCmd();
+		fn(&scratch);
+
+		vtx.assign(scratch.VtxBuffer.begin(), scratch.VtxBuffer.end());
+		idx.assign(scratch.IdxBuffer.begin(), scratch.IdxBuffer.end());
+		epoch = currentEpoch;
+	}
+
+	void replay(ImDrawList* const drawList, const ImVec2& offset) const
+	{
+		if (idx.empty()) {
+			return;
+		}
+
+		const unsigned int base = drawList->_VtxCurrentIdx;
+		drawList->PrimReserve(int(idx.size()), int(vtx.size()));
+
+		for (const ImDrawVert& v : vtx) {
+			drawList->PrimWriteVtx(v.pos + offset, v.uv, v.col);
+		}
+
+		for (const ImDrawIdx i : idx) {
+			drawList->PrimWriteIdx(ImDrawIdx(base + i));
+		}
+	}
+
+	void clear()
+	{
+		vtx.clear();
+		idx.clear();
+		epoch = 0;
+	}
+};
+
 struct NodeState
 {
 	ImVec2 Pos = { 0, 0 };
 	ImVec2 Size = { 0, 0 };
+
+	// Box and header of the node, relative to its top left corner
+	RetainedMesh background;
+	ImVec2 backgroundSize = { 0, 0 };
+	float backgroundHeaderY = 0.0f;
+	float backgroundZoom = 0.0f;
+	ImU32 backgroundColor = 0;
+
+	// Rect with which the node was last put in the canvas grid
+	ImVec2 indexedPos = { 0, 0 };
+	ImVec2 indexedSize = { 0, 0 };
+};
+
+// Buckets items by the cells of a uniform grid over canvas space which their bounds overlap, so that
+// hit tests and culling only visit the items near the area they're interested in.
+struct CanvasGrid
+{
+	static constexpr float cellSize = 256.0f;
+
+	struct Item {
+		// Range of cells the item was inserted into; empty if it wasn't
+		int minX = 0, minY = 0;
+		int maxX = -1, maxY = -1;
+	};
+
+	std::unordered_map<u64, std::vector<u32>> cells;
+	std::vector<Item> items;
+	std::vector<u32> queryStamp;
+	u32 stamp = 0;
+	u32 version = 1;	// bumped whenever any item changes cells
+
+	static u64 cellKey(int x, int y) {
+		return (u64(u32(x)) << 32) | u64(u32(y));
+	}
+
+	static int cellKeyX(u64 key) {
+		return int(u32(key >> 32));
+	}
+
+	static int cellKeyY(u64 key) {
+		return int(u32(key));
+	}
+
+	static int cellCoord(float v) {
+		return int(floorf(v / cellSize));
+	}
+
+	// Inserts the item or moves it to new bounds. Only touches the cells if the range changes.
+	void set(u32 id, const ImVec2& min, const ImVec2& max)
+	{
+		if (id >= items.size()) {
+			items.resize(id + 1);
+			queryStamp.resize(id + 1, 0);
+		}
+
+		Item cur;
+		cur.minX = cellCoord(min.x);
+		cur.minY = cellCoord(min.y);
+		cur.maxX = cellCoord(max.x);
+		cur.maxY = cellCoord(max.y);
+
+		Item& item = items[id];
+		if (item.minX == cur.minX && item.minY == cur.minY && item.maxX == cur.maxX && item.maxY == cur.maxY) {
+			return;
+		}
+
+		removeFromCells(id, item);
+		item = cur;
+		++version;
+
+		for (int y = item.minY; y <= item.maxY; ++y) {
+			for (int x = item.minX; x <= item.maxX; ++x) {
+				cells[cellKey(x, y)].push_back(id);
+			}
+		}
+	}
+
+	void remove(u32 id)
+	{
+		if (id < items.size()) {
+			removeFromCells(id, items[id]);
+			items[id] = Item();
+			++version;
+		}
+	}
+
+	void clear()
+	{
+		cells.clear();
+		items.clear();
+		queryStamp.clear();
+		++version;
+	}
+
+	// Calls fn(x, y, itemCount) for every non-empty cell overlapping the area
+	template <typename Fn>
+	void iterCells(const ImVec2& min, const ImVec2& max, Fn fn) const
+	{
+		const int minX = cellCoord(min.x), maxX = cellCoord(max.x);
+		const int minY = cellCoord(min.y), maxY = cellCoord(max.y);
+
+		// Zoomed far out the area can span more cells than there are non-empty ones
+		if (double(maxX - minX + 1) * double(maxY - minY + 1) > double(cells.size())) {
+			for (const auto& cell : cells) {
+				const int x = cellKeyX(cell.first), y = cellKeyY(cell.first);
+				if (x >= minX && x <= maxX && y >= minY && y <= maxY) {
+					fn(x, y, cell.second.size());
+				}
+			}
+
+			return;
+		}
+
+		for (int y = minY; y <= maxY; ++y) {
+			for (int x = minX; x <= maxX; ++x) {
+				auto found = cells.find(cellKey(x, y));
+				if (found != cells.end()) {
+					fn(x, y, found->second.size());
+				}
+			}
+		}
+	}
+
+	// Calls fn once for every item sharing a cell with the area; that includes some just outside of it
+	template <typename Fn>
+	void query(const ImVec2& min, const ImVec2& max, Fn fn)
+	{
+		++stamp;
+
+		const int minX = cellCoord(min.x), maxX = cellCoord(max.x);
+		const int minY = cellCoord(min.y), maxY = cellCoord(max.y);
+
+		for (int y = minY; y <= maxY; ++y) {
+			for (int x = minX; x <= maxX; ++x) {
+				auto found = cells.find(cellKey(x, y));
+				if (found == cells.end()) {
+					continue;
+				}
+
+				for (const u32 id : found->second) {
+					if (queryStamp[id] != stamp) {
+						queryStamp[id] = stamp;
+						fn(id);
+					}
+				}
+			}
+		}
+	}
+
+private:
+	void removeFromCells(u32 id, const Item& item)
+	{
+		for (int y = item.minY; y <= item.maxY; ++y) {
+			for (int x = item.minX; x <= item.maxX; ++x) {
+				auto found = cells.find(cellKey(x, y));
+				assert(found != cells.end());
+
+				std::vector<u32>& bucket = found->second;
+				auto it = std::find(bucket.begin(), bucket.end(), id);
+				assert(it != bucket.end());
+				*it = bucket.back();
+				bucket.pop_back();
+
+				if (bucket.empty()) {
+					cells.erase(found);
+				}
+			}
+		}
+	}
 };
 
 enum DragState {
@@ -94,6 +313,22 @@ struct BezierCurve {
 	}
 };
 
+// Curve of a link, scaled by the zoom but not offset
+struct LinkGeometry {
+	RetainedMesh mesh;
+	ImVec2 from;
+	ImVec2 to;
+	float zoom = 0.0f;
+	ImU32 col = 0;
+};
+
+// What nodes and links are drawn as, depending on the zoom
+enum DetailLevel {
+	DetailLevel_Full,		// widgets with labels and ports
+	DetailLevel_Simple,		// flat boxes and straight links
+	DetailLevel_Overview,	// number of nodes in every grid cell
+};
+
 struct Connector {
 	nodegraph::port_handle port;
 	bool isOutput;
@@ -134,52 +369,123 @@ struct NodeGraphState
 	bool openContextMenu = false;
 	nodegraph::node_handle nodeHoveredInScene;
 
-	Connector getHoverCon(const nodegraph::Graph& graph, ImVec2 offset, float maxDist)
+	// Canvas space to screen space, for the current frame
+	ImVec2 canvasOffset = ImVec2(0.0f, 0.0f);
+	float zoom = 1.0f;
+
+	const float minZoom = 0.02f;
+	const float maxZoom = 2.0f;
+	const float simpleDetailZoom = 0.5f;		// below which node labels are dropped
+	const float overviewCellSize = 32.0f;		// on screen, below which grid cells stand for nodes
+
+	// Node rects and the bounds of link curves, in canvas space. Kept in sync with the graph through
+	// its journal, and with the canvas by reindexing the nodes whose layout changed while drawing.
+	CanvasGrid nodeGrid;
+	CanvasGrid linkGrid;
+	u64 syncedGeneration = 0;
+
+	std::vector<nodegraph::node_idx> nodesToPlace;		// added, but not laid out yet
+	const size_t maxPlacementsPerFrame = 64;
+	std::vector<nodegraph::node_idx> visibleNodes;		// drawn this frame
+	std::vector<nodegraph::node_idx> movedNodes;		// whose rect or ports changed while drawing
+
+	std::vector<LinkGeometry> linkGeometry;
+	RetainedMesh gridMesh;
+	ImVec2 gridMeshSize = ImVec2(0.0f, 0.0f);
+	float gridMeshSpacing = 0.0f;
+
+	// Whole graph in a corner of the canvas. The node density is recorded once per change to the grid.
+	const ImVec2 minimapSize = ImVec2(200.0f, 120.0f);
+	const float minimapMargin = 10.0f;
+	RetainedMesh minimapMesh;
+	u32 minimapGridVersion = 0;
+	bool minimapEmpty = true;
+	ImVec2 minimapBoundsMin = ImVec2(0.0f, 0.0f);		// of the graph in canvas space
+	ImVec2 minimapContentOffset = ImVec2(0.0f, 0.0f);	// of the bounds within the minimap
+	float minimapScale = 1.0f;
+	ImVec2 minimapPos = ImVec2(0.0f, 0.0f);				// on screen this frame
+
+	// Bumped when the style settings which the retained meshes depend on change
+	u32 geometryEpoch = 1;
+	ImVec2 geometryUvWhitePixel = ImVec2(0.0f, 0.0f);
+	float geometryCurveTessellationTol = 0.0f;
+	bool geometryAntiAliasedLines = false;
+	bool geometryAntiAliasedShapes = false;
+
+	void updateGeometryEpoch()
 	{
-		const ImVec2 mousePos = ImGui::GetIO().MousePos;
-		Connector result;
+		const ImGuiStyle& style = ImGui::GetStyle();
+		const ImVec2 uvWhitePixel = ImGui::GetFontTexUvWhitePixel();
 
-		graph.iterNodes([&](nodegraph::node_handle nodeHandle)
+		if (uvWhitePixel != geometryUvWhitePixel
+			|| style.CurveTessellationTol != geometryCurveTessellationTol
+			|| style.AntiAliasedLines != geometryAntiAliasedLines
+			|| style.AntiAliasedShapes != geometryAntiAliasedShapes)
 		{
-			const nodegraph::Node& node = graph.nodes[nodeHandle.idx];
+			geometryUvWhitePixel = uvWhitePixel;
+			geometryCurveTessellationTol = style.CurveTessellationTol;
+			geometryAntiAliasedLines = style.AntiAliasedLines;
+			geometryAntiAliasedShapes = style.AntiAliasedShapes;
+			++geometryEpoch;
+		}
+	}
 
-			{
-				float closestDist = 1e5f;
-				nodegraph::port_handle closest;
+	DetailLevel getDetailLevel() const
+	{
+		if (zoom >= simpleDetailZoom) {
+			return DetailLevel_Full;
+		}
+		else if (CanvasGrid::cellSize * zoom >= overviewCellSize) {
+			return DetailLevel_Simple;
+		}
+		else {
+			return DetailLevel_Overview;
+		}
+	}
 
-				graph.iterNodeInputPorts(nodeHandle, [&](nodegraph::port_handle portHandle)
-				{
-					const float d = distance(ports[portHandle.idx].pos, mousePos);
-					if (d < closestDist) {
-						closestDist = d;
-						closest = portHandle;
-					}
-				});
+	ImVec2 toScreen(const ImVec2& canvasPos) const
+	{
+		return canvasOffset + canvasPos * zoom;
+	}
 
-				if (closestDist < maxDist) {
-					result = Connector{ closest, false };
-					return;
-				}
-			}
+	ImVec2 toCanvas(const ImVec2& screenPos) const
+	{
+		return (screenPos - canvasOffset) * (1.0f / zoom);
+	}
 
-			{
-				float closestDist = 1e5f;
-				nodegraph::port_handle closest;
+	Connector getHoverCon(const nodegraph::Graph& graph, float maxDist)
+	{
+		Connector result;
 
-				graph.iterNodeOutputPorts(nodeHandle, [&](nodegraph::port_handle portHandle)
-				{
-					const float d = distance(ports[portHandle.idx].pos, mousePos);
-					if (d < closestDist) {
-						closestDist = d;
-						closest = portHandle;
-					}
-				});
+		// Ports are only shown, and can only be dragged, at full detail
+		if (getDetailLevel() != DetailLevel_Full) {
+			return result;
+		}
 
-				if (closestDist < maxDist) {
-					result = Connector{ closest, true };
-					return;
+		const ImVec2 mousePos = toCanvas(ImGui::GetIO().MousePos);
+		const ImVec2 extent(maxDist / zoom, maxDist / zoom);
+
+		// Ports sit on the edges of their nodes, so only the nodes near the mouse need looking at
+		float closestDist = maxDist;
+		nodeGrid.query(mousePos - extent, mousePos + extent, [&](u32 nodeIdx)
+		{
+			graph.iterNodeInputPorts(nodeIdx, [&](nodegraph::port_handle portHandle)
+			{
+				const float d = distance(getPortCanvasPos(graph, portHandle.idx), mousePos) * zoom;
+				if (d < closestDist) {
+					closestDist = d;
+					result = Connector{ portHandle, false };
 				}
-			}
+			});
+
+			graph.iterPorts(graph.nodes.outputPorts[nodeIdx], [&](nodegraph::port_handle portHandle)
+			{
+				const float d = distance(getPortCanvasPos(graph, portHandle.idx), mousePos) * zoom;
+				if (d < closestDist) {
+					closestDist = d;
+					result = Connector{ portHandle, true };
+				}
+			});
 		});
 
 		return result;
@@ -198,14 +504,19 @@ struct NodeGraphState
 		s_dragPorts.clear();
 	}
 
-	ImVec2 getPortPos(nodegraph::port_idx h) const
+	ImVec2 getPortCanvasPos(const nodegraph::Graph& graph, nodegraph::port_idx h) const
+	{
+		return nodes[graph.ports.node[h]].Pos + ports[h].pos;
+	}
+
+	ImVec2 getPortPos(const nodegraph::Graph& graph, nodegraph::port_idx h) const
 	{
-		return ports[h].pos;
+		return toScreen(getPortCanvasPos(graph, h));
 	}
 
-	ImVec2 getPortPos(nodegraph::port_handle h) const
+	ImVec2 getPortPos(const nodegraph::Graph& graph, nodegraph::port_handle h) const
 	{
-		return ports[h.idx].pos;
+		return getPortPos(graph, h.idx);
 	}
 
 	bool canDropDragOnPort(nodegraph::Graph& graph, nodegraph::port_handle port) const
@@ -216,10 +527,11 @@ struct NodeGraphState
 			bool canDrop = false;
 
 			nodegraph::node_handle conNode = graph.getPortNode(port);
-			if (conNode.idx != dragNode.idx) {
-				// TODO: more checks
-
-				canDrop = true;
+			if (s_draggingOutput) {
+				canDrop = !graph.wouldCreateCycle(dragNode.idx, conNode.idx);
+			}
+			else {
+				canDrop = !graph.wouldCreateCycle(conNode.idx, dragNode.idx);
 			}
 
 			canDropAll = canDropAll && canDrop;
@@ -228,6 +540,16 @@ struct NodeGraphState
 		return canDropAll;
 	}
 
+	ImColor getPortColor(nodegraph::Graph& graph, nodegraph::port_handle portHandle, bool isOutput) const
+	{
+		// Grey out the ports which the dragged links can't be dropped on
+		if (DragState_Dragging == s_dragState && isOutput != s_draggingOutput && !canDropDragOnPort(graph, portHandle)) {
+			return blockedPortColor;
+		}
+
+		return ports[portHandle.idx].valid ? defaultPortColor : invalidPortColor;
+	}
+
 	void handleDrop(nodegraph::Graph& graph, nodegraph::port_handle portHandle)
 	{
 		// Add all the connections
@@ -248,7 +570,7 @@ struct NodeGraphState
 	}
 
 	// Must be called after drawNodes
-	void updateDragging(nodegraph::Graph& graph, INodeGraphGuiGlue& glue, ImDrawList* const drawList, ImVec2 offset)
+	void updateDragging(nodegraph::Graph& graph, INodeGraphGuiGlue& glue, ImDrawList* const drawList)
 	{
 		// Loop the state machine as long as the states keep changing
 		DragState prevDragState;
@@ -259,13 +581,13 @@ struct NodeGraphState
 			{
 			case DragState_Default:
 			{
-				Connector con = getHoverCon(graph, offset, NodeSlotRadius * 1.5f);
+				Connector con = getHoverCon(graph, NodeSlotRadius * 1.5f);
 				if (con.port.valid()) {
 					if (ImGui::IsMouseClicked(0)) {
 						s_dragPorts.push_back(con.port);
 						s_draggingOutput = con.isOutput;
 
-						const bool dragOutInput = !con.isOutput && graph.ports[con.port.idx].link != nodegraph::invalid_link_idx;
+						const bool dragOutInput = !con.isOutput && graph.ports.link[con.port.idx] != nodegraph::invalid_link_idx;
 						const bool dragOutInvalidOutput = con.isOutput && !ports[con.port.idx].valid;
 
 						if (dragOutInput || dragOutInvalidOutput) {
@@ -292,35 +614,24 @@ struct NodeGraphState
 					return;
 				}
 
-				Connector con = getHoverCon(graph, offset, NodeSlotRadius * 3.f);
+				Connector con = getHoverCon(graph, NodeSlotRadius * 3.f);
 				if (!con.port.valid() || s_dragPorts[0] != con.port)
 				{
 					nodegraph::port_idx detachedPort = s_dragPorts[0].idx;
 					s_dragPorts.clear();
 
 					if (!s_draggingOutput) {
-						nodegraph::link_idx link = graph.ports[detachedPort].link;
-						nodegraph::port_handle srcPort = graph.portHandle(graph.links[link].srcPort);
+						nodegraph::link_idx link = graph.ports.link[detachedPort];
+						nodegraph::port_handle srcPort = graph.portHandle(graph.links.srcPort[link]);
 						s_dragPorts.push_back(srcPort);
 						graph.removeLink(link);
 					}
 					else {
-						nodegraph::link_idx toRemove = nodegraph::invalid_link_idx;
-						graph.iterOutputPortLinks(graph.portHandle(detachedPort), [&](nodegraph::port_handle link) {
-							nodegraph::port_handle dstPort = graph.portHandle(graph.links[link.idx].dstPort);
+						graph.iterOutputPortLinks(graph.portHandle(detachedPort), [&](nodegraph::link_handle link) {
+							nodegraph::port_handle dstPort = graph.portHandle(graph.links.dstPort[link.idx]);
 							s_dragPorts.push_back(dstPort);
-
-							// Can't remove the current link, but we can remove the previous one.
-							if (toRemove != nodegraph::invalid_link_idx) {
-								graph.removeLink(toRemove);
-							}
-							toRemove = link.idx;
+							graph.removeLink(link.idx);
 						});
-
-						// Nuke the last link if any
-						if (toRemove != nodegraph::invalid_link_idx) {
-							graph.removeLink(toRemove);
-						}
 					}
 
 					s_draggingOutput = !s_draggingOutput;
@@ -334,19 +645,19 @@ struct NodeGraphState
 			{
 				if (s_draggingOutput) {
 					assert(1 == s_dragPorts.size());
-					BezierCurve linkCurve = getNodeLinkCurve(getPortPos(s_dragPorts[0]), ImGui::GetIO().MousePos);
+					BezierCurve linkCurve = getNodeLinkCurve(getPortPos(graph, s_dragPorts[0]), ImGui::GetIO().MousePos);
 					drawNodeLink(drawList, linkCurve);
 				}
 				else {
 					for (auto port : s_dragPorts) {
-						BezierCurve linkCurve = getNodeLinkCurve(ImGui::GetIO().MousePos, getPortPos(port));
+						BezierCurve linkCurve = getNodeLinkCurve(ImGui::GetIO().MousePos, getPortPos(graph, port));
 						drawNodeLink(drawList, linkCurve);
 					}
 				}
 
 				const bool drop = !ImGui::IsMouseDown(0);
 
-				Connector con = getHoverCon(graph, offset, NodeSlotRadius * 3.f);
+				Connector con = getHoverCon(graph, NodeSlotRadius * 3.f);
 
 				if (!con.port.valid()) {
 					if (nodeHoveredInScene.valid()) {
@@ -369,7 +680,7 @@ struct NodeGraphState
 
 						for (auto& portHandle : s_validDropPorts) {
 							drawList->ChannelsSetCurrent(2);
-							drawNodeConnector(drawList, getPortPos(portHandle), ImColor(32, 220, 120, 255));
+							drawNodeConnector(drawList, getPortPos(graph, portHandle), ImColor(32, 220, 120, 255));
 						}
 
 						if (drop) {
@@ -393,7 +704,7 @@ struct NodeGraphState
 					if (canDropAll)
 					{
 						drawList->ChannelsSetCurrent(2);
-						drawNodeConnector(drawList, getPortPos(con.port), ImColor(32, 220, 120, 255));
+						drawNodeConnector(drawList, getPortPos(graph, con.port), ImColor(32, 220, 120, 255));
 
 						if (drop)
 						{
@@ -435,184 +746,573 @@ struct NodeGraphState
 		} while (prevDragState != s_dragState);
 	}
 
-	void drawNodes(nodegraph::Graph& graph, INodeGraphGuiGlue& glue, ImDrawList* const drawList, const ImVec2& offset)
+	void drawNodes(nodegraph::Graph& graph, INodeGraphGuiGlue& glue, ImDrawList* const drawList)
 	{
-		const ImVec2 NodeWindowPadding(12.0f, 8.0f);
-
 		if (ImGui::IsMouseClicked(0)) {
 			nodeSelected = nodegraph::node_handle();
 		}
 
-		// Display nodes
-		graph.iterNodes([&](nodegraph::node_handle nodeHandle)
+		const bool fullDetail = getDetailLevel() == DetailLevel_Full;
+
+		// The node widgets are laid out at the zoomed size
+		ImGui::SetWindowFontScale(zoom);
+		ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImGui::GetStyle().ItemSpacing * zoom);
+
+		// Display nodes. New ones are laid out in full regardless of the zoom, to find their size.
+		for (const nodegraph::node_idx nodeIdx : visibleNodes) {
+			const nodegraph::node_handle nodeHandle(nodeIdx, graph.nodes.fingerprint[nodeIdx]);
+
+			if (fullDetail || 0 == nodes[nodeIdx].Size.x) {
+				drawNode(graph, glue, drawList, nodeHandle);
+			}
+			else {
+				drawNodeBox(glue, drawList, nodeHandle);
+			}
+		}
+
+		ImGui::PopStyleVar();
+		ImGui::SetWindowFontScale(1.0f);
+	}
+
+	// Hovering, selection and dragging of the node, through the button just emitted over it
+	void updateNodeInteraction(INodeGraphGuiGlue& glue, nodegraph::node_handle nodeHandle, bool nodeWidgetsActive)
+	{
+		NodeState& node = nodes[nodeHandle.idx];
+
+		if (ImGui::IsItemHovered())
 		{
-			NodeState& node = nodes[nodeHandle.idx];
-			ImGui::PushID(nodeHandle.idx);
-			ImVec2 nodeRectMin = offset + node.Pos;
+			nodeHoveredInScene = nodeHandle;
+			openContextMenu |= ImGui::IsMouseClicked(1);
 
-			// Display node contents first
-			drawList->ChannelsSetCurrent(2); // Foreground
-			const bool oldAnyActive = ImGui::IsAnyItemActive();
-			ImGui::SetCursorScreenPos(nodeRectMin + NodeWindowPadding);
+			if (ImGui::IsMouseDoubleClicked(0)) {
+				glue.onTriggered(nodeHandle);
+			}
+		}
+		bool nodeMovingActive = ImGui::IsItemActive();
+		if (nodeWidgetsActive || nodeMovingActive)
+			nodeSelected = nodeHandle;
+		if (nodeMovingActive && ImGui::IsMouseDragging(0))
+			node.Pos = node.Pos + ImGui::GetIO().MouseDelta * (1.0f / zoom);
+	}
 
-			ImGui::BeginGroup();
-			ImGui::Text(glue.getNodeName(nodeHandle).c_str());
-			ImGui::Dummy(ImVec2(0, 5));
+	// Flat box without labels or ports, at the size the node was last laid out with
+	void drawNodeBox(INodeGraphGuiGlue& glue, ImDrawList* const drawList, nodegraph::node_handle nodeHandle)
+	{
+		NodeState& node = nodes[nodeHandle.idx];
+		ImGui::PushID(nodeHandle.idx);
+		const ImVec2 nodeRectMin = toScreen(node.Pos);
+		const ImVec2 nodeRectSize = node.Size * zoom;
 
-			const float nodeHeaderMaxY = ImGui::GetCursorScreenPos().y;
+		drawList->ChannelsSetCurrent(0); // Background
+		ImGui::SetCursorScreenPos(nodeRectMin);
+		ImGui::InvisibleButton("node", nodeRectSize);
+		updateNodeInteraction(glue, nodeHandle, false);
 
-			ImGui::BeginGroup();
+		ImU32 nodeBgColor = (nodeHoveredInScene == nodeHandle || nodeSelected == nodeHandle) ? ImColor(95, 95, 95) : ImColor(75, 75, 75);
+		drawList->AddRectFilled(nodeRectMin, nodeRectMin + nodeRectSize, nodeBgColor);
 
-			ImGui::BeginGroup(); // Lock horizontal position
-			graph.iterNodeInputPorts(nodeHandle, [&](nodegraph::port_handle portHandle)
-			{
-				auto portInfo = glue.getPortInfo(portHandle);
-				ImVec2 cursorLeft = ImGui::GetCursorScreenPos();
-				ImColor textColor = defaultPortLabelColor;
-				if (!portInfo.valid) textColor = invalidPortLabelColor;
+		ImGui::PopID();
 
-				ImGui::PushStyleColor(ImGuiCol_Text, textColor);
-				ImGui::Text(portInfo.name.c_str());
-				ImGui::PopStyleColor();
+		if (node.Pos != node.indexedPos) {
+			movedNodes.push_back(nodeHandle.idx);
+		}
+	}
 
-				ports[portHandle.idx].pos = cursorLeft + ImVec2(-NodeWindowPadding.x, 0.5f * ImGui::GetItemRectSize().y);
-				ports[portHandle.idx].valid = portInfo.valid;
-			});
-			ImGui::EndGroup();
+	void drawNode(nodegraph::Graph& graph, INodeGraphGuiGlue& glue, ImDrawList* const drawList, nodegraph::node_handle nodeHandle)
+	{
+		const ImVec2 NodeWindowPadding = ImVec2(12.0f, 8.0f) * zoom;
 
-			// Make some space in the middle
-			ImGui::SameLine();
-			ImGui::Dummy(ImVec2(20, 0));
+		NodeState& node = nodes[nodeHandle.idx];
+		bool portsMoved = false;
+		ImGui::PushID(nodeHandle.idx);
+		ImVec2 nodeRectMin = toScreen(node.Pos);
 
-			ImGui::SameLine();
+		// Display node contents first
+		drawList->ChannelsSetCurrent(2); // Foreground
+		const bool oldAnyActive = ImGui::IsAnyItemActive();
+		ImGui::SetCursorScreenPos(nodeRectMin + NodeWindowPadding);
 
-			ImGui::BeginGroup(); // Lock horizontal position
-			float cursorStart = ImGui::GetCursorPosX();
-			float maxWidth = 0.0f;
+		ImGui::BeginGroup();
+		ImGui::Text(glue.getNodeName(nodeHandle).c_str());
+		ImGui::Dummy(ImVec2(0, 5) * zoom);
 
-			graph.iterNodeOutputPorts(nodeHandle, [&](nodegraph::port_handle portHandle) {
-				maxWidth = std::max(maxWidth, ImGui::CalcTextSize(glue.getPortInfo(portHandle).name.c_str()).x);
-			});
+		const float nodeHeaderMaxY = ImGui::GetCursorScreenPos().y;
 
-			graph.iterNodeOutputPorts(nodeHandle, [&](nodegraph::port_handle portHandle)
-			{
-				auto portInfo = glue.getPortInfo(portHandle);
-				const std::string name = portInfo.name;
-				const float width = ImGui::CalcTextSize(name.c_str()).x;
-				ImGui::SetCursorPosX(cursorStart + maxWidth - width);
-				ImVec2 cursorLeft = ImGui::GetCursorScreenPos();
+		ImGui::BeginGroup();
 
-				ImColor textColor = defaultPortLabelColor;
-				if (!portInfo.valid) textColor = invalidPortLabelColor;
+		ImGui::BeginGroup(); // Lock horizontal position
+		graph.iterNodeInputPorts(nodeHandle, [&](nodegraph::port_handle portHandle)
+		{
+			auto portInfo = glue.getPortInfo(portHandle);
+			ImVec2 cursorLeft = ImGui::GetCursorScreenPos();
+			ImColor textColor = defaultPortLabelColor;
+			if (!portInfo.valid) textColor = invalidPortLabelColor;
+
+			ImGui::PushStyleColor(ImGuiCol_Text, textColor);
+			ImGui::Text(portInfo.name.c_str());
+			ImGui::PopStyleColor();
+
+			const ImVec2 portPos = (cursorLeft + ImVec2(-NodeWindowPadding.x, 0.5f * ImGui::GetItemRectSize().y) - nodeRectMin) * (1.0f / zoom);
+			portsMoved = portsMoved || ports[portHandle.idx].pos != portPos;
+			ports[portHandle.idx].pos = portPos;
+			ports[portHandle.idx].valid = portInfo.valid;
+		});
+		ImGui::EndGroup();
 
-				ImGui::PushStyleColor(ImGuiCol_Text, textColor);
-				ImGui::Text(name.c_str());
-				ImGui::PopStyleColor();
+		// Make some space in the middle
+		ImGui::SameLine();
+		ImGui::Dummy(ImVec2(20, 0) * zoom);
 
-				ports[portHandle.idx].pos = cursorLeft + ImVec2(NodeWindowPadding.x + width, 0.5f * ImGui::GetItemRectSize().y);
-				ports[portHandle.idx].valid = portInfo.valid;
-			});
-			ImGui::EndGroup();
+		ImGui::SameLine();
 
-			ImGui::EndGroup();
-			ImGui::EndGroup();
+		ImGui::BeginGroup(); // Lock horizontal position
+		float cursorStart = ImGui::GetCursorPosX();
+		float maxWidth = 0.0f;
 
-			// Note: Could draw node interior here
+		graph.iterNodeOutputPorts(nodeHandle, [&](nodegraph::port_handle portHandle) {
+			maxWidth = std::max(maxWidth, ImGui::CalcTextSize(glue.getPortInfo(portHandle).name.c_str()).x);
+		});
 
-			ImGui::GetCursorPos();
+		graph.iterNodeOutputPorts(nodeHandle, [&](nodegraph::port_handle portHandle)
+		{
+			auto portInfo = glue.getPortInfo(portHandle);
+			const std::string name = portInfo.name;
+			const float width = ImGui::CalcTextSize(name.c_str()).x;
+			ImGui::SetCursorPosX(cursorStart + maxWidth - width);
+			ImVec2 cursorLeft = ImGui::GetCursorScreenPos();
+
+			ImColor textColor = defaultPortLabelColor;
+			if (!portInfo.valid) textColor = invalidPortLabelColor;
+
+			ImGui::PushStyleColor(ImGuiCol_Text, textColor);
+			ImGui::Text(name.c_str());
+			ImGui::PopStyleColor();
+
+			const ImVec2 portPos = (cursorLeft + ImVec2(NodeWindowPadding.x + width, 0.5f * ImGui::GetItemRectSize().y) - nodeRectMin) * (1.0f / zoom);
+			portsMoved = portsMoved || ports[portHandle.idx].pos != portPos;
+			ports[portHandle.idx].pos = portPos;
+			ports[portHandle.idx].valid = portInfo.valid;
+		});
+		ImGui::EndGroup();
 
-			// Save the size of what we have emitted and whether any of the widgets are being used
-			bool nodeWidgetsActive = (!oldAnyActive && ImGui::IsAnyItemActive());
-			node.Size = ImGui::GetItemRectSize() + NodeWindowPadding + NodeWindowPadding;
-			ImVec2 nodeRectMax = nodeRectMin + node.Size;
+		ImGui::EndGroup();
+		ImGui::EndGroup();
 
-			// Display node box
-			drawList->ChannelsSetCurrent(0); // Background
-			ImGui::SetCursorScreenPos(nodeRectMin);
-			ImGui::InvisibleButton("node", node.Size);
+		// Note: Could draw node interior here
 
-			if (ImGui::IsItemHovered())
-			{
-				nodeHoveredInScene = nodeHandle;
-				openContextMenu |= ImGui::IsMouseClicked(1);
+		ImGui::GetCursorPos();
 
-				if (ImGui::IsMouseDoubleClicked(0)) {
-					glue.onTriggered(nodeHandle);
-				}
-			}
-			bool nodeMovingActive = ImGui::IsItemActive();
-			if (nodeWidgetsActive || nodeMovingActive)
-				nodeSelected = nodeHandle;
-			if (nodeMovingActive && ImGui::IsMouseDragging(0))
-				node.Pos = node.Pos + ImGui::GetIO().MouseDelta;
+		// Save the size of what we have emitted and whether any of the widgets are being used
+		bool nodeWidgetsActive = (!oldAnyActive && ImGui::IsAnyItemActive());
+		const ImVec2 nodeRectSize = ImGui::GetItemRectSize() + NodeWindowPadding + NodeWindowPadding;
+		node.Size = nodeRectSize * (1.0f / zoom);
 
-			ImU32 nodeBgColor = (nodeHoveredInScene == nodeHandle || nodeSelected == nodeHandle) ? ImColor(75, 75, 75) : ImColor(60, 60, 60);
-			drawList->AddRectFilled(nodeRectMin, nodeRectMax, nodeBgColor, 8.0f);
-			drawList->AddRectFilled(nodeRectMin, ImVec2(nodeRectMax.x, nodeHeaderMaxY - 6), ImColor(255, 255, 255, 32), 8.0f, 1 | 2);
+		// Display node box
+		drawList->ChannelsSetCurrent(0); // Background
+		ImGui::SetCursorScreenPos(nodeRectMin);
+		ImGui::InvisibleButton("node", nodeRectSize);
+		updateNodeInteraction(glue, nodeHandle, nodeWidgetsActive);
 
-			ImColor frameColor = ImColor(255, 255, 255, 20);
-			drawList->AddLine(ImVec2(nodeRectMin.x, nodeHeaderMaxY - 6 - 1), ImVec2(nodeRectMax.x, nodeHeaderMaxY - 6 - 1), frameColor);
-			drawList->AddRect(nodeRectMin, nodeRectMax, frameColor, 8.0f);
+		ImU32 nodeBgColor = (nodeHoveredInScene == nodeHandle || nodeSelected == nodeHandle) ? ImColor(75, 75, 75) : ImColor(60, 60, 60);
+		const float headerY = nodeHeaderMaxY - nodeRectMin.y;
 
-			drawList->ChannelsSetCurrent(2); // Foreground
+		if (node.background.epoch != geometryEpoch || node.backgroundSize != node.Size || node.backgroundHeaderY != headerY || node.backgroundZoom != zoom || node.backgroundColor != nodeBgColor) {
+			node.backgroundSize = node.Size;
+			node.backgroundHeaderY = headerY;
+			node.backgroundZoom = zoom;
+			node.backgroundColor = nodeBgColor;
 
-			graph.iterNodeInputPorts(nodeHandle, [&](nodegraph::port_handle portHandle)
+			node.background.record(geometryEpoch, [&](ImDrawList* const bg)
 			{
-				drawNodeConnector(drawList, ports[portHandle.idx].pos, ports[portHandle.idx].valid ? defaultPortColor : invalidPortColor);
+				const ImVec2 rectMax = nodeRectSize;
+				const float rounding = 8.0f * zoom;
+				const float headerMaxY = headerY - 6 * zoom;
+				bg->AddRectFilled(ImVec2(0, 0), rectMax, nodeBgColor, rounding);
+				bg->AddRectFilled(ImVec2(0, 0), ImVec2(rectMax.x, headerMaxY), ImColor(255, 255, 255, 32), rounding, 1 | 2);
+
+				ImColor frameColor = ImColor(255, 255, 255, 20);
+				bg->AddLine(ImVec2(0, headerMaxY - 1), ImVec2(rectMax.x, headerMaxY - 1), frameColor);
+				bg->AddRect(ImVec2(0, 0), rectMax, frameColor, rounding);
 			});
+		}
 
-			graph.iterNodeOutputPorts(nodeHandle, [&](nodegraph::port_handle portHandle)
-			{
-				drawNodeConnector(drawList, ports[portHandle.idx].pos, ports[portHandle.idx].valid ? defaultPortColor : invalidPortColor);
-			});
+		node.background.replay(drawList, nodeRectMin);
 
-			ImGui::PopID();
+		drawList->ChannelsSetCurrent(2); // Foreground
+
+		graph.iterNodeInputPorts(nodeHandle, [&](nodegraph::port_handle portHandle)
+		{
+			drawNodeConnector(drawList, getPortPos(graph, portHandle), getPortColor(graph, portHandle, false));
+		});
+
+		graph.iterNodeOutputPorts(nodeHandle, [&](nodegraph::port_handle portHandle)
+		{
+			drawNodeConnector(drawList, getPortPos(graph, portHandle), getPortColor(graph, portHandle, true));
 		});
+
+		ImGui::PopID();
+
+		if (portsMoved || node.Pos != node.indexedPos || node.Size != node.indexedSize) {
+			movedNodes.push_back(nodeHandle.idx);
+		}
 	}
 
-	void drawLinks(nodegraph::Graph& graph, INodeGraphGuiGlue& glue, ImDrawList* const drawList, const ImVec2& offset)
+	void drawLinks(nodegraph::Graph& graph, INodeGraphGuiGlue& glue, ImDrawList* const drawList, const ImVec2& visibleMin, const ImVec2& visibleMax)
 	{
 		// Display links
 		drawList->ChannelsSetCurrent(1); // Background
+		const bool fullDetail = getDetailLevel() == DetailLevel_Full;
 
-		graph.iterNodes([&](nodegraph::node_handle nodeHandle)
+		linkGrid.query(visibleMin, visibleMax, [&](u32 link)
 		{
-			graph.iterNodeInputPorts(nodeHandle, [&](nodegraph::port_handle portHandle)
-			{
-				const nodegraph::Port& port = graph.ports[portHandle.idx];
-				if (port.link != nodegraph::invalid_link_idx) {
-					const nodegraph::Link& link = graph.links[port.link];
+			const nodegraph::port_idx srcPort = graph.links.srcPort[link];
+			const nodegraph::port_idx dstPort = graph.links.dstPort[link];
+
+			// Removed by the dragging this frame; the grid catches up on the next sync
+			if (srcPort == nodegraph::invalid_port_idx) {
+				return;
+			}
+
+			ImColor linkColor = ImColor(200, 200, 100, 128);
+
+			// Zoomed out, straight segments colored by the port state of the last full layout
+			if (!fullDetail) {
+				if (!ports[srcPort].valid || !ports[dstPort].valid) {
+					linkColor = ImColor(255, 32, 8, 255);
+				}
+
+				drawList->AddLine(getPortPos(graph, srcPort), getPortPos(graph, dstPort), linkColor);
+				return;
+			}
+
+			// Scaled, but not offset, so that scrolling can replay the same curves
+			ImVec2 p1 = getPortCanvasPos(graph, srcPort) * zoom;
+			ImVec2 p2 = getPortCanvasPos(graph, dstPort) * zoom;
+
+			const auto p1info = glue.getPortInfo(graph.portHandle(srcPort));
+			const auto p2info = glue.getPortInfo(graph.portHandle(dstPort));
+
+			if (!p1info.valid || !p2info.valid) {
+				linkColor = ImColor(255, 32, 8, 255);
+			}
+
+			// Only re-tessellate the curves whose ends moved
+			LinkGeometry& geom = linkGeometry[link];
+			if (geom.mesh.epoch != geometryEpoch || geom.from != p1 || geom.to != p2 || geom.zoom != zoom || geom.col != ImU32(linkColor)) {
+				geom.from = p1;
+				geom.to = p2;
+				geom.zoom = zoom;
+				geom.col = linkColor;
+				geom.mesh.record(geometryEpoch, [&](ImDrawList* const curveList) {
+					drawNodeLink(curveList, getNodeLinkCurve(p1, p2), linkColor);
+				});
+			}
+
+			geom.mesh.replay(drawList, canvasOffset);
+		});
+	}
+
+	// Stands in for the nodes when zoomed out too far to tell them apart: shades every grid cell by
+	// the number of nodes in it, which keeps the cost bound by the screen size.
+	void drawOverview(ImDrawList* const drawList, const ImVec2& visibleMin, const ImVec2& visibleMax)
+	{
+		drawList->ChannelsSetCurrent(0); // Background
+
+		const float cellSize = CanvasGrid::cellSize * zoom;
+		nodeGrid.iterCells(visibleMin, visibleMax, [&](int x, int y, size_t count)
+		{
+			const ImVec2 cellMin = toScreen(ImVec2(float(x), float(y)) * CanvasGrid::cellSize);
+			const int alpha = int(std::min<size_t>(40 + 30 * count, 220));
+			drawList->AddRectFilled(cellMin, cellMin + ImVec2(cellSize, cellSize), ImColor(150, 150, 150, alpha));
+		});
+	}
+
+	void updateLinkBounds(const nodegraph::Graph& graph, nodegraph::link_idx link)
+	{
+		const nodegraph::port_idx srcPort = graph.links.srcPort[link];
+		const nodegraph::port_idx dstPort = graph.links.dstPort[link];
+
+		if (srcPort == nodegraph::invalid_port_idx) {
+			linkGrid.remove(link);
+			return;
+		}
+
+		// The curve stays within the hull of its control points
+		const BezierCurve c = getNodeLinkCurve(getPortCanvasPos(graph, srcPort), getPortCanvasPos(graph, dstPort));
+		const ImVec2 pad(NodeSlotRadius, NodeSlotRadius);
+		const ImVec2 min(std::min(std::min(c.pos0.x, c.cp0.x), std::min(c.cp1.x, c.pos1.x)), std::min(std::min(c.pos0.y, c.cp0.y), std::min(c.cp1.y, c.pos1.y)));
+		const ImVec2 max(std::max(std::max(c.pos0.x, c.cp0.x), std::max(c.cp1.x, c.pos1.x)), std::max(std::max(c.pos0.y, c.cp0.y), std::max(c.cp1.y, c.pos1.y)));
+		linkGrid.set(link, min - pad, max + pad);
+	}
+
+	void reindexNode(const nodegraph::Graph& graph, INodeGraphGuiGlue& glue, nodegraph::node_idx nodeIdx)
+	{
+		NodeState& node = nodes[nodeIdx];
+		node.indexedPos = node.Pos;
+		node.indexedSize = node.Size;
+		nodeGrid.set(nodeIdx, node.Pos, node.Pos + node.Size);
+
+		glue.updateNodePosition(nodegraph::node_handle(nodeIdx, graph.nodes.fingerprint[nodeIdx]), node.Pos.x, node.Pos.y);
+		updateIncidentLinkBounds(graph, nodeIdx);
+	}
+
+	void updateIncidentLinkBounds(const nodegraph::Graph& graph, nodegraph::node_idx nodeIdx)
+	{
+		for (const nodegraph::port_idx port : graph.getInputPorts(nodeIdx)) {
+			if (graph.ports.link[port] != nodegraph::invalid_link_idx) {
+				updateLinkBounds(graph, graph.ports.link[port]);
+			}
+		}
+
+		for (const nodegraph::port_idx port : graph.getOutputPorts(nodeIdx)) {
+			for (const nodegraph::link_idx link : graph.getOutputLinks(port)) {
+				updateLinkBounds(graph, link);
+			}
+		}
+	}
+
+	// Catches up with the changes to the graph since the last sync
+	void syncWithGraph(const nodegraph::Graph& graph)
+	{
+		typedef nodegraph::Graph::ChangeType ChangeType;
 
-					ImVec2 p1 = getPortPos(link.srcPort);
-					ImVec2 p2 = getPortPos(link.dstPort);
+		nodes.resize(graph.nodes.size());
+		ports.resize(graph.ports.size());
+		linkGeometry.resize(graph.links.size());
 
-					const auto p1info = glue.getPortInfo(graph.portHandle(link.srcPort));
-					const auto p2info = glue.getPortInfo(graph.portHandle(link.dstPort));
+		const bool caughtUp = graph.iterChangesSince(syncedGeneration, [&](const nodegraph::Graph::Change& change)
+		{
+			switch (change.type) {
+			case ChangeType::NodeAdded:
+				nodes[change.idx] = NodeState();
+				nodesToPlace.push_back(change.idx);
+				break;
+			case ChangeType::NodeRemoved:
+				nodeGrid.remove(change.idx);
+				break;
+			case ChangeType::LinkAdded:
+				updateLinkBounds(graph, change.idx);
+				break;
+			case ChangeType::LinkRemoved:
+				updateLinkBounds(graph, change.idx);
+				linkGeometry[change.idx].mesh.clear();
+				break;
+			default:
+				break;
+			}
+		});
 
-					BezierCurve curve = getNodeLinkCurve(p1, p2);
-					float f = curve.distanceToPoint(ImGui::GetMousePos());
+		if (!caughtUp) {
+			nodeGrid.clear();
+			linkGrid.clear();
+			nodesToPlace.clear();
 
-					ImColor linkColor = ImColor(200, 200, 100, 128);
+			for (size_t i = 0; i < graph.nodes.size(); ++i) {
+				const nodegraph::node_idx nodeIdx = nodegraph::node_idx(i);
+				if (graph.nodes.livePos[nodeIdx] == nodegraph::invalid_node_idx) {
+					nodes[nodeIdx] = NodeState();
+				}
+				else if (0 == nodes[nodeIdx].Size.x) {
+					nodesToPlace.push_back(nodeIdx);
+				}
+				else {
+					nodeGrid.set(nodeIdx, nodes[nodeIdx].Pos, nodes[nodeIdx].Pos + nodes[nodeIdx].Size);
+				}
+			}
+
+			for (size_t i = 0; i < graph.links.size(); ++i) {
+				updateLinkBounds(graph, nodegraph::link_idx(i));
+			}
+		}
 
-					if (!p1info.valid || !p2info.valid) {
-						linkColor = ImColor(255, 32, 8, 255);
+		syncedGeneration = graph.generation;
+	}
+
+	void findVisibleNodes(const nodegraph::Graph& graph, const ImVec2& visibleMin, const ImVec2& visibleMax)
+	{
+		visibleNodes.clear();
+
+		// New nodes need laying out in full to find their size, even in the overview. That is spread
+		// over frames, the ones on screen first, so that loading a big graph doesn't emit all of it at once.
+		for (int onScreenPass = 1; onScreenPass >= 0 && visibleNodes.size() < maxPlacementsPerFrame; --onScreenPass) {
+			for (const nodegraph::node_idx nodeIdx : nodesToPlace) {
+				const ImVec2& pos = nodes[nodeIdx].Pos;
+				const bool onScreen = pos.x >= visibleMin.x && pos.y >= visibleMin.y && pos.x <= visibleMax.x && pos.y <= visibleMax.y;
+
+				if (onScreen == (onScreenPass != 0)) {
+					visibleNodes.push_back(nodeIdx);
+					if (visibleNodes.size() >= maxPlacementsPerFrame) {
+						break;
 					}
-					drawNodeLink(drawList, curve, linkColor);
 				}
-			});
+			}
+		}
+
+		if (getDetailLevel() == DetailLevel_Overview) {
+			return;
+		}
+
+		nodeGrid.query(visibleMin, visibleMax, [&](u32 nodeIdx) {
+			visibleNodes.push_back(nodeIdx);
 		});
+
+		// The selected node might be mid-drag
+		if (nodeSelected.valid() && graph.nodes.fingerprint[nodeSelected.idx] == nodeSelected.fingerprint) {
+			visibleNodes.push_back(nodeSelected.idx);
+		}
+
+		// Keep the stacking order stable regardless of where the grid found them
+		std::sort(visibleNodes.begin(), visibleNodes.end(), [&](nodegraph::node_idx a, nodegraph::node_idx b) {
+			return graph.nodes.livePos[a] < graph.nodes.livePos[b];
+		});
+		visibleNodes.erase(std::unique(visibleNodes.begin(), visibleNodes.end()), visibleNodes.end());
+
+		while (!visibleNodes.empty() && graph.nodes.livePos[visibleNodes.back()] == nodegraph::invalid_node_idx) {
+			visibleNodes.pop_back();
+		}
 	}
 
 	void drawGrid(ImDrawList* const drawList, const ImVec2& offset)
 	{
 		const ImU32 GridColor = ImColor(255, 255, 255, 10);
-		const float GridSize = 32.0f;
-		ImVec2 winPos = ImGui::GetCursorScreenPos();
+		ImVec2 winPos = this->originOffset;
 		ImVec2 canvasSize = ImGui::GetWindowSize();
-		for (float x = fmodf(offset.x, GridSize); x < canvasSize.x; x += GridSize)
-			drawList->AddLine(ImVec2(x, 0.0f) + winPos, ImVec2(x, canvasSize.y) + winPos, GridColor);
-		for (float y = fmodf(offset.y, GridSize); y < canvasSize.y; y += GridSize)
-			drawList->AddLine(ImVec2(0.0f, y) + winPos, ImVec2(canvasSize.x, y) + winPos, GridColor);
+
+		// Coarser when zoomed out, so that the lines don't merge into a fill
+		float GridSize = 32.0f * zoom;
+		while (GridSize < 16.0f) {
+			GridSize *= 4.0f;
+		}
+
+		// Recorded with a cell of slack around the canvas, so that shifting it by up to a cell either
+		// way for scrolling still covers all of it
+		if (gridMesh.epoch != geometryEpoch || gridMeshSize != canvasSize || gridMeshSpacing != GridSize) {
+			gridMeshSize = canvasSize;
+			gridMeshSpacing = GridSize;
+			gridMesh.record(geometryEpoch, [&](ImDrawList* const lines)
+			{
+				for (float x = -GridSize; x < canvasSize.x + GridSize; x += GridSize)
+					lines->AddLine(ImVec2(x, -GridSize), ImVec2(x, canvasSize.y + GridSize), GridColor);
+				for (float y = -GridSize; y < canvasSize.y + GridSize; y += GridSize)
+					lines->AddLine(ImVec2(-GridSize, y), ImVec2(canvasSize.x + GridSize, y), GridColor);
+			});
+		}
+
+		gridMesh.replay(drawList, winPos + ImVec2(fmodf(offset.x, GridSize), fmodf(offset.y, GridSize)));
+	}
+
+	// Zooms with the mouse wheel, keeping the canvas point under the mouse in place
+	void updateZoom()
+	{
+		const ImGuiIO& io = ImGui::GetIO();
+		if (!ImGui::IsWindowHovered() || 0.0f == io.MouseWheel) {
+			return;
+		}
+
+		const float newZoom = std::max(minZoom, std::min(maxZoom, zoom * powf(1.2f, io.MouseWheel)));
+		const ImVec2 mouseCanvasPos = (io.MousePos - (originOffset - scrolling)) * (1.0f / zoom);
+
+		scrolling = originOffset - (io.MousePos - mouseCanvasPos * newZoom);
+		zoom = newZoom;
+	}
+
+	void updateMinimapMesh()
+	{
+		if (minimapMesh.epoch == geometryEpoch && minimapGridVersion == nodeGrid.version) {
+			return;
+		}
+
+		minimapGridVersion = nodeGrid.version;
+		minimapEmpty = nodeGrid.cells.empty();
+
+		if (minimapEmpty) {
+			minimapMesh.clear();
+			return;
+		}
+
+		int minX = INT_MAX, minY = INT_MAX;
+		int maxX = INT_MIN, maxY = INT_MIN;
+		for (const auto& cell : nodeGrid.cells) {
+			const int x = CanvasGrid::cellKeyX(cell.first), y = CanvasGrid::cellKeyY(cell.first);
+			minX = std::min(minX, x);
+			minY = std::min(minY, y);
+			maxX = std::max(maxX, x);
+			maxY = std::max(maxY, y);
+		}
+
+		const ImVec2 extent = ImVec2(float(maxX - minX + 1), float(maxY - minY + 1)) * CanvasGrid::cellSize;
+		minimapBoundsMin = ImVec2(float(minX), float(minY)) * CanvasGrid::cellSize;
+		minimapScale = std::min(minimapSize.x / extent.x, minimapSize.y / extent.y);
+		minimapContentOffset = (minimapSize - extent * minimapScale) * 0.5f;
+
+		// Cells are merged into bins of a few pixels, so that the mesh stays small for huge graphs
+		const float binSize = std::max(CanvasGrid::cellSize * minimapScale, 3.0f);
+		const int binsX = int(ceilf(minimapSize.x / binSize)) + 1;
+		const int binsY = int(ceilf(minimapSize.y / binSize)) + 1;
+		std::vector<u32> binCounts(binsX * binsY, 0);
+
+		for (const auto& cell : nodeGrid.cells) {
+			const ImVec2 cellPos = (ImVec2(float(CanvasGrid::cellKeyX(cell.first)), float(CanvasGrid::cellKeyY(cell.first))) * CanvasGrid::cellSize - minimapBoundsMin) * minimapScale;
+			const int bx = std::min(int(cellPos.x / binSize), binsX - 1);
+			const int by = std::min(int(cellPos.y / binSize), binsY - 1);
+			binCounts[by * binsX + bx] += u32(cell.second.size());
+		}
+
+		minimapMesh.record(geometryEpoch, [&](ImDrawList* const bins)
+		{
+			for (int by = 0; by < binsY; ++by) {
+				for (int bx = 0; bx < binsX; ++bx) {
+					const u32 count = binCounts[by * binsX + bx];
+					if (count > 0) {
+						const ImVec2 binMin = ImVec2(float(bx), float(by)) * binSize;
+						const int alpha = int(std::min<u32>(80 + 30 * count, 255));
+						bins->AddRectFilled(binMin, binMin + ImVec2(binSize, binSize), ImColor(170, 170, 170, alpha));
+					}
+				}
+			}
+		});
+	}
+
+	// Clicking or dragging on the minimap centers the view on that point
+	void updateMinimapInput()
+	{
+		updateMinimapMesh();
+		if (minimapEmpty) {
+			return;
+		}
+
+		minimapPos = ImGui::GetWindowPos() + ImGui::GetWindowSize() - minimapSize - ImVec2(minimapMargin, minimapMargin);
+
+		// Emitted before the nodes, so that it takes the hover over the ones underneath
+		ImGui::SetCursorScreenPos(minimapPos);
+		ImGui::InvisibleButton("minimap", minimapSize);
+
+		if (ImGui::IsItemActive() && ImGui::IsMouseDown(0)) {
+			const ImVec2 target = minimapBoundsMin + (ImGui::GetIO().MousePos - minimapPos - minimapContentOffset) * (1.0f / minimapScale);
+			const ImVec2 windowCenter = ImGui::GetWindowPos() + ImGui::GetWindowSize() * 0.5f;
+			scrolling = originOffset - (windowCenter - target * zoom);
+		}
+	}
+
+	void drawMinimap(ImDrawList* const drawList, const ImVec2& visibleMin, const ImVec2& visibleMax)
+	{
+		if (minimapEmpty) {
+			return;
+		}
+
+		drawList->ChannelsSetCurrent(2); // Foreground
+
+		const ImVec2 minimapMax = minimapPos + minimapSize;
+		drawList->AddRectFilled(minimapPos, minimapMax, ImColor(25, 25, 25, 220));
+		minimapMesh.replay(drawList, minimapPos + minimapContentOffset);
+
+		const ImVec2 viewMin = minimapPos + minimapContentOffset + (visibleMin - minimapBoundsMin) * minimapScale;
+		const ImVec2 viewMax = minimapPos + minimapContentOffset + (visibleMax - minimapBoundsMin) * minimapScale;
+		drawList->PushClipRect(minimapPos, minimapMax, true);
+		drawList->AddRect(viewMin, viewMax, ImColor(255, 255, 255, 160));
+		drawList->PopClipRect();
+
+		drawList->AddRect(minimapPos, minimapMax, ImColor(255, 255, 255, 40));
 	}
 
 	void doGui(nodegraph::Graph& graph, INodeGraphGuiGlue& glue)
@@ -620,42 +1320,79 @@ struct NodeGraphState
 		openContextMenu = false;
 		nodeHoveredInScene = nodegraph::node_handle();
 
-		nodes.resize(graph.nodes.size());
-		ports.resize(graph.ports.size());
+		syncWithGraph(graph);
+		updateGeometryEpoch();
 
 		// TODO: spawning of multiple nodes with offsets
-		graph.iterNodes([&](nodegraph::node_handle nodeHandle)
-		{
-			if (nodes[nodeHandle.idx].Size.x == 0) {
-				ImVec2 spawnPos;
+		for (const nodegraph::node_idx nodeIdx : nodesToPlace) {
+			if (graph.nodes.livePos[nodeIdx] == nodegraph::invalid_node_idx || nodes[nodeIdx].Size.x != 0) {
+				continue;
+			}
 
-				float desiredX, desiredY;
-				if (glue.getNodeDesiredPosition(nodeHandle, &desiredX, &desiredY)) {
-					spawnPos = scrolling - this->originOffset + ImVec2(desiredX, desiredY);
-				}
-				else {
-					spawnPos = ImGui::GetIO().MousePos + scrolling - this->originOffset;
-				}
+			const nodegraph::node_handle nodeHandle(nodeIdx, graph.nodes.fingerprint[nodeIdx]);
+			ImVec2 spawnPos;
 
-				nodes[nodeHandle.idx].Pos = spawnPos;
+			float desiredX, desiredY;
+			if (glue.getNodeDesiredPosition(nodeHandle, &desiredX, &desiredY)) {
+				// Same space as updateNodePosition reports, so saved layouts load back regardless of the view
+				spawnPos = ImVec2(desiredX, desiredY);
+			}
+			else {
+				spawnPos = (ImGui::GetIO().MousePos + scrolling - this->originOffset) * (1.0f / zoom);
 			}
 
-			glue.updateNodePosition(nodeHandle, nodes[nodeHandle.idx].Pos.x, nodes[nodeHandle.idx].Pos.y);
-		});
+			// Links get indexed before their new nodes are placed
+			if (nodes[nodeIdx].Pos != spawnPos) {
+				nodes[nodeIdx].Pos = spawnPos;
+				updateIncidentLinkBounds(graph, nodeIdx);
+			}
+		}
 
 		ImGui::BeginGroup();
 		ImGui::PushItemWidth(120.0f);
 
 		this->originOffset = ImGui::GetCursorScreenPos();
+		updateZoom();
+		updateMinimapInput();
+
 		ImVec2 offset = this->originOffset - scrolling;
+		canvasOffset = offset;
 		ImDrawList* drawList = ImGui::GetWindowDrawList();
 
+		// Only what overlaps the window gets laid out and drawn
+		const ImVec2 cullMargin(16.0f, 16.0f);
+		const ImVec2 visibleMin = toCanvas(ImGui::GetWindowPos() - cullMargin);
+		const ImVec2 visibleMax = toCanvas(ImGui::GetWindowPos() + ImGui::GetWindowSize() + cullMargin);
+		findVisibleNodes(graph, visibleMin, visibleMax);
+
 		drawList->ChannelsSplit(3);
 		{
 			drawGrid(drawList, offset);
-			drawNodes(graph, glue, drawList, offset);
-			updateDragging(graph, glue, drawList, scrolling);
-			drawLinks(graph, glue, drawList, offset);
+
+			movedNodes.clear();
+			drawNodes(graph, glue, drawList);
+
+			nodesToPlace.erase(std::remove_if(nodesToPlace.begin(), nodesToPlace.end(), [&](nodegraph::node_idx nodeIdx) {
+				return graph.nodes.livePos[nodeIdx] == nodegraph::invalid_node_idx || nodes[nodeIdx].Size.x != 0;
+			}), nodesToPlace.end());
+
+			for (const nodegraph::node_idx nodeIdx : movedNodes) {
+				reindexNode(graph, glue, nodeIdx);
+			}
+
+			updateDragging(graph, glue, drawList);
+
+			// Pick up the links added or removed by the dragging
+			syncWithGraph(graph);
+
+			if (getDetailLevel() == DetailLevel_Overview) {
+				drawOverview(drawList, visibleMin, visibleMax);
+			}
+			else {
+				drawLinks(graph, glue, drawList, visibleMin, visibleMax);
+			}
+
+			drawMinimap(drawList, toCanvas(ImGui::GetWindowPos()), toCanvas(ImGui::GetWindowPos() + ImGui::GetWindowSize()));
 		}
 		drawList->ChannelsMerge();
 
@@ -6,6 +6,8 @@
 
 struct INodeGraphGuiGlue {
 	virtual std::string getNodeName(nodegraph::node_handle) const = 0;
+
+	// Node positions are in canvas space, independent of the scrolling and zoom of the view
 	virtual bool getNodeDesiredPosition(nodegraph::node_handle, float *const x, float *const y) const = 0;
 
 	struct PortInfo {
@@ -0,0 +1,38 @@
+#include "ProfilerHistory.h"
+
+#include <algorithm>
+
+namespace ProfilerHistory {
+	void pushSample(vector<float>& history, float ms)
+	{
+		if (history.size() >= historyLength) {
+			history.erase(history.begin());
+		}
+
+		history.push_back(ms);
+	}
+
+	Stats calculateStats(const vector<float>& history)
+	{
+		Stats stats;
+		if (history.empty()) {
+			return stats;
+		}
+
+		vector<float> sorted = history;
+		std::sort(sorted.begin(), sorted.end());
+
+		float sum = 0;
+		for (float ms : sorted) {
+			sum += ms;
+		}
+
+		stats.lastMs = history.back();
+		stats.meanMs = sum / sorted.size();
+		stats.p50Ms = sorted[(sorted.size() - 1) / 2];
+		stats.p95Ms = sorted[(sorted.size() - 1) * 95 / 100];
+		stats.maxMs = sorted.back();
+
+		return stats;
+	}
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "Common.h"
+
+// Rolling histories of timings in milliseconds, shared by FrameProfiler and ReloadProfiler
+namespace ProfilerHistory {
+	const size_t historyLength = 128;
+
+	// Appends a sample, dropping the oldest one once the history is full
+	void pushSample(vector<float>& history, float ms);
+
+	struct Stats {
+		float lastMs = 0;
+		float meanMs = 0;
+		float p50Ms = 0;
+		float p95Ms = 0;
+		float maxMs = 0;
+	};
+
+	Stats calculateStats(const vector<float>& history);
+}
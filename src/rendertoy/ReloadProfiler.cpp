@@ -0,0 +1,161 @@
+#include "ReloadProfiler.h"
+
+#include <rapidjson/prettywriter.h>
+#include <rapidjson/stringbuffer.h>
+#include <unordered_map>
+#include <fstream>
+
+namespace ReloadProfiler {
+	using ProfilerHistory::pushSample;
+
+	const size_t stageCount = size_t(Stage::Count);
+
+	struct Reload {
+		Clock::time_point times[stageCount];
+		bool marked[stageCount] = {};
+	};
+
+	std::unordered_map<const void*, Reload> reloadsInFlight;
+	vector<float> stageHistory[stageCount];
+	vector<float> totalHistory;
+
+	const char* getStageName(Stage stage)
+	{
+		static const char* const names[] = {
+			"Detect",
+			"Dispatch",
+			"Preprocess",
+			"Compile",
+			"Reflect",
+			"Graph update",
+			"Package compile",
+			"First dispatch",
+			"Swap",
+		};
+		static_assert(sizeof(names) / sizeof(names[0]) == stageCount, "Stage names out of sync with the enum");
+
+		return names[size_t(stage)];
+	}
+
+	void begin(const void* shader, Clock::time_point detectedTime, Clock::time_point dispatchTime)
+	{
+		// A newer change supersedes a reload which hasn't made it to the screen yet
+		Reload& reload = reloadsInFlight[shader];
+		reload = Reload();
+
+		reload.times[size_t(Stage::Detect)] = detectedTime;
+		reload.marked[size_t(Stage::Detect)] = true;
+		reload.times[size_t(Stage::Dispatch)] = dispatchTime;
+		reload.marked[size_t(Stage::Dispatch)] = true;
+	}
+
+	void mark(const void* shader, Stage stage)
+	{
+		auto found = reloadsInFlight.find(shader);
+		if (found != reloadsInFlight.end() && !found->second.marked[size_t(stage)]) {
+			found->second.times[size_t(stage)] = Clock::now();
+			found->second.marked[size_t(stage)] = true;
+		}
+	}
+
+	void cancel(const void* shader)
+	{
+		reloadsInFlight.erase(shader);
+	}
+
+	static float toMs(Clock::duration d)
+	{
+		return std::chrono::duration<float, std::milli>(d).count();
+	}
+
+	void frameSwapped()
+	{
+		const Clock::time_point now = Clock::now();
+
+		for (auto it = reloadsInFlight.begin(); it != reloadsInFlight.end(); ) {
+			Reload& reload = it->second;
+
+			if (!reload.marked[size_t(Stage::FirstDispatch)]) {
+				++it;
+				continue;
+			}
+
+			reload.times[size_t(Stage::Swap)] = now;
+			reload.marked[size_t(Stage::Swap)] = true;
+
+			for (size_t i = 1; i < stageCount; ++i) {
+				if (!reload.marked[i]) {
+					reload.times[i] = reload.times[i - 1];
+				}
+
+				pushSample(stageHistory[i], toMs(reload.times[i] - reload.times[i - 1]));
+			}
+
+			pushSample(totalHistory, toMs(now - reload.times[size_t(Stage::Detect)]));
+			it = reloadsInFlight.erase(it);
+		}
+	}
+
+	const vector<float>& getStageHistory(Stage stage)
+	{
+		return stageHistory[size_t(stage)];
+	}
+
+	const vector<float>& getTotalHistory()
+	{
+		return totalHistory;
+	}
+
+	template <typename Writer>
+	static void writeSeries(Writer& writer, const char* name, const vector<float>& history)
+	{
+		const ProfilerHistory::Stats stats = ProfilerHistory::calculateStats(history);
+
+		writer.StartObject();
+		writer.String("name");
+		writer.String(name);
+		writer.String("meanMs");
+		writer.Double(stats.meanMs);
+		writer.String("p50Ms");
+		writer.Double(stats.p50Ms);
+		writer.String("p95Ms");
+		writer.Double(stats.p95Ms);
+		writer.String("maxMs");
+		writer.Double(stats.maxMs);
+
+		writer.String("samplesMs");
+		writer.StartArray();
+		for (float ms : history) {
+			writer.Double(ms);
+		}
+		writer.EndArray();
+
+		writer.EndObject();
+	}
+
+	bool exportJson(const char* path)
+	{
+		rapidjson::StringBuffer sb;
+		rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(sb);
+
+		writer.StartObject();
+		writer.String("reloadCount");
+		writer.Uint(unsigned(totalHistory.size()));
+
+		writer.String("total");
+		writeSeries(writer, "Total", totalHistory);
+
+		writer.String("stages");
+		writer.StartArray();
+		for (size_t i = 1; i < stageCount; ++i) {
+			writeSeries(writer, getStageName(Stage(i)), stageHistory[i]);
+		}
+		writer.EndArray();
+
+		writer.EndObject();
+
+		std::ofstream file(path);
+		file.write(sb.GetString(), sb.GetSize());
+		return bool(file);
+	}
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "Common.h"
+#include "ProfilerHistory.h"
+
+#include <chrono>
+
+// Follows shader hot-reloads from the file watcher noticing a change until the first frame
+// which uses the new program is presented, and keeps a rolling history of each stage.
+// Reloads are keyed by the shader being reloaded, so the stages can be marked from wherever
+// they happen; marks for shaders without a reload in flight are ignored.
+namespace ReloadProfiler {
+	typedef std::chrono::steady_clock Clock;
+
+	enum class Stage : u8 {
+		Detect,			// the watcher thread noticed the change
+		Dispatch,		// FileWatcher::update invoked the callback
+		Preprocess,		// the source was loaded, hashed and parsed
+		Compile,		// the program was compiled and linked
+		Reflect,		// the params were reflected
+		GraphUpdate,	// passes picked up the new params
+		PackageCompile,	// the package was compiled with the new program
+		FirstDispatch,	// the new program was dispatched
+		Swap,			// the frame was presented
+		Count
+	};
+
+	const char* getStageName(Stage stage);
+
+	void begin(const void* shader, Clock::time_point detectedTime, Clock::time_point dispatchTime);
+	void mark(const void* shader, Stage stage);
+	void cancel(const void* shader);
+
+	// Completes the reloads whose first dispatch has happened. Call right after presenting a frame.
+	void frameSwapped();
+
+	// Milliseconds spent in each stage by the most recent reloads, oldest first. A stage's time is
+	// measured from the end of the previous one; stages which didn't happen (e.g. compilation on a
+	// program cache hit) take zero time.
+	const vector<float>& getStageHistory(Stage stage);
+	const vector<float>& getTotalHistory();
+
+	bool exportJson(const char* path);
+}
@@ -2,8 +2,18 @@
 #include "Shader.h"
 #include "StringUtil.h"
 #include "FileUtil.h"
+#include "ShaderCache.h"
+#include "ReloadProfiler.h"
 #include <glad/glad.h>
 #include <fstream>
+#include <cctype>
+#include <stdio.h>
+
+static void addShaderPrologue(vector<char> *const source)
+{
+	std::string prefix = "#version 440\n#line 0\n";
+	source->insert(source->begin(), prefix.begin(), prefix.end());
+}
 
 vector<char> loadShaderSource(const std::string& path, const char* preprocessorOptions)
 {
@@ -18,9 +28,74 @@ vector<char> loadShaderSource(const std::string& path, const char* preprocessorO
 	std::vector<char> result = loadTextFileZ(preprocessedFile.c_str());*/
 
 	std::vector<char> result = loadTextFileZ(path.c_str());
-	std::string prefix = "#version 440\n#line 0\n";
+	addShaderPrologue(&result);
+	return result;
+}
+
+// Driver logs come in a few flavors:
+//   ERROR: 0:12: message					(AMD, Intel)
+//   0(12) : error C1008: message			(NVIDIA)
+//   0:12(5): error: message				(Mesa)
+// Returns the length of the location prefix, or 0 if the line doesn't have one
+static int parseErrorLocation(const char* str, int *const line, int *const column)
+{
+	int sourceIdx = 0, consumed = 0;
+
+	if (sscanf(str, "ERROR: %d:%d: %n", &sourceIdx, line, &consumed) == 2 && consumed > 0) {
+		return consumed;
+	}
+
+	if (sscanf(str, "WARNING: %d:%d: %n", &sourceIdx, line, &consumed) == 2 && consumed > 0) {
+		return consumed;
+	}
+
+	if (sscanf(str, "%d(%d) : %n", &sourceIdx, line, &consumed) == 2 && consumed > 0) {
+		return consumed;
+	}
+
+	if (sscanf(str, "%d:%d(%d): %n", &sourceIdx, line, column, &consumed) == 3 && consumed > 0) {
+		return consumed;
+	}
+
+	return 0;
+}
+
+// Lines without a location (e.g. link errors) are kept with line 0
+vector<ShaderCompileError> parseCompileErrors(const std::string& log, const std::string& file)
+{
+	vector<ShaderCompileError> result;
+
+	size_t lineStart = 0;
+	while (lineStart < log.size()) {
+		size_t lineEnd = log.find('\n', lineStart);
+		if (std::string::npos == lineEnd) {
+			lineEnd = log.size();
+		}
+
+		std::string text = log.substr(lineStart, lineEnd - lineStart);
+		lineStart = lineEnd + 1;
+
+		while (!text.empty() && isspace(u8(text.back()))) {
+			text.pop_back();
+		}
+
+		if (text.empty()) {
+			continue;
+		}
+
+		ShaderCompileError error;
+		error.file = file;
+
+		const int consumed = parseErrorLocation(text.c_str(), &error.line, &error.column);
+		if (0 == consumed) {
+			error.line = 0;
+			error.column = 1;
+		}
+
+		error.message = text.substr(consumed);
+		result.push_back(std::move(error));
+	}
 
-	result.insert(result.begin(), prefix.begin(), prefix.end());
 	return result;
 }
 
@@ -28,36 +103,39 @@ ShaderParamValue ShaderParamRefl::defaultValue() const
 {
 	ShaderParamValue res;
 
+	const bool hasDefault = annotation.has(ParamAnnotation::Flag_Default);
+	const float defaultFloat = hasDefault ? annotation.defaultFloat : (annotation.has(ParamAnnotation::Flag_Color) ? 1.0f : 0.0f);
+
 	if (ShaderParamType::Float == type) {
-		res.floatValue = annotation.get("default", 0.0f);
+		res.floatValue = defaultFloat;
 	}
 	else if (ShaderParamType::Float2 == type) {
-		res.float2Value = vec2(annotation.get("default", 0.0f));
+		res.float2Value = vec2(defaultFloat);
 	}
 	else if (ShaderParamType::Float3 == type) {
-		res.float3Value = vec3(annotation.get("default", annotation.has("color") ? 1.0f : 0.0f));
+		res.float3Value = vec3(defaultFloat);
 	}
 	else if (ShaderParamType::Float4 == type) {
-		res.float4Value = vec4(annotation.get("default", annotation.has("color") ? 1.0f : 0.0f));
+		res.float4Value = vec4(defaultFloat);
 	}
 	else if (ShaderParamType::Int == type) {
-		res.intValue = annotation.get("default", 0);
+		res.intValue = annotation.defaultInt;
 	}
 	else if (ShaderParamType::Int2 == type) {
-		res.int2Value = ivec2(annotation.get("default", 0));
+		res.int2Value = ivec2(annotation.defaultInt);
 	}
 	else if (ShaderParamType::Int3 == type) {
-		res.int3Value = ivec3(annotation.get("default", 0));
+		res.int3Value = ivec3(annotation.defaultInt);
 	}
 	else if (ShaderParamType::Int4 == type) {
-		res.int4Value = ivec4(annotation.get("default", 0));
+		res.int4Value = ivec4(annotation.defaultInt);
 	}
 	else if (ShaderParamType::Sampler2d == type) {
-		if (annotation.has("input")) {
+		if (annotation.has(ParamAnnotation::Flag_Input)) {
 			res.textureValue.source = TextureDesc::Source::Input;
 		}
-		else if (annotation.has("default")) {
-			res.textureValue.path = annotation.get("default", "");
+		else if (hasDefault) {
+			res.textureValue.path = annotation.defaultPath;
 			res.textureValue.source = TextureDesc::Source::Load;
 		}
 		else {
@@ -65,26 +143,27 @@ ShaderParamValue ShaderParamRefl::defaultValue() const
 		}
 	}
 	else if (ShaderParamType::Image2d == type) {
-		if (annotation.has("input")) {
+		if (annotation.has(ParamAnnotation::Flag_Input)) {
 			res.textureValue.source = TextureDesc::Source::Input;
 		}
-		else if (annotation.has("default")) {
-			res.textureValue.path = annotation.get("default", "");
+		else if (hasDefault) {
+			res.textureValue.path = annotation.defaultPath;
 			res.textureValue.source = TextureDesc::Source::Load;
 		}
 		else {
 			res.textureValue.source = TextureDesc::Source::Create;
 
-			if (annotation.has("relativeTo")) {
-				res.textureValue.scaleRelativeTo = annotation.get("relativeTo", "");
+			if (annotation.has(ParamAnnotation::Flag_RelativeTo)) {
+				res.textureValue.scaleRelativeTo = annotation.relativeTo;
+				res.textureValue.scaleRelativeToIdx = annotation.relativeToIdx;
 				res.textureValue.useRelativeScale = true;
 
-				if (annotation.has("scale")) {
-					sscanf(annotation.get("scale", ""), "%f %f", &res.textureValue.relativeScale.x, &res.textureValue.relativeScale.y);
+				if (annotation.has(ParamAnnotation::Flag_Scale)) {
+					res.textureValue.relativeScale = annotation.scale;
 				}
 			}
-			else if (annotation.has("size")) {
-				sscanf(annotation.get("size", ""), "%u %u", &res.textureValue.resolution.x, &res.textureValue.resolution.y);
+			else if (annotation.has(ParamAnnotation::Flag_Size)) {
+				res.textureValue.resolution = annotation.size;
 				res.textureValue.useRelativeScale = false;
 			}
 		}
@@ -133,6 +212,68 @@ static bool parseParenthesizedExpression(const char*& c, const char* aend)
 	return false;
 }
 
+static bool isAnnotationKey(const char* kbegin, const char* kend, const char* key)
+{
+	const size_t len = strlen(key);
+	return size_t(kend - kbegin) == len && 0 == memcmp(kbegin, key, len);
+}
+
+// Values are always followed by the closing parenthesis, so strtof/strtol can't run past them
+static void applyAnnotationItem(const char* kbegin, const char* kend, const char* vbegin, const char* vend, ParamAnnotation *const annot)
+{
+	typedef ParamAnnotation A;
+
+	// Keys without a value parse as zero
+	if (vbegin == vend) {
+		vbegin = vend = "";
+	}
+
+	if (isAnnotationKey(kbegin, kend, "min")) {
+		annot->flags |= A::Flag_Min;
+		annot->minFloat = strtof(vbegin, nullptr);
+		annot->minInt = int(strtol(vbegin, nullptr, 10));
+	}
+	else if (isAnnotationKey(kbegin, kend, "max")) {
+		annot->flags |= A::Flag_Max;
+		annot->maxFloat = strtof(vbegin, nullptr);
+		annot->maxInt = int(strtol(vbegin, nullptr, 10));
+	}
+	else if (isAnnotationKey(kbegin, kend, "default")) {
+		annot->flags |= A::Flag_Default;
+		annot->defaultFloat = strtof(vbegin, nullptr);
+		annot->defaultInt = int(strtol(vbegin, nullptr, 10));
+		annot->defaultPath.assign(vbegin, vend);
+	}
+	else if (isAnnotationKey(kbegin, kend, "color")) {
+		annot->flags |= A::Flag_Color;
+	}
+	else if (isAnnotationKey(kbegin, kend, "input")) {
+		annot->flags |= A::Flag_Input;
+	}
+	else if (isAnnotationKey(kbegin, kend, "time")) {
+		annot->flags |= A::Flag_Time;
+	}
+	else if (isAnnotationKey(kbegin, kend, "relativeTo")) {
+		annot->flags |= A::Flag_RelativeTo;
+		annot->relativeTo.assign(vbegin, vend);
+	}
+	else if (isAnnotationKey(kbegin, kend, "scale")) {
+		char* next = nullptr;
+		annot->flags |= A::Flag_Scale;
+		annot->scale.x = strtof(vbegin, &next);
+		annot->scale.y = strtof(next, nullptr);
+	}
+	else if (isAnnotationKey(kbegin, kend, "size")) {
+		char* next = nullptr;
+		annot->flags |= A::Flag_Size;
+		annot->size.x = int(strtol(vbegin, &next, 10));
+		annot->size.y = int(strtol(next, nullptr, 10));
+	}
+	else {
+		annot->extra[std::string(kbegin, kend)].assign(vbegin, vend);
+	}
+}
+
 static bool parseAnnotation(const char* abegin, const char* aend, ParamAnnotation *const annot)
 {
 	const char* c = abegin;
@@ -141,35 +282,37 @@ static bool parseAnnotation(const char* abegin, const char* aend, ParamAnnotatio
 		return c < aend;
 	};
 
-	while (c < aend) {
-		skipWhite();
-
-		if (isalnum(*c)) {
-			const char* tbegin = c;
-			while (isalnum(*c)) {
-				++c;
-			}
-			const char* tend = c;
+	while (skipWhite()) {
+		if (!isalnum(*c)) {
+			++c;
+			continue;
+		}
 
-			skipWhite();
+		const char* tbegin = c;
+		while (c < aend && isalnum(*c)) {
+			++c;
+		}
+		const char* tend = c;
 
-			std::string annotValue;
-			if (*c == '(')
-			{
-				const char* const exprBegin = c;
-				if (!parseParenthesizedExpression(c, aend)) {
-					return false;
-				}
+		const char* valueBegin = tend;
+		const char* valueEnd = tend;
 
-				const char* const exprEnd = c;
-				assert('(' == *exprBegin);
-				assert(')' == *exprEnd);
-				annotValue = std::string(exprBegin + 1, exprEnd);
-				++c;
+		if (skipWhite() && *c == '(')
+		{
+			const char* const exprBegin = c;
+			if (!parseParenthesizedExpression(c, aend)) {
+				return false;
 			}
 
-			annot->items[std::string(tbegin, tend)] = annotValue;
+			const char* const exprEnd = c;
+			assert('(' == *exprBegin);
+			assert(')' == *exprEnd);
+			valueBegin = exprBegin + 1;
+			valueEnd = exprEnd;
+			++c;
 		}
+
+		applyAnnotationItem(tbegin, tend, valueBegin, valueEnd, annot);
 	}
 
 	return true;
@@ -193,46 +336,112 @@ static std::string getInfoLog(
 	return result;
 }
 
-// Returns 0 on failure
-static GLuint makeShader(GLenum shaderType, const vector<char>& source, std::string *const errorLog)
+// KHR_parallel_shader_compile / ARB_parallel_shader_compile; not covered by the glad loader
+#define GL_COMPLETION_STATUS 0x91B1
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSPROC)(GLuint count);
+
+static bool g_parallelShaderCompile = false;
+
+void initParallelShaderCompile(void* (*getProcAddress)(const char*))
 {
-	GLuint handle = glCreateShader(shaderType);
-	if (!handle) {
-		*errorLog = "glCreateShader failed";
-		return 0;
+	GLint extensionCount = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+
+	const char* entryPoint = nullptr;
+	for (GLint i = 0; i < extensionCount && !entryPoint; ++i) {
+		const char* const ext = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+		if (0 == strcmp(ext, "GL_KHR_parallel_shader_compile")) {
+			entryPoint = "glMaxShaderCompilerThreadsKHR";
+		}
+		else if (0 == strcmp(ext, "GL_ARB_parallel_shader_compile")) {
+			entryPoint = "glMaxShaderCompilerThreadsARB";
+		}
 	}
 
-	GLint sourceLength = (GLint)source.size();
-	const GLchar* sources[1] = { source.data() };
-	glShaderSource(handle, 1, sources, &sourceLength);
+	if (entryPoint) {
+		auto maxShaderCompilerThreads = reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSPROC>(getProcAddress(entryPoint));
+		if (maxShaderCompilerThreads) {
+			// 0xFFFFFFFF lets the implementation pick the thread count
+			maxShaderCompilerThreads(0xFFFFFFFF);
+			g_parallelShaderCompile = true;
+		}
+	}
 
-	glCompileShader(handle);
-	{
-		GLint shader_ok;
-		glGetShaderiv(handle, GL_COMPILE_STATUS, &shader_ok);
+	printf("Parallel shader compilation: %s\n", g_parallelShaderCompile ? "supported" : "not supported");
+}
 
-		if (!shader_ok) {
-			*errorLog = getInfoLog(handle, glGetShaderiv, glGetShaderInfoLog);
-			glDeleteShader(handle);
-			return 0;
-		}
+// Doesn't wait for the compilation to finish; see checkShader. Returns 0 on failure.
+static GLuint submitShader(GLenum shaderType, const vector<char>& source)
+{
+	GLuint handle = glCreateShader(shaderType);
+	if (handle) {
+		GLint sourceLength = (GLint)source.size();
+		const GLchar* sources[1] = { source.data() };
+		glShaderSource(handle, 1, sources, &sourceLength);
+		glCompileShader(handle);
 	}
 
 	return handle;
 }
 
-static GLuint makeProgram(GLuint computeShader, std::string *const errorLog)
+// Doesn't wait for the link to finish; see checkProgram
+static GLuint submitProgram(GLuint computeShader)
 {
-	GLint program_ok;
-
 	GLuint program = glCreateProgram();
 	glAttachShader(program, computeShader);
 	glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(program);
+
+	return program;
+}
+
+// Without parallel compilation, the status queries below block until the driver is done anyway
+static bool isProgramComplete(GLuint program)
+{
+	GLint complete = GL_TRUE;
+	if (g_parallelShaderCompile) {
+		glGetProgramiv(program, GL_COMPLETION_STATUS, &complete);
+	}
+
+	return complete != GL_FALSE;
+}
+
+static bool checkShader(GLuint handle, std::string *const errorLog)
+{
+	GLint shader_ok;
+	glGetShaderiv(handle, GL_COMPILE_STATUS, &shader_ok);
+
+	if (!shader_ok) {
+		*errorLog = getInfoLog(handle, glGetShaderiv, glGetShaderInfoLog);
+	}
+
+	return shader_ok != GL_FALSE;
+}
+
+static bool checkProgram(GLuint program, std::string *const errorLog)
+{
+	GLint program_ok;
 	glGetProgramiv(program, GL_LINK_STATUS, &program_ok);
 
 	if (!program_ok) {
 		*errorLog = getInfoLog(program, glGetProgramiv, glGetProgramInfoLog);
+	}
+
+	return program_ok != GL_FALSE;
+}
+
+
+// Returns 0 on failure
+static GLuint makeProgramFromBinary(GLenum binaryFormat, const vector<u8>& binary)
+{
+	GLint program_ok;
+
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, binaryFormat, binary.data(), GLsizei(binary.size()));
+	glGetProgramiv(program, GL_LINK_STATUS, &program_ok);
+
+	if (!program_ok) {
+		// Driver update or a corrupt cache entry; the caller will compile from source
 		glDeleteProgram(program);
 		return 0;
 	}
@@ -240,8 +449,28 @@ static GLuint makeProgram(GLuint computeShader, std::string *const errorLog)
 	return program;
 }
 
+int findParamIndex(const vector<ShaderParamBindingRefl>& params, const std::string& name)
+{
+	for (size_t i = 0; i < params.size(); ++i) {
+		if (params[i].name == name) {
+			return int(i);
+		}
+	}
+
+	return -1;
+}
+
+int resolveRelativeScaleTarget(const vector<ShaderParamBindingRefl>& params, const std::string& name)
+{
+	if ("#window" == name) {
+		return TextureDesc::RelativeToWindow;
+	}
+
+	const int idx = findParamIndex(params, name);
+	return idx != -1 ? idx : TextureDesc::RelativeToNone;
+}
 
-void ComputeShader::reflectParams(const std::unordered_map<std::string, ParamAnnotation>& annotations)
+void ComputeShader::reflectParams(const vector<ParsedAnnotation>& annotations)
 {
 	GLint activeUniformCount = 0;
 	glGetProgramiv(m_programHandle, GL_ACTIVE_UNIFORMS, &activeUniformCount);
@@ -249,6 +478,9 @@ void ComputeShader::reflectParams(const std::unordered_map<std::string, ParamAnn
 
 	m_params.resize(activeUniformCount);
 
+	int imageUnit = 0;
+	int textureUnit = 0;
+
 	char name[1024];
 	for (GLint loc = 0; loc < activeUniformCount; ++loc) {
 		GLsizei nameLength = 0;
@@ -260,77 +492,153 @@ void ComputeShader::reflectParams(const std::unordered_map<std::string, ParamAnn
 		param.location = loc;
 		param.name = name;
 		param.type = parseShaderType(typeGl, size);
+		param.annotation = ParamAnnotation();
 
-		auto it = annotations.find(name);
-		if (it != annotations.end()) {
-			param.annotation = it->second;
+		if (ShaderParamType::Image2d == param.type) {
+			param.binding = imageUnit++;
+		}
+		else if (ShaderParamType::Sampler2d == param.type) {
+			param.binding = textureUnit++;
+		}
+		else {
+			param.binding = -1;
 		}
-	}
-}
 
-std::unordered_map<std::string, ParamAnnotation> ComputeShader::parseAnnotations(const vector<char>& source)
-{
-	std::unordered_map<std::string, ParamAnnotation> result;
+		for (const ParsedAnnotation& it : annotations) {
+			if (it.paramName == param.name) {
+				param.annotation = it.annotation;
+				break;
+			}
+		}
+	}
 
-	auto processLine = [&](const char* lbegin, const char* lend) {
-		while (lend > lbegin && lend[-1] == '\r') --lend;
+	for (ShaderParamBindingRefl& param : m_params) {
+		if (param.annotation.has(ParamAnnotation::Flag_RelativeTo)) {
+			param.annotation.relativeToIdx = resolveRelativeScaleTarget(m_params, param.annotation.relativeTo);
+		}
+	}
 
-		const char* tagBegin = "//@";
-		const char* tagEnd = tagBegin + strlen(tagBegin);
-		const char* annotBegin = std::search(lbegin, lend, tagBegin, tagEnd);
-		if (annotBegin == lend) return;
+	GLint workGroupSize[3];
+	glGetProgramiv(m_programHandle, GL_COMPUTE_WORK_GROUP_SIZE, workGroupSize);
+	for (int i = 0; i < 3; ++i) {
+		m_workGroupSize[i] = u32(workGroupSize[i]);
+	}
+}
 
-		const char* identEnd = annotBegin;
+vector<ComputeShader::ParsedAnnotation> ComputeShader::parseAnnotations(const vector<char>& source)
+{
+	vector<ParsedAnnotation> result;
+
+	// Single pass over the source. The last ';' on the current line is remembered, so that
+	// when an annotation tag is found, the param name can be picked up from right before it.
+	const char* c = source.data();
+	const char* const fend = source.data() + source.size();
+	const char* lbegin = c;
+	const char* lastSemicolon = nullptr;
+
+	while (c < fend) {
+		if ('\n' == *c) {
+			lbegin = ++c;
+			lastSemicolon = nullptr;
+		}
+		else if (';' == *c) {
+			lastSemicolon = c++;
+		}
+		else if ('/' == *c && fend - c >= 3 && '/' == c[1] && '@' == c[2]) {
+			// Skip the tag from the annotation
+			const char* const annotBegin = c + 3;
 
-		// Skip the tag from the annotation
-		annotBegin += tagEnd - tagBegin;
+			while (c < fend && *c != '\n') ++c;
+			const char* annotEnd = c;
+			while (annotEnd > annotBegin && ('\r' == annotEnd[-1] || '\0' == annotEnd[-1])) --annotEnd;
 
-		// Find the identifier
-		while (identEnd > lbegin && *identEnd != ';') --identEnd;
-		if (lbegin == identEnd) return;
+			if (!lastSemicolon) {
+				continue;
+			}
 
-		while (identEnd > lbegin && isspace(*identEnd)) --identEnd;
-		if (lbegin == identEnd) return;
+			// Find the identifier
+			const char* identEnd = lastSemicolon;
+			while (identEnd > lbegin && isspace(identEnd[-1])) --identEnd;
 
-		const char* identBegin = identEnd - 1;
-		while (identBegin > lbegin && (isalnum(*identBegin) || '_' == *identBegin)) --identBegin;
-		++identBegin;
+			const char* identBegin = identEnd;
+			while (identBegin > lbegin && (isalnum(identBegin[-1]) || '_' == identBegin[-1])) --identBegin;
 
-		if (identEnd - identBegin <= 0) {
-			return;
-		}
+			if (identEnd - identBegin <= 0) {
+				continue;
+			}
 
-		std::string paramName = std::string(identBegin, identEnd);
-		//auto param = std::find_if(params.begin(), params.end(), [&paramName](ShaderParam& it) { return it.name == paramName; });
-		//if (param != params.end())
-		{
-			ParamAnnotation annot;
-			if (parseAnnotation(annotBegin, lend, &annot)) {
-				result[paramName] = annot;
+			result.emplace_back();
+			if (parseAnnotation(annotBegin, annotEnd, &result.back().annotation)) {
+				result.back().paramName.assign(identBegin, identEnd);
+			}
+			else {
+				result.pop_back();
 			}
 		}
+		else {
+			++c;
+		}
+	}
 
-		//printf("Ident: '%.*s' annotation: '%.*s'\n", int(identEnd - identBegin), identBegin, int(lend - annotBegin), annotBegin);
-	};
+	return result;
+}
 
-	const char* lbegin = source.data();
-	const char *const fend = source.data() + source.size();
-	for (const char* lend = source.data(); lend != fend; ++lend) {
-		if ('\n' == *lend) {
-			processLine(lbegin, lend);
-			lbegin = lend + 1;
-		}
+void ComputeShader::releaseHandles()
+{
+	GlResources::release(m_programHandle);
+	GlResources::release(m_csHandle);
+}
+
+// Pending objects were never bound, so they can be deleted right away
+void ComputeShader::releasePending()
+{
+	if (m_pending.programHandle) {
+		glDeleteProgram(m_pending.programHandle);
+		glDeleteShader(m_pending.shaderHandle);
 	}
 
-	if (fend - lbegin > 1) {
-		processLine(lbegin, fend);
+	m_pending = PendingReload();
+}
+
+ComputeShader& ComputeShader::operator=(ComputeShader&& other)
+{
+	if (this != &other) {
+		releaseHandles();
+		releasePending();
+
+		m_params = std::move(other.m_params);
+		m_sourceFile = std::move(other.m_sourceFile);
+		m_preprocessorOptions = std::move(other.m_preprocessorOptions);
+		m_sourceOverride = std::move(other.m_sourceOverride);
+		m_errorLog = std::move(other.m_errorLog);
+		m_csHandle = other.m_csHandle;
+		m_programHandle = other.m_programHandle;
+		std::copy(other.m_workGroupSize, other.m_workGroupSize + 3, m_workGroupSize);
+		versionId = other.versionId;
+		m_pending = std::move(other.m_pending);
+
+		other.m_csHandle = GlShaderHandle();
+		other.m_programHandle = GlProgramHandle();
+		other.m_pending = PendingReload();
 	}
 
-	return result;
+	return *this;
+}
+
+ComputeShader::~ComputeShader()
+{
+	releaseHandles();
+	releasePending();
 }
 
 void ComputeShader::updateErrorLogFile()
 {
+	// The editor which streamed the source gets the errors through EditorLink,
+	// and the file would describe source which isn't on disk
+	if (m_sourceOverride) {
+		return;
+	}
+
 	if (m_errorLog.length() > 0) {
 		std::ofstream(m_sourceFile + ".errors").write(m_errorLog.data(), m_errorLog.size());
 	}
@@ -339,30 +647,136 @@ void ComputeShader::updateErrorLogFile()
 	}
 }
 
-bool ComputeShader::reload()
+void ComputeShader::prepareSource(PreparedSource *const result) const
 {
+	if (m_sourceOverride) {
+		result->source = *m_sourceOverride;
+		addShaderPrologue(&result->source);
+	}
+	else {
+		result->source = loadShaderSource(m_sourceFile, m_preprocessorOptions.c_str());
+	}
+
+	result->cacheKey = ShaderCache::makeKey(result->source);
+
+	shared_ptr<ShaderCache::Entry> cached = make_shared<ShaderCache::Entry>();
+	if (ShaderCache::load(result->cacheKey, cached.get())) {
+		result->cached = cached;
+	}
+	else {
+		result->annotations = parseAnnotations(result->source);
+	}
+}
+
+ShaderLoadStatus ComputeShader::beginReload(PreparedSource&& prepared)
+{
+	// A newer source supersedes whatever might still be compiling
+	releasePending();
 	m_errorLog.clear();
 
-	vector<char> source = loadShaderSource(m_sourceFile, "");
-	GLuint sHandle = makeShader(GL_COMPUTE_SHADER, source, &m_errorLog);
+	if (prepared.cached) {
+		ShaderCache::Entry& cached = *prepared.cached;
+		const GLuint pHandle = makeProgramFromBinary(cached.binaryFormat, cached.binary);
+
+		if (pHandle) {
+			releaseHandles();
+			m_programHandle = GlResources::track(GlProgramHandle(pHandle), cached.binary.size(), "compute program");
+			m_params = std::move(cached.params);
+			std::copy(cached.workGroupSize, cached.workGroupSize + 3, m_workGroupSize);
+			++versionId;
+
+			updateErrorLogFile();
+			return ShaderLoadStatus::Ready;
+		}
+
+		// Stale binary; the annotations are only parsed up front on a cache miss
+		prepared.annotations = parseAnnotations(prepared.source);
+	}
+
+	const GLuint sHandle = submitShader(GL_COMPUTE_SHADER, prepared.source);
 	if (!sHandle) {
+		m_errorLog = "glCreateShader failed";
+		ReloadProfiler::cancel(this);
 		updateErrorLogFile();
-		return false;
+		return ShaderLoadStatus::Failed;
+	}
+
+	m_pending.shaderHandle = sHandle;
+	m_pending.programHandle = submitProgram(sHandle);
+	m_pending.cacheKey = prepared.cacheKey;
+	m_pending.sourceSize = prepared.source.size();
+	m_pending.storeInCache = !m_sourceOverride;
+	m_pending.annotations = std::move(prepared.annotations);
+
+	return ShaderLoadStatus::Pending;
+}
+
+ShaderLoadStatus ComputeShader::updateReload(bool wait)
+{
+	if (!isReloadPending()) {
+		return m_programHandle.valid() ? ShaderLoadStatus::Ready : ShaderLoadStatus::Failed;
 	}
 
-	GLuint pHandle = makeProgram(sHandle, &m_errorLog);
-	if (!pHandle) {
+	if (!wait && !isProgramComplete(m_pending.programHandle)) {
+		return ShaderLoadStatus::Pending;
+	}
+
+	const GLuint sHandle = m_pending.shaderHandle;
+	const GLuint pHandle = m_pending.programHandle;
+	const u64 cacheKey = m_pending.cacheKey;
+	const size_t sourceSize = m_pending.sourceSize;
+	const bool storeInCache = m_pending.storeInCache;
+	const vector<ParsedAnnotation> annotations = std::move(m_pending.annotations);
+	m_pending = PendingReload();
+
+	if (!checkShader(sHandle, &m_errorLog) || !checkProgram(pHandle, &m_errorLog)) {
+		glDeleteProgram(pHandle);
+		glDeleteShader(sHandle);
+		ReloadProfiler::cancel(this);
 		updateErrorLogFile();
-		return false;
+		return ShaderLoadStatus::Failed;
 	}
 
-	m_programHandle = pHandle;
-	m_csHandle = sHandle;
+	ReloadProfiler::mark(this, ReloadProfiler::Stage::Compile);
+
+	GLint binaryLength = 0;
+	glGetProgramiv(pHandle, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+
+	releaseHandles();
+	m_programHandle = GlResources::track(GlProgramHandle(pHandle), binaryLength, "compute program");
+	m_csHandle = GlResources::track(GlShaderHandle(sHandle), sourceSize, "compute shader");
 	++versionId;
 
 	updateErrorLogFile();
-
-	auto annotations = parseAnnotations(source);
 	reflectParams(annotations);
-	return true;
+	ReloadProfiler::mark(this, ReloadProfiler::Stage::Reflect);
+
+	{
+		ShaderCache::Entry entry;
+		if (binaryLength > 0 && storeInCache) {
+			GLenum binaryFormat = 0;
+			entry.binary.resize(binaryLength);
+			glGetProgramBinary(pHandle, binaryLength, nullptr, &binaryFormat, entry.binary.data());
+
+			entry.binaryFormat = binaryFormat;
+			entry.params = m_params;
+			std::copy(m_workGroupSize, m_workGroupSize + 3, entry.workGroupSize);
+			ShaderCache::store(cacheKey, entry);
+		}
+	}
+
+	return ShaderLoadStatus::Ready;
+}
+
+bool ComputeShader::reload()
+{
+	PreparedSource prepared;
+	prepareSource(&prepared);
+
+	ShaderLoadStatus status = beginReload(std::move(prepared));
+	if (ShaderLoadStatus::Pending == status) {
+		status = updateReload(true);
+	}
+
+	return ShaderLoadStatus::Ready == status;
 }
@@ -2,6 +2,7 @@
 #include "Common.h"
 //#include "StringUtil.h"
 #include "Texture.h"
+#include "GlResources.h"
 //#include "FileUtil.h"
 
 //#include <glad/glad.h>
@@ -12,42 +13,46 @@
 
 std::vector<char> loadShaderSource(const std::string& path, const char* preprocessorOptions);
 
+// Parsed once at reflection time from the "//@" comment following a param declaration
 struct ParamAnnotation
 {
-	std::unordered_map<std::string, std::string> items;
+	enum Flag : u16 {
+		Flag_Min = 1 << 0,
+		Flag_Max = 1 << 1,
+		Flag_Default = 1 << 2,
+		Flag_Color = 1 << 3,
+		Flag_Input = 1 << 4,
+		Flag_RelativeTo = 1 << 5,
+		Flag_Scale = 1 << 6,
+		Flag_Size = 1 << 7,
+		Flag_Time = 1 << 8,	// float param fed the time in seconds, which makes the pass redraw every frame
+	};
 
-	const char* get(const std::string& value, const char* def) const {
-		auto it = items.find(value);
-		if (it != items.end()) {
-			return it->second.c_str();
-		}
-		else {
-			return def;
-		}
-	}
+	u16 flags = 0;
 
-	float get(const std::string& value, float def) const {
-		auto it = items.find(value);
-		if (it != items.end()) {
-			return atof(it->second.c_str());
-		}
-		else {
-			return def;
-		}
-	}
+	// The param type isn't known while parsing, so numbers are kept in both forms
+	float minFloat = 0.0f;
+	float maxFloat = 1.0f;
+	float defaultFloat = 0.0f;
+	int minInt = 0;
+	int maxInt = 16;
+	int defaultInt = 0;
 
-	int get(const std::string& value, int def) const {
-		auto it = items.find(value);
-		if (it != items.end()) {
-			return atoi(it->second.c_str());
-		}
-		else {
-			return def;
-		}
-	}
+	vec2 scale = vec2(1, 1);
+	ivec2 size = ivec2(1280, 720);
+
+	// Target of relativeTo(), resolved after reflection. Same encoding as TextureDesc::scaleRelativeToIdx
+	int relativeToIdx = TextureDesc::RelativeToNone;
+	std::string relativeTo;
+
+	// default() of texture params
+	std::string defaultPath;
 
-	bool has(const std::string& value) const {
-		return items.find(value) != items.end();
+	// Keys which aren't understood by the parser
+	std::unordered_map<std::string, std::string> extra;
+
+	bool has(Flag flag) const {
+		return (flags & flag) != 0;
 	}
 };
 
@@ -100,34 +105,122 @@ struct ShaderParamRefl {
 
 struct ShaderParamBindingRefl : ShaderParamRefl {
 	unsigned int location = -1;
+
+	// Image or texture unit assigned at reflection time; -1 for plain uniforms
+	int binding = -1;
+};
+
+// Returns -1 if not found
+int findParamIndex(const std::vector<ShaderParamBindingRefl>& params, const std::string& name);
+
+// Maps the name of a relative size target to a TextureDesc::scaleRelativeToIdx value
+int resolveRelativeScaleTarget(const std::vector<ShaderParamBindingRefl>& params, const std::string& name);
+
+struct ShaderCompileError {
+	std::string file;
+	int line = 0;		// 0 if the driver didn't say
+	int column = 1;		// 1 unless the driver said otherwise
+	std::string message;
+};
+
+// Splits a compiler or linker log into messages. The sources only ever have one string, thus
+// all of the errors are attributed to `file`.
+std::vector<ShaderCompileError> parseCompileErrors(const std::string& log, const std::string& file);
+
+namespace ShaderCache { struct Entry; }
+
+// Detects KHR/ARB_parallel_shader_compile, which glad doesn't load, and lets the driver
+// use as many compiler threads as it likes. Call once after the GL context is created.
+void initParallelShaderCompile(void* (*getProcAddress)(const char*));
+
+enum class ShaderLoadStatus {
+	Ready,
+	Pending,
+	Failed,
 };
 
 struct ComputeShader
 {
 	std::vector<ShaderParamBindingRefl> m_params;
 	std::string m_sourceFile;
+	std::string m_preprocessorOptions;
 	std::string m_errorLog;
 
-	unsigned int m_csHandle = -1;
-	unsigned int m_programHandle = -1;
+	// Unsaved source streamed from an editor through EditorLink; used instead of the file while set.
+	// Zero-terminated, without the #version prologue. Such sources don't go to the program cache.
+	shared_ptr<const std::vector<char>> m_sourceOverride;
+
+	GlShaderHandle m_csHandle;
+	GlProgramHandle m_programHandle;
+	u32 m_workGroupSize[3] = { 1, 1, 1 };
 
 	// incremented every time the shader is dynamically reloaded
 	u32 versionId = 0;
 
-	void reflectParams(const std::unordered_map<std::string, ParamAnnotation>& annotations);
+	struct ParsedAnnotation {
+		std::string paramName;
+		ParamAnnotation annotation;
+	};
+
+	// The part of a (re)load which doesn't touch GL, thus can be done on any thread
+	struct PreparedSource {
+		std::vector<char> source;
+		u64 cacheKey = 0;
+		shared_ptr<ShaderCache::Entry> cached;		// null on a cache miss
+		std::vector<ParsedAnnotation> annotations;	// only parsed on a cache miss
+	};
 
-	std::unordered_map<std::string, ParamAnnotation> parseAnnotations(const std::vector<char>& source);
+	void reflectParams(const std::vector<ParsedAnnotation>& annotations);
+
+	static std::vector<ParsedAnnotation> parseAnnotations(const std::vector<char>& source);
 
 	void updateErrorLogFile();
 
+	void prepareSource(PreparedSource *const result) const;
+
+	// Creates the program from the cache, or submits compilation and linking to the driver.
+	// In the latter case the result is Pending, and the program is picked up by updateReload.
+	ShaderLoadStatus beginReload(PreparedSource&& prepared);
+
+	// Finishes a pending reload. Without `wait`, returns Pending while the driver is still compiling.
+	ShaderLoadStatus updateReload(bool wait);
+
+	bool isReloadPending() const {
+		return m_pending.programHandle != 0;
+	}
+
+	// Synchronous reload; returns false if the shader failed to compile
 	bool reload();
 
+	// Doesn't compile the shader; that's up to reload or beginReload
 	ComputeShader() {}
-	ComputeShader(const std::string sourceFile)
+	ComputeShader(const std::string sourceFile, const char* preprocessorOptions = "")
 		: m_sourceFile(sourceFile)
-	{
-		reload();
-	}
+		, m_preprocessorOptions(preprocessorOptions)
+	{}
+
+	// The GL objects are owned by the shader, thus it can only be moved
+	ComputeShader(const ComputeShader&) = delete;
+	ComputeShader& operator=(const ComputeShader&) = delete;
+	ComputeShader(ComputeShader&& other) { *this = std::move(other); }
+	ComputeShader& operator=(ComputeShader&& other);
+
+	~ComputeShader();
+
+private:
+	struct PendingReload {
+		unsigned int shaderHandle = 0;	// GLuint
+		unsigned int programHandle = 0;	// GLuint
+		u64 cacheKey = 0;
+		size_t sourceSize = 0;
+		bool storeInCache = true;
+		std::vector<ParsedAnnotation> annotations;
+	};
+
+	PendingReload m_pending;
+
+	void releaseHandles();
+	void releasePending();
 };
 
 struct ShaderParamProxy {
@@ -215,6 +308,15 @@ struct ShaderParamIterProxy {
 		return refls->size();
 	}
 
+	ShaderParamProxy operator[](size_t i) {
+		return ShaderParamProxy{ (*refls)[i], (*values)[i], (*uids)[i], u32(i) };
+	}
+
+	// The same params, with values from another array
+	ShaderParamIterProxy withValues(std::vector<ShaderParamValue>& otherValues) const {
+		return ShaderParamIterProxy(*refls, otherValues, *uids);
+	}
+
 	friend struct Iterator;
 private:
 	const std::vector<ShaderParamBindingRefl>* refls = nullptr;
@@ -0,0 +1,303 @@
+#include "ShaderCache.h"
+#include "FileUtil.h"
+#include "Hash.h"
+
+#include <glad/glad.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <cassert>
+
+namespace ShaderCache {
+	// Bump whenever the layout of the cache files changes
+	const u32 cacheMagic = 0x43535452;	// 'RTSC'
+	const u32 cacheVersion = 3;
+	const char* const cacheDir = "cache/shaders";
+
+	// Every saved edit of a shader adds an entry, so the least recently used ones are evicted
+	// once the entries take up more than this
+	const u64 maxCacheBytes = 64 << 20;
+
+	struct Writer {
+		vector<u8> data;
+
+		void bytes(const void* src, size_t size) {
+			const u8* b = static_cast<const u8*>(src);
+			data.insert(data.end(), b, b + size);
+		}
+
+		void u32v(u32 v) { bytes(&v, sizeof(v)); }
+		void u64v(u64 v) { bytes(&v, sizeof(v)); }
+		template <typename T> void pod(const T& v) { bytes(&v, sizeof(v)); }
+
+		void str(const std::string& s) {
+			u32v(u32(s.size()));
+			bytes(s.data(), s.size());
+		}
+	};
+
+	struct Reader {
+		const u8* cur;
+		const u8* end;
+
+		bool bytes(void* dst, size_t size) {
+			if (size_t(end - cur) < size) return false;
+			memcpy(dst, cur, size);
+			cur += size;
+			return true;
+		}
+
+		bool u32v(u32* v) { return bytes(v, sizeof(*v)); }
+		bool u64v(u64* v) { return bytes(v, sizeof(*v)); }
+		template <typename T> bool pod(T* v) { return bytes(v, sizeof(*v)); }
+
+		bool str(std::string* s) {
+			u32 len;
+			if (!u32v(&len) || size_t(end - cur) < len) return false;
+			s->assign(reinterpret_cast<const char*>(cur), len);
+			cur += len;
+			return true;
+		}
+	};
+
+	static void writeAnnotation(Writer& w, const ParamAnnotation& a)
+	{
+		w.pod(a.flags);
+		w.pod(a.minFloat);
+		w.pod(a.maxFloat);
+		w.pod(a.defaultFloat);
+		w.pod(a.minInt);
+		w.pod(a.maxInt);
+		w.pod(a.defaultInt);
+		w.pod(a.scale);
+		w.pod(a.size);
+		w.pod(a.relativeToIdx);
+		w.str(a.relativeTo);
+		w.str(a.defaultPath);
+
+		w.u32v(u32(a.extra.size()));
+		for (const auto& item : a.extra) {
+			w.str(item.first);
+			w.str(item.second);
+		}
+	}
+
+	static bool readAnnotation(Reader& r, ParamAnnotation *const a)
+	{
+		u32 extraCount;
+		const bool ok = r.pod(&a->flags)
+			&& r.pod(&a->minFloat)
+			&& r.pod(&a->maxFloat)
+			&& r.pod(&a->defaultFloat)
+			&& r.pod(&a->minInt)
+			&& r.pod(&a->maxInt)
+			&& r.pod(&a->defaultInt)
+			&& r.pod(&a->scale)
+			&& r.pod(&a->size)
+			&& r.pod(&a->relativeToIdx)
+			&& r.str(&a->relativeTo)
+			&& r.str(&a->defaultPath)
+			&& r.u32v(&extraCount);
+
+		if (!ok) {
+			return false;
+		}
+
+		for (u32 i = 0; i < extraCount; ++i) {
+			std::string key, value;
+			if (!r.str(&key) || !r.str(&value)) return false;
+			a->extra[key] = value;
+		}
+
+		return true;
+	}
+
+	u64 driverHash = 0;
+
+	void init()
+	{
+		const GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+		driverHash = hashBytes(&cacheVersion, sizeof(cacheVersion));
+		for (GLenum name : names) {
+			const char* const str = reinterpret_cast<const char*>(glGetString(name));
+			if (str) driverHash = hashBytes(str, strlen(str), driverHash);
+		}
+	}
+
+	static std::string entryPath(u64 key)
+	{
+		char name[32];
+		sprintf(name, "%016llx.bin", key);
+		return std::string(cacheDir) + "/" + name;
+	}
+
+	u64 makeKey(const vector<char>& source)
+	{
+		assert(driverHash != 0 && "ShaderCache::init not called");
+		return hashBytes(source.data(), source.size(), driverHash);
+	}
+
+	bool load(u64 key, Entry *const entry)
+	{
+		const std::string path = entryPath(key);
+		FILE* const f = fopen(path.c_str(), "rb");
+		if (!f) {
+			return false;
+		}
+
+		fseek(f, 0, SEEK_END);
+		const long fsize = ftell(f);
+		fseek(f, 0, SEEK_SET);
+		vector<u8> data(fsize > 0 ? size_t(fsize) : 0);
+		const size_t bytesRead = fread(data.data(), 1, data.size(), f);
+		fclose(f);
+
+		if (bytesRead != data.size()) {
+			return false;
+		}
+
+		Reader r = { data.data(), data.data() + data.size() };
+
+		u32 magic, version, paramCount, binaryLength;
+		u64 storedKey;
+		if (!r.u32v(&magic) || magic != cacheMagic) return false;
+		if (!r.u32v(&version) || version != cacheVersion) return false;
+		if (!r.u64v(&storedKey) || storedKey != key) return false;
+
+		if (!r.u32v(&entry->binaryFormat) || !r.u32v(&binaryLength)) return false;
+		entry->binary.resize(binaryLength);
+		if (!r.bytes(entry->binary.data(), binaryLength)) return false;
+
+		for (u32& dim : entry->workGroupSize) {
+			if (!r.u32v(&dim)) return false;
+		}
+
+		if (!r.u32v(&paramCount)) return false;
+		entry->params.resize(paramCount);
+
+		for (ShaderParamBindingRefl& param : entry->params) {
+			u32 type, location, binding;
+			if (!r.str(&param.name)) return false;
+			if (!r.u32v(&type) || type > u32(ShaderParamType::Unknown)) return false;
+			if (!r.u32v(&location) || !r.u32v(&binding)) return false;
+
+			param.type = ShaderParamType(type);
+			param.location = location;
+			param.binding = int(binding);
+
+			if (!readAnnotation(r, &param.annotation)) return false;
+		}
+
+		if (r.cur != r.end) {
+			return false;
+		}
+
+		// The modification time doubles as the last use for eviction
+		std::error_code ec;
+		fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+
+		return true;
+	}
+
+	// Removes the least recently used entries until the rest fit in maxCacheBytes
+	static void evictEntries(const std::string& keepPath)
+	{
+		struct CachedFile {
+			fs::path path;
+			fs::file_time_type lastUsed;
+			u64 size;
+		};
+
+		vector<CachedFile> files;
+		u64 totalSize = 0;
+
+		std::error_code ec;
+		for (fs::directory_iterator it(cacheDir, ec), end; !ec && it != end; it.increment(ec)) {
+			if (it->path().extension() != ".bin") {
+				continue;
+			}
+
+			std::error_code statEc;
+			CachedFile file = { it->path(), fs::last_write_time(it->path(), statEc), u64(fs::file_size(it->path(), statEc)) };
+			if (!statEc) {
+				totalSize += file.size;
+				files.push_back(file);
+			}
+		}
+
+		if (totalSize <= maxCacheBytes) {
+			return;
+		}
+
+		std::sort(files.begin(), files.end(), [](const CachedFile& a, const CachedFile& b) {
+			return a.lastUsed < b.lastUsed;
+		});
+
+		for (const CachedFile& file : files) {
+			if (totalSize <= maxCacheBytes) {
+				break;
+			}
+
+			if (file.path == keepPath) {
+				continue;
+			}
+
+			std::error_code removeEc;
+			if (fs::remove(file.path, removeEc)) {
+				totalSize -= file.size;
+			}
+		}
+	}
+
+	void store(u64 key, const Entry& entry)
+	{
+		Writer w;
+		w.u32v(cacheMagic);
+		w.u32v(cacheVersion);
+		w.u64v(key);
+
+		w.u32v(entry.binaryFormat);
+		w.u32v(u32(entry.binary.size()));
+		w.bytes(entry.binary.data(), entry.binary.size());
+
+		for (u32 dim : entry.workGroupSize) {
+			w.u32v(dim);
+		}
+
+		w.u32v(u32(entry.params.size()));
+		for (const ShaderParamBindingRefl& param : entry.params) {
+			w.str(param.name);
+			w.u32v(u32(param.type));
+			w.u32v(param.location);
+			w.u32v(u32(param.binding));
+
+			writeAnnotation(w, param.annotation);
+		}
+
+		std::error_code ec;
+		fs::create_directories(cacheDir, ec);
+
+		// Written next to the entry and renamed over it, so that loads never see a partial file
+		const std::string path = entryPath(key);
+		const std::string tempPath = path + ".tmp";
+
+		FILE* const f = fopen(tempPath.c_str(), "wb");
+		if (!f) {
+			return;
+		}
+
+		const bool written = fwrite(w.data.data(), 1, w.data.size(), f) == w.data.size();
+		if (0 != fclose(f) || !written) {
+			fs::remove(tempPath, ec);
+			return;
+		}
+
+		fs::rename(tempPath, path, ec);
+		if (ec) {
+			fs::remove(tempPath, ec);
+			return;
+		}
+
+		evictEntries(path);
+	}
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include "Common.h"
+#include "Shader.h"
+
+// Persistent cache of linked program binaries along with their reflection data, so that
+// unchanged shaders can be loaded without compilation, annotation parsing or GL reflection queries.
+namespace ShaderCache {
+	struct Entry {
+		unsigned int binaryFormat = 0;	// GLenum
+		vector<u8> binary;
+		vector<ShaderParamBindingRefl> params;
+		u32 workGroupSize[3] = { 1, 1, 1 };
+	};
+
+	// Queries the identity of the GL driver; must be called on the GL thread before makeKey
+	void init();
+
+	// Combines the hash of the shader source with the identity of the GL driver,
+	// since program binaries are only valid for the driver that produced them.
+	// Safe to call from any thread.
+	u64 makeKey(const vector<char>& source);
+
+	bool load(u64 key, Entry *const entry);
+	void store(u64 key, const Entry& entry);
+}
@@ -0,0 +1,164 @@
+#include "ShaderLibrary.h"
+#include "FileWatcher.h"
+#include "FileUtil.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <unordered_map>
+#include <stdio.h>
+
+namespace ShaderLibrary {
+	std::string					root;
+	FileWatcher::WatchId		watchId = FileWatcher::invalidWatchId;
+
+	std::thread					indexThread;
+	std::mutex					mutex;
+	std::condition_variable		rescanRequested;
+	bool						rescanPending = false;
+	bool						threadStopping = false;
+
+	// Written by the index thread, taken by the main thread in update
+	shared_ptr<const Index>		latestIndex;
+
+	// Main thread only
+	shared_ptr<const Index>		currentIndex = make_shared<Index>();
+
+	static bool readFile(const fs::path& path, vector<char> *const result)
+	{
+		FILE* const f = fopen(path.string().c_str(), "rb");
+		if (!f) {
+			return false;
+		}
+
+		fseek(f, 0, SEEK_END);
+		const long fsize = ftell(f);
+		fseek(f, 0, SEEK_SET);
+		result->resize(fsize > 0 ? size_t(fsize) : 0);
+		result->resize(fread(result->data(), 1, result->size(), f));
+		fclose(f);
+
+		return true;
+	}
+
+	// Only files which are new or have a different size or modification time are read and parsed
+	static shared_ptr<const Index> scan(const Index& previous)
+	{
+		std::unordered_map<std::string, const Entry*> previousByPath;
+		for (const Entry& entry : previous) {
+			previousByPath[entry.path] = &entry;
+		}
+
+		shared_ptr<Index> index = make_shared<Index>();
+		vector<char> source;
+
+		std::error_code ec;
+		for (fs::recursive_directory_iterator it(root, ec), end; !ec && it != end; it.increment(ec)) {
+			const fs::path& path = it->path();
+			if (!fs::is_regular_file(it->status()) || path.extension() != ".glsl") {
+				continue;
+			}
+
+			Entry entry;
+			entry.path = path.generic_string();
+			entry.size = u64(fs::file_size(path, ec));
+			entry.mtime = s64(fs::last_write_time(path, ec).time_since_epoch().count());
+
+			auto found = previousByPath.find(entry.path);
+			if (found != previousByPath.end() && found->second->size == entry.size && found->second->mtime == entry.mtime) {
+				index->push_back(*found->second);
+				continue;
+			}
+
+			const std::string filename = path.filename().string();
+			entry.name = filename.substr(0, filename.find_last_of("."));
+
+			if (readFile(path, &source)) {
+				entry.annotations = ComputeShader::parseAnnotations(source);
+			}
+
+			index->push_back(std::move(entry));
+		}
+
+		std::sort(index->begin(), index->end(), [](const Entry& a, const Entry& b) {
+			return a.name < b.name || (a.name == b.name && a.path < b.path);
+		});
+
+		return index;
+	}
+
+	static void threadFunc()
+	{
+		shared_ptr<const Index> index = make_shared<Index>();
+
+		for (;;) {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				rescanRequested.wait(lock, [] { return threadStopping || rescanPending; });
+
+				if (threadStopping) {
+					return;
+				}
+
+				rescanPending = false;
+			}
+
+			index = scan(*index);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			latestIndex = index;
+		}
+	}
+
+	static void requestRescan()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			rescanPending = true;
+		}
+
+		rescanRequested.notify_one();
+	}
+
+	void start(const char* rootDir)
+	{
+		root = rootDir;
+		threadStopping = false;
+		rescanPending = true;
+		indexThread = std::thread(&threadFunc);
+
+		watchId = FileWatcher::watchDirectoryTree(rootDir, []() {
+			requestRescan();
+		});
+	}
+
+	void stop()
+	{
+		FileWatcher::stopWatching(watchId);
+		watchId = FileWatcher::invalidWatchId;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			threadStopping = true;
+		}
+
+		rescanRequested.notify_one();
+		indexThread.join();
+	}
+
+	void update()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (latestIndex) {
+			currentIndex = std::move(latestIndex);
+			latestIndex = nullptr;
+		}
+	}
+
+	const Index& getIndex()
+	{
+		return *currentIndex;
+	}
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "Common.h"
+#include "Shader.h"
+
+#include <string>
+
+// In-memory index of the shaders available under a directory, for menus which list them.
+// The index is built on a background thread and kept current through a FileWatcher
+// directory watch, so reading it never touches the disk.
+namespace ShaderLibrary {
+	struct Entry {
+		std::string path;	// relative to the working directory, as passed to ShaderRegistry
+		std::string name;	// file name without the extension
+		vector<ComputeShader::ParsedAnnotation> annotations;
+
+		// Used to skip re-parsing unchanged files during a rescan
+		u64 size = 0;
+		s64 mtime = 0;
+	};
+
+	typedef vector<Entry> Index;
+
+	void start(const char* rootDir);
+	void stop();
+
+	// Picks up the latest index from the background thread. Call once per frame.
+	void update();
+
+	// Sorted by name. Empty until the first scan has finished.
+	const Index& getIndex();
+}
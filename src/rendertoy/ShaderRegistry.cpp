@@ -0,0 +1,234 @@
+#include "ShaderRegistry.h"
+#include "FileWatcher.h"
+#include "FileUtil.h"
+#include "ThreadPool.h"
+#include "ReloadProfiler.h"
+
+#include <unordered_map>
+#include <algorithm>
+#include <cctype>
+#include <stdio.h>
+
+namespace ShaderRegistry {
+	std::unordered_map<std::string, std::weak_ptr<ComputeShader>> shaders;
+	vector<std::weak_ptr<ComputeShader>> pendingShaders;
+
+	struct ShaderChange {
+		std::string key;
+		ReloadProfiler::Clock::time_point detectedTime;
+		ReloadProfiler::Clock::time_point dispatchTime;
+	};
+
+	vector<ShaderChange> changedShaders;	// filled by watch callbacks, reloaded in update
+
+	// Sources streamed by the editor, keyed by makePathKey
+	std::unordered_map<std::string, shared_ptr<const vector<char>>> sourceOverrides;
+
+	static std::string makePathKey(const std::string& path)
+	{
+		std::error_code ec;
+		std::string key = fs::canonical(path, ec).string();
+		if (ec) {
+			key = fs::absolute(path).string();
+		}
+
+#ifdef _WIN32
+		// NTFS paths are case-insensitive
+		std::transform(key.begin(), key.end(), key.begin(), [](char c) { return char(::tolower(c)); });
+#endif
+
+		return key;
+	}
+
+	static std::string makeKey(const std::string& pathKey, const char* preprocessorOptions)
+	{
+		return pathKey + '\n' + preprocessorOptions;
+	}
+
+	static std::string getPathKey(const std::string& key)
+	{
+		return key.substr(0, key.find('\n'));
+	}
+
+	// Returns an uncompiled shader if it wasn't in the registry yet
+	static shared_ptr<ComputeShader> findOrCreate(const std::string& path, const char* preprocessorOptions, bool *const created)
+	{
+		const std::string pathKey = makePathKey(path);
+		const std::string key = makeKey(pathKey, preprocessorOptions);
+
+		auto found = shaders.find(key);
+		if (found != shaders.end()) {
+			if (shared_ptr<ComputeShader> existing = found->second.lock()) {
+				*created = false;
+				return existing;
+			}
+		}
+
+		ComputeShader* const raw = new ComputeShader(path, preprocessorOptions);
+
+		auto sourceOverride = sourceOverrides.find(pathKey);
+		if (sourceOverride != sourceOverrides.end()) {
+			raw->m_sourceOverride = sourceOverride->second;
+		}
+
+		const FileWatcher::WatchId watchId = FileWatcher::watchFile(path.c_str(), [key]()
+		{
+			changedShaders.push_back({ key, FileWatcher::getChangeDetectedTime(), ReloadProfiler::Clock::now() });
+		});
+
+		// The deleter retires the watch and the registry entry together with the last reference
+		shared_ptr<ComputeShader> shader(raw, [key, watchId](ComputeShader* s)
+		{
+			FileWatcher::stopWatching(watchId);
+			shaders.erase(key);
+			delete s;
+		});
+
+		shaders[key] = shader;
+		*created = true;
+		return shader;
+	}
+
+	shared_ptr<ComputeShader> acquire(const std::string& path, const char* preprocessorOptions)
+	{
+		bool created;
+		shared_ptr<ComputeShader> shader = findOrCreate(path, preprocessorOptions, &created);
+
+		if (created) {
+			shader->reload();
+		}
+
+		return shader;
+	}
+
+	// Loads the sources on the thread pool, then submits everything before asking about any of it,
+	// so that the driver can work on all of it at once. Returns the shaders still compiling.
+	static vector<shared_ptr<ComputeShader>> submitReloads(const vector<shared_ptr<ComputeShader>>& batch)
+	{
+		vector<ComputeShader::PreparedSource> prepared(batch.size());
+		ThreadPool::parallelFor(batch.size(), [&](size_t i)
+		{
+			batch[i]->prepareSource(&prepared[i]);
+		});
+
+		for (const shared_ptr<ComputeShader>& shader : batch) {
+			ReloadProfiler::mark(shader.get(), ReloadProfiler::Stage::Preprocess);
+		}
+
+		vector<shared_ptr<ComputeShader>> pending;
+		for (size_t i = 0; i < batch.size(); ++i) {
+			if (ShaderLoadStatus::Pending == batch[i]->beginReload(std::move(prepared[i]))) {
+				pending.push_back(batch[i]);
+			}
+		}
+
+		return pending;
+	}
+
+	// All shaders changed by one FileWatcher batch are finished within the same frame,
+	// so passes and the graph only have to be updated once for the whole batch
+	static void reloadChangedShaders()
+	{
+		vector<shared_ptr<ComputeShader>> batch;
+		for (const ShaderChange& change : changedShaders) {
+			// The file on disk is newer than whatever the editor streamed before saving it
+			sourceOverrides.erase(getPathKey(change.key));
+
+			auto found = shaders.find(change.key);
+			if (found != shaders.end()) {
+				if (shared_ptr<ComputeShader> shader = found->second.lock()) {
+					shader->m_sourceOverride = nullptr;
+					ReloadProfiler::begin(shader.get(), change.detectedTime, change.dispatchTime);
+					batch.push_back(shader);
+				}
+			}
+		}
+
+		changedShaders.clear();
+
+		for (shared_ptr<ComputeShader>& shader : submitReloads(batch)) {
+			shader->updateReload(true);
+		}
+	}
+
+	vector<shared_ptr<ComputeShader>> prefetch(const vector<std::string>& paths, const char* preprocessorOptions)
+	{
+		vector<shared_ptr<ComputeShader>> result;
+		vector<shared_ptr<ComputeShader>> created;
+
+		for (const std::string& path : paths) {
+			bool isNew;
+			result.push_back(findOrCreate(path, preprocessorOptions, &isNew));
+
+			if (isNew) {
+				created.push_back(result.back());
+			}
+		}
+
+		for (shared_ptr<ComputeShader>& shader : submitReloads(created)) {
+			pendingShaders.push_back(shader);
+		}
+
+		return result;
+	}
+
+	vector<shared_ptr<ComputeShader>> overrideSource(const std::string& path, shared_ptr<const vector<char>> source)
+	{
+		const std::string pathKey = makePathKey(path);
+		if (source) {
+			sourceOverrides[pathKey] = source;
+		}
+		else {
+			sourceOverrides.erase(pathKey);
+		}
+
+		const ReloadProfiler::Clock::time_point now = ReloadProfiler::Clock::now();
+
+		vector<shared_ptr<ComputeShader>> batch;
+		for (auto& it : shaders) {
+			if (getPathKey(it.first) != pathKey) {
+				continue;
+			}
+
+			if (shared_ptr<ComputeShader> shader = it.second.lock()) {
+				shader->m_sourceOverride = source;
+				ReloadProfiler::begin(shader.get(), now, now);
+				batch.push_back(shader);
+			}
+		}
+
+		for (shared_ptr<ComputeShader>& shader : submitReloads(batch)) {
+			shader->updateReload(true);
+		}
+
+		return batch;
+	}
+
+	void update()
+	{
+		if (!changedShaders.empty()) {
+			reloadChangedShaders();
+		}
+
+		for (size_t i = 0; i < pendingShaders.size(); ) {
+			shared_ptr<ComputeShader> shader = pendingShaders[i].lock();
+
+			if (!shader || shader->updateReload(false) != ShaderLoadStatus::Pending) {
+				pendingShaders.erase(pendingShaders.begin() + i);
+			}
+			else {
+				++i;
+			}
+		}
+	}
+
+	size_t getShaderCount()
+	{
+		return shaders.size();
+	}
+
+	size_t getPendingCount()
+	{
+		return pendingShaders.size();
+	}
+}
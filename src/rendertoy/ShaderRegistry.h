@@ -0,0 +1,32 @@
+#pragma once
+#include "Common.h"
+#include "Shader.h"
+
+// Shares compiled shaders between all passes which use the same source file and preprocessor options.
+// Each unique shader is compiled, reflected and watched for changes once; the entry is removed when
+// the last reference to it goes away. Passes detect reloads by comparing ComputeShader::versionId.
+namespace ShaderRegistry {
+	// Compiles synchronously if the shader isn't in the registry yet
+	shared_ptr<ComputeShader> acquire(const std::string& path, const char* preprocessorOptions = "");
+
+	// Creates all of the shaders which aren't in the registry yet in one batch. Sources are loaded,
+	// hashed and parsed on the thread pool, then handed to the driver together so that it can compile
+	// them concurrently. Doesn't wait for compilation; the programs appear as update finishes them.
+	// The returned references keep the new shaders alive until passes acquire them.
+	vector<shared_ptr<ComputeShader>> prefetch(const vector<std::string>& paths, const char* preprocessorOptions = "");
+
+	// Makes every shader compiled from `path` use `source` instead of the file, including ones created
+	// later, and reloads them right away. A null source goes back to the file. The override is also
+	// dropped when the file changes on disk. Returns the reloaded shaders.
+	vector<shared_ptr<ComputeShader>> overrideSource(const std::string& path, shared_ptr<const vector<char>> source);
+
+	// Reloads the shaders changed by the last FileWatcher batch, and picks up the ones which the
+	// driver has finished compiling. Call once per frame, right after FileWatcher::update.
+	void update();
+
+	// Number of unique shaders currently alive
+	size_t getShaderCount();
+
+	// Number of shaders submitted by prefetch which are still compiling
+	size_t getPendingCount();
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "Common.h"
+
+#include <atomic>
+
+// Bounded lock-free queue for handing items from exactly one producer thread to exactly one
+// consumer thread. Neither side ever blocks; push fails when the queue is full.
+template <typename T, size_t Capacity>
+struct SpscQueue
+{
+	static_assert(Capacity > 0 && 0 == (Capacity & (Capacity - 1)), "Capacity must be a power of two");
+
+	// Producer thread only
+	bool push(const T& item) {
+		const size_t tail = m_tail.load(std::memory_order_relaxed);
+		if (tail - m_head.load(std::memory_order_acquire) == Capacity) {
+			return false;
+		}
+
+		m_items[tail & (Capacity - 1)] = item;
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer thread only
+	bool pop(T *const item) {
+		const size_t head = m_head.load(std::memory_order_relaxed);
+		if (head == m_tail.load(std::memory_order_acquire)) {
+			return false;
+		}
+
+		*item = m_items[head & (Capacity - 1)];
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	T m_items[Capacity];
+
+	// On separate cache lines, so that the two threads don't keep stealing them from each other
+	alignas(64) std::atomic<size_t> m_head{ 0 };	// written by the consumer
+	alignas(64) std::atomic<size_t> m_tail{ 0 };	// written by the producer
+};
@@ -1,4 +1,5 @@
 #include "Texture.h"
+#include "GlResources.h"
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -8,8 +9,8 @@ std::unordered_map<std::string, shared_ptr<CreatedTexture>> g_loadedTextures;
 
 CreatedTexture::~CreatedTexture()
 {
-	if (texId != 0) glDeleteTextures(1, &texId);
-	if (samplerId != 0) glDeleteSamplers(1, &samplerId);
+	GlResources::release(GlResourceType::Texture, texId);
+	GlResources::release(GlResourceType::Sampler, samplerId);
 }
 
 shared_ptr<CreatedTexture> loadTexture(const TextureDesc& desc) {
@@ -136,9 +137,12 @@ shared_ptr<CreatedTexture> createTexture(const TextureDesc& desc, const TextureK
 	glSamplerParameteri(samplerId, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glSamplerParameteri(samplerId, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
+	// RGBA16F
+	const u64 texBytes = u64(key.width) * key.height * 8;
+
 	auto tex = std::make_shared<CreatedTexture>();
 	tex->key = key;
-	tex->texId = tex1;
-	tex->samplerId = samplerId;
+	tex->texId = GlResources::track(GlTextureHandle(tex1), texBytes, "texture");
+	tex->samplerId = GlResources::track(GlSamplerHandle(samplerId), 0, "sampler");
 	return tex;
 }
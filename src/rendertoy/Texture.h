@@ -21,9 +21,18 @@ struct TextureDesc {
 		Input
 	};
 
+	enum {
+		RelativeToWindow = -1,
+		RelativeToNone = -2,
+	};
+
 	std::string path;
 	Source source = Source::Create;
 	std::string scaleRelativeTo;
+
+	// Param index of scaleRelativeTo, or one of the above. Kept in sync with the name
+	// by the owning pass, so that compiling doesn't need to look params up by name.
+	int scaleRelativeToIdx = RelativeToNone;
 	vec2 relativeScale;
 	ivec2 resolution;
 	bool wrapS : 1;
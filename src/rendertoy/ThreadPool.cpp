@@ -0,0 +1,101 @@
+#include "ThreadPool.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <algorithm>
+#include <cassert>
+
+namespace ThreadPool {
+	vector<std::thread>					workers;
+	std::deque<std::function<void()>>	jobs;
+	bool								stopping = true;
+
+	std::mutex							mutex;
+	std::condition_variable				jobQueued;
+	std::condition_variable				jobDone;
+
+	void workerFunc() {
+		for (;;) {
+			std::function<void()> job;
+
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				jobQueued.wait(lock, [] { return stopping || !jobs.empty(); });
+
+				if (jobs.empty()) {
+					return;
+				}
+
+				job = std::move(jobs.front());
+				jobs.pop_front();
+			}
+
+			job();
+		}
+	}
+
+	void start() {
+		assert(stopping);
+		stopping = false;
+
+		const u32 hwThreads = std::max(1u, std::thread::hardware_concurrency());
+		for (u32 i = 0; i + 1 < hwThreads; ++i) {
+			workers.emplace_back(&workerFunc);
+		}
+	}
+
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+
+		jobQueued.notify_all();
+		for (std::thread& t : workers) {
+			t.join();
+		}
+
+		workers.clear();
+	}
+
+	size_t getWorkerCount() {
+		return workers.size();
+	}
+
+	void parallelFor(size_t count, const std::function<void(size_t)>& fn) {
+		std::atomic<size_t> nextIdx(0);
+		size_t helpersRunning = std::min(workers.size(), count > 0 ? count - 1 : 0);
+
+		auto run = [&]() {
+			for (size_t i = nextIdx++; i < count; i = nextIdx++) {
+				fn(i);
+			}
+		};
+
+		if (helpersRunning > 0) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				for (size_t i = 0; i < helpersRunning; ++i) {
+					jobs.push_back([&]() {
+						run();
+
+						std::lock_guard<std::mutex> lock(mutex);
+						--helpersRunning;
+						jobDone.notify_all();
+					});
+				}
+			}
+
+			jobQueued.notify_all();
+		}
+
+		run();
+
+		// The helpers reference this stack frame, so wait until the last one has left
+		std::unique_lock<std::mutex> lock(mutex);
+		jobDone.wait(lock, [&] { return 0 == helpersRunning; });
+	}
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include "Common.h"
+
+#include <functional>
+
+// Fixed set of worker threads for CPU-side work such as loading and hashing files.
+// Jobs must not touch GL; the context only lives on the main thread.
+namespace ThreadPool {
+	// Spawns one worker per hardware thread, minus one for the main thread
+	void start();
+	void stop();
+
+	size_t getWorkerCount();
+
+	// Calls fn(i) for every i in [0, count) on the workers and the calling thread, and returns
+	// once all of them are done. Must not be called from within a job.
+	void parallelFor(size_t count, const std::function<void(size_t)>& fn);
+}
@@ -8,6 +8,7 @@
 
 #include <imgui.h>
 #include "imgui_impl_glfw_gl3.h"
+#include <string.h>
 
 // GL3W/GLFW
 //#include <GL/gl3w.h>    // This example is using gl3w to access OpenGL functions (because it is small). You may use glew/glad/glLoadGen/etc. whatever already works for you.
@@ -31,38 +32,64 @@ static int          g_AttribLocationTex = 0, g_AttribLocationProjMtx = 0;
 static int          g_AttribLocationPosition = 0, g_AttribLocationUV = 0, g_AttribLocationColor = 0;
 static unsigned int g_VboHandle = 0, g_VaoHandle = 0, g_ElementsHandle = 0;
 
-// This is the main rendering function that you have to implement and provide to ImGui (via setting up 'RenderDrawListsFn' in the ImGuiIO structure)
-// If text or lines are blurry when integrating ImGui in your engine:
-// - in your Render function, try translating your projection matrix by (0.5f,0.5f) or (0.375f,0.375f)
-void ImGui_ImplGlfwGL3_RenderDrawLists(ImDrawData* draw_data)
+// Vertices and indices are streamed through persistently mapped buffers, split into one region per
+// frame in flight. The fence of a region is signalled once the GPU has read the frame drawn from it.
+static const int    g_RingFrameCount = 3;
+static GLsync       g_RingFences[g_RingFrameCount] = {};
+static int          g_RingFrame = 0;
+static int          g_RingVtxCapacity = 0, g_RingIdxCapacity = 0;     // per region
+static ImDrawVert*  g_RingVtxData = NULL;
+static ImDrawIdx*   g_RingIdxData = NULL;
+
+static void ImGui_ImplGlfwGL3_DestroyRingBuffers()
 {
-    // Avoid rendering when minimized, scale coordinates for retina displays (screen coordinates != framebuffer coordinates)
-    ImGuiIO& io = ImGui::GetIO();
-    int fb_width = (int)(io.DisplaySize.x * io.DisplayFramebufferScale.x);
-    int fb_height = (int)(io.DisplaySize.y * io.DisplayFramebufferScale.y);
-    if (fb_width == 0 || fb_height == 0)
-        return;
-    draw_data->ScaleClipRects(io.DisplayFramebufferScale);
+    for (int i = 0; i < g_RingFrameCount; i++)
+    {
+        if (g_RingFences[i]) glDeleteSync(g_RingFences[i]);
+        g_RingFences[i] = 0;
+    }
 
-    // Backup GL state
-    GLint last_program; glGetIntegerv(GL_CURRENT_PROGRAM, &last_program);
-    GLint last_texture; glGetIntegerv(GL_TEXTURE_BINDING_2D, &last_texture);
-    GLint last_active_texture; glGetIntegerv(GL_ACTIVE_TEXTURE, &last_active_texture);
-    GLint last_array_buffer; glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &last_array_buffer);
-    GLint last_element_array_buffer; glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &last_element_array_buffer);
-    GLint last_vertex_array; glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &last_vertex_array);
-    GLint last_blend_src; glGetIntegerv(GL_BLEND_SRC, &last_blend_src);
-    GLint last_blend_dst; glGetIntegerv(GL_BLEND_DST, &last_blend_dst);
-    GLint last_blend_equation_rgb; glGetIntegerv(GL_BLEND_EQUATION_RGB, &last_blend_equation_rgb);
-    GLint last_blend_equation_alpha; glGetIntegerv(GL_BLEND_EQUATION_ALPHA, &last_blend_equation_alpha);
-    GLint last_viewport[4]; glGetIntegerv(GL_VIEWPORT, last_viewport);
-    GLint last_scissor_box[4]; glGetIntegerv(GL_SCISSOR_BOX, last_scissor_box); 
-    GLboolean last_enable_blend = glIsEnabled(GL_BLEND);
-    GLboolean last_enable_cull_face = glIsEnabled(GL_CULL_FACE);
-    GLboolean last_enable_depth_test = glIsEnabled(GL_DEPTH_TEST);
-    GLboolean last_enable_scissor_test = glIsEnabled(GL_SCISSOR_TEST);
-
-    // Setup render state: alpha-blending enabled, no face culling, no depth testing, scissor enabled
+    // Deleting the buffers unmaps them; the driver keeps them alive until the GPU is done with them
+    if (g_VboHandle) glDeleteBuffers(1, &g_VboHandle);
+    if (g_ElementsHandle) glDeleteBuffers(1, &g_ElementsHandle);
+    g_VboHandle = g_ElementsHandle = 0;
+    g_RingVtxData = NULL;
+    g_RingIdxData = NULL;
+    g_RingVtxCapacity = g_RingIdxCapacity = 0;
+}
+
+// Expects g_VaoHandle to be bound, as the buffers become part of its state
+static void ImGui_ImplGlfwGL3_CreateRingBuffers(int vtx_capacity, int idx_capacity)
+{
+    ImGui_ImplGlfwGL3_DestroyRingBuffers();
+
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    const GLsizeiptr vtx_size = (GLsizeiptr)vtx_capacity * g_RingFrameCount * sizeof(ImDrawVert);
+    const GLsizeiptr idx_size = (GLsizeiptr)idx_capacity * g_RingFrameCount * sizeof(ImDrawIdx);
+
+    glGenBuffers(1, &g_VboHandle);
+    glBindBuffer(GL_ARRAY_BUFFER, g_VboHandle);
+    glBufferStorage(GL_ARRAY_BUFFER, vtx_size, NULL, flags);
+    g_RingVtxData = (ImDrawVert*)glMapBufferRange(GL_ARRAY_BUFFER, 0, vtx_size, flags);
+
+#define OFFSETOF(TYPE, ELEMENT) ((size_t)&(((TYPE *)0)->ELEMENT))
+    glVertexAttribPointer(g_AttribLocationPosition, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (GLvoid*)OFFSETOF(ImDrawVert, pos));
+    glVertexAttribPointer(g_AttribLocationUV, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (GLvoid*)OFFSETOF(ImDrawVert, uv));
+    glVertexAttribPointer(g_AttribLocationColor, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ImDrawVert), (GLvoid*)OFFSETOF(ImDrawVert, col));
+#undef OFFSETOF
+
+    glGenBuffers(1, &g_ElementsHandle);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_ElementsHandle);
+    glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, idx_size, NULL, flags);
+    g_RingIdxData = (ImDrawIdx*)glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, idx_size, flags);
+
+    g_RingVtxCapacity = vtx_capacity;
+    g_RingIdxCapacity = idx_capacity;
+}
+
+static void ImGui_ImplGlfwGL3_SetupRenderState(int fb_width, int fb_height)
+{
+    // Alpha-blending enabled, no face culling, no depth testing, scissor enabled
     glEnable(GL_BLEND);
     glBlendEquation(GL_FUNC_ADD);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -72,6 +99,7 @@ void ImGui_ImplGlfwGL3_RenderDrawLists(ImDrawData* draw_data)
     glActiveTexture(GL_TEXTURE0);
 
     // Setup viewport, orthographic projection matrix
+    ImGuiIO& io = ImGui::GetIO();
     glViewport(0, 0, (GLsizei)fb_width, (GLsizei)fb_height);
     const float ortho_projection[4][4] =
     {
@@ -84,17 +112,72 @@ void ImGui_ImplGlfwGL3_RenderDrawLists(ImDrawData* draw_data)
     glUniform1i(g_AttribLocationTex, 0);
     glUniformMatrix4fv(g_AttribLocationProjMtx, 1, GL_FALSE, &ortho_projection[0][0]);
     glBindVertexArray(g_VaoHandle);
+}
 
-    for (int n = 0; n < draw_data->CmdListsCount; n++)
+// This is the main rendering function that you have to implement and provide to ImGui (via setting up 'RenderDrawListsFn' in the ImGuiIO structure)
+// If text or lines are blurry when integrating ImGui in your engine:
+// - in your Render function, try translating your projection matrix by (0.5f,0.5f) or (0.375f,0.375f)
+void ImGui_ImplGlfwGL3_RenderDrawLists(ImDrawData* draw_data)
+{
+    // Avoid rendering when minimized, scale coordinates for retina displays (screen coordinates != framebuffer coordinates)
+    ImGuiIO& io = ImGui::GetIO();
+    int fb_width = (int)(io.DisplaySize.x * io.DisplayFramebufferScale.x);
+    int fb_height = (int)(io.DisplaySize.y * io.DisplayFramebufferScale.y);
+    if (fb_width == 0 || fb_height == 0)
+        return;
+    draw_data->ScaleClipRects(io.DisplayFramebufferScale);
+
+    // No GL state is queried up front, as every query stalls on the driver. See the header for what is left behind.
+    ImGui_ImplGlfwGL3_SetupRenderState(fb_width, fb_height);
+
+    // Wait until the GPU is done with the frame last drawn from this region
+    const int region = g_RingFrame % g_RingFrameCount;
+    if (g_RingFences[region])
     {
-        const ImDrawList* cmd_list = draw_data->CmdLists[n];
-        const ImDrawIdx* idx_buffer_offset = 0;
+        GLenum wait_result;
+        do
+        {
+            wait_result = glClientWaitSync(g_RingFences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        } while (wait_result == GL_TIMEOUT_EXPIRED);
+
+        glDeleteSync(g_RingFences[region]);
+        g_RingFences[region] = 0;
+    }
+
+    if (draw_data->TotalVtxCount > g_RingVtxCapacity || draw_data->TotalIdxCount > g_RingIdxCapacity)
+    {
+        ImGui_ImplGlfwGL3_CreateRingBuffers(
+            draw_data->TotalVtxCount > g_RingVtxCapacity * 2 ? draw_data->TotalVtxCount : g_RingVtxCapacity * 2,
+            draw_data->TotalIdxCount > g_RingIdxCapacity * 2 ? draw_data->TotalIdxCount : g_RingIdxCapacity * 2);
+    }
+
+    // Append all the draw lists to the region, so that the frame is uploaded in one go
+    const int region_vtx_start = region * g_RingVtxCapacity;
+    const int region_idx_start = region * g_RingIdxCapacity;
+    {
+        ImDrawVert* vtx_dst = g_RingVtxData + region_vtx_start;
+        ImDrawIdx* idx_dst = g_RingIdxData + region_idx_start;
+        for (int n = 0; n < draw_data->CmdListsCount; n++)
+        {
+            const ImDrawList* cmd_list = draw_data->CmdLists[n];
+            memcpy(vtx_dst, cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
+            memcpy(idx_dst, cmd_list->IdxBuffer.Data, cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx));
+            vtx_dst += cmd_list->VtxBuffer.Size;
+            idx_dst += cmd_list->IdxBuffer.Size;
+        }
+    }
 
-        glBindBuffer(GL_ARRAY_BUFFER, g_VboHandle);
-        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)cmd_list->VtxBuffer.Size * sizeof(ImDrawVert), (const GLvoid*)cmd_list->VtxBuffer.Data, GL_STREAM_DRAW);
+    // Texture and scissor as last set, so that the commands only change them when they differ
+    GLuint bound_texture = 0;
+    bool bound_texture_valid = false;
+    GLint scissor_box[4] = { 0, 0, 0, 0 };
+    bool scissor_box_valid = false;
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_ElementsHandle);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx), (const GLvoid*)cmd_list->IdxBuffer.Data, GL_STREAM_DRAW);
+    int vtx_offset = region_vtx_start;
+    int idx_offset = region_idx_start;
+    for (int n = 0; n < draw_data->CmdListsCount; n++)
+    {
+        const ImDrawList* cmd_list = draw_data->CmdLists[n];
 
         for (int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.Size; cmd_i++)
         {
@@ -102,32 +185,49 @@ void ImGui_ImplGlfwGL3_RenderDrawLists(ImDrawData* draw_data)
             if (pcmd->UserCallback)
             {
                 pcmd->UserCallback(cmd_list, pcmd);
+
+                // The callback might have changed anything
+                ImGui_ImplGlfwGL3_SetupRenderState(fb_width, fb_height);
+                bound_texture_valid = false;
+                scissor_box_valid = false;
             }
             else
             {
-                glBindTexture(GL_TEXTURE_2D, (GLuint)(intptr_t)pcmd->TextureId);
-                glScissor((int)pcmd->ClipRect.x, (int)(fb_height - pcmd->ClipRect.w), (int)(pcmd->ClipRect.z - pcmd->ClipRect.x), (int)(pcmd->ClipRect.w - pcmd->ClipRect.y));
-                glDrawElements(GL_TRIANGLES, (GLsizei)pcmd->ElemCount, sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, idx_buffer_offset);
+                const GLuint texture = (GLuint)(intptr_t)pcmd->TextureId;
+                if (!bound_texture_valid || texture != bound_texture)
+                {
+                    glBindTexture(GL_TEXTURE_2D, texture);
+                    bound_texture = texture;
+                    bound_texture_valid = true;
+                }
+
+                const GLint box[4] = { (int)pcmd->ClipRect.x, (int)(fb_height - pcmd->ClipRect.w), (int)(pcmd->ClipRect.z - pcmd->ClipRect.x), (int)(pcmd->ClipRect.w - pcmd->ClipRect.y) };
+                if (!scissor_box_valid || memcmp(box, scissor_box, sizeof(box)) != 0)
+                {
+                    glScissor(box[0], box[1], box[2], box[3]);
+                    memcpy(scissor_box, box, sizeof(box));
+                    scissor_box_valid = true;
+                }
+
+                glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)pcmd->ElemCount, sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, (const GLvoid*)(idx_offset * sizeof(ImDrawIdx)), vtx_offset);
             }
-            idx_buffer_offset += pcmd->ElemCount;
+            idx_offset += pcmd->ElemCount;
         }
+
+        vtx_offset += cmd_list->VtxBuffer.Size;
     }
 
-    // Restore modified GL state
-    glUseProgram(last_program);
-    glActiveTexture(last_active_texture);
-    glBindTexture(GL_TEXTURE_2D, last_texture);
-    glBindVertexArray(last_vertex_array);
-    glBindBuffer(GL_ARRAY_BUFFER, last_array_buffer);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, last_element_array_buffer);
-    glBlendEquationSeparate(last_blend_equation_rgb, last_blend_equation_alpha);
-    glBlendFunc(last_blend_src, last_blend_dst);
-    if (last_enable_blend) glEnable(GL_BLEND); else glDisable(GL_BLEND);
-    if (last_enable_cull_face) glEnable(GL_CULL_FACE); else glDisable(GL_CULL_FACE);
-    if (last_enable_depth_test) glEnable(GL_DEPTH_TEST); else glDisable(GL_DEPTH_TEST);
-    if (last_enable_scissor_test) glEnable(GL_SCISSOR_TEST); else glDisable(GL_SCISSOR_TEST);
-    glViewport(last_viewport[0], last_viewport[1], (GLsizei)last_viewport[2], (GLsizei)last_viewport[3]);
-    glScissor(last_scissor_box[0], last_scissor_box[1], (GLsizei)last_scissor_box[2], (GLsizei)last_scissor_box[3]);
+    g_RingFences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    g_RingFrame++;
+
+    // Leave the state as documented in the header
+    glUseProgram(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBlendFunc(GL_ONE, GL_ZERO);
+    glDisable(GL_BLEND);
+    glDisable(GL_SCISSOR_TEST);
 }
 
 static const char* ImGui_ImplGlfwGL3_GetClipboardText(void* user_data)
@@ -255,21 +355,14 @@ bool ImGui_ImplGlfwGL3_CreateDeviceObjects()
     g_AttribLocationUV = glGetAttribLocation(g_ShaderHandle, "UV");
     g_AttribLocationColor = glGetAttribLocation(g_ShaderHandle, "Color");
 
-    glGenBuffers(1, &g_VboHandle);
-    glGenBuffers(1, &g_ElementsHandle);
-
     glGenVertexArrays(1, &g_VaoHandle);
     glBindVertexArray(g_VaoHandle);
-    glBindBuffer(GL_ARRAY_BUFFER, g_VboHandle);
     glEnableVertexAttribArray(g_AttribLocationPosition);
     glEnableVertexAttribArray(g_AttribLocationUV);
     glEnableVertexAttribArray(g_AttribLocationColor);
 
-#define OFFSETOF(TYPE, ELEMENT) ((size_t)&(((TYPE *)0)->ELEMENT))
-    glVertexAttribPointer(g_AttribLocationPosition, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (GLvoid*)OFFSETOF(ImDrawVert, pos));
-    glVertexAttribPointer(g_AttribLocationUV, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (GLvoid*)OFFSETOF(ImDrawVert, uv));
-    glVertexAttribPointer(g_AttribLocationColor, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ImDrawVert), (GLvoid*)OFFSETOF(ImDrawVert, col));
-#undef OFFSETOF
+    // Grown on demand by the renderer
+    ImGui_ImplGlfwGL3_CreateRingBuffers(1 << 16, 3 << 16);
 
     ImGui_ImplGlfwGL3_CreateFontsTexture();
 
@@ -283,10 +376,9 @@ bool ImGui_ImplGlfwGL3_CreateDeviceObjects()
 
 void    ImGui_ImplGlfwGL3_InvalidateDeviceObjects()
 {
+    ImGui_ImplGlfwGL3_DestroyRingBuffers();
     if (g_VaoHandle) glDeleteVertexArrays(1, &g_VaoHandle);
-    if (g_VboHandle) glDeleteBuffers(1, &g_VboHandle);
-    if (g_ElementsHandle) glDeleteBuffers(1, &g_ElementsHandle);
-    g_VaoHandle = g_VboHandle = g_ElementsHandle = 0;
+    g_VaoHandle = 0;
 
     if (g_ShaderHandle && g_VertHandle) glDetachShader(g_ShaderHandle, g_VertHandle);
     if (g_VertHandle) glDeleteShader(g_VertHandle);
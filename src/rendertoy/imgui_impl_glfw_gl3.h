@@ -6,6 +6,10 @@
 // If you are new to ImGui, see examples/README.txt and documentation at the top of imgui.cpp.
 // https://github.com/ocornut/imgui
 
+// Unlike the stock binding, rendering doesn't back up and restore GL state. It leaves the program, texture (on unit 0),
+// vertex array and array buffer bindings at 0, blending (with the default func) and scissor test disabled, and the viewport
+// set to the whole framebuffer. Requires GL 4.4 for persistently mapped buffers.
+
 struct GLFWwindow;
 
 IMGUI_API bool        ImGui_ImplGlfwGL3_Init(GLFWwindow* window, bool install_callbacks);
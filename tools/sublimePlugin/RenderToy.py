@@ -1,8 +1,14 @@
 import sublime, sublime_plugin
 import functools
 import html
+import json
+import os
 import os.path
 import re
+import socket
+import tempfile
+import threading
+import time
 
 pluginInstances = []
 
@@ -10,6 +16,103 @@ def plugin_unloaded():
     global pluginInstances
     for i in range(len(pluginInstances)):
         pluginInstances[i].shouldUnload = True
+    editorLink.close()
+
+# Must match EditorLink::getDefaultSocketPath
+def editorLinkPath():
+    if os.name == 'nt':
+        return os.path.join(tempfile.gettempdir(), 'rendertoy.sock')
+    return os.path.join(os.environ.get('TMPDIR') or '/tmp', 'rendertoy.sock')
+
+# Streams unsaved buffers to RenderToy and receives the compile errors, see EditorLink.h.
+# Where Python has no AF_UNIX (e.g. on Windows), or RenderToy isn't running,
+# the .errors files written next to the shaders are used instead.
+class EditorLink:
+    reconnectInterval = 2.0
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.sock = None
+        self.nextId = 1
+        self.lastConnectAttempt = 0
+        self.listeners = {}
+
+    def connected(self):
+        return self.sock is not None
+
+    def connect(self):
+        if not hasattr(socket, 'AF_UNIX'):
+            return None
+        now = time.time()
+        if now - self.lastConnectAttempt < self.reconnectInterval:
+            return None
+        self.lastConnectAttempt = now
+
+        s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        try:
+            s.connect(editorLinkPath())
+        except OSError:
+            s.close()
+            return None
+
+        self.sock = s
+        threading.Thread(target=self.receive, args=(s,), daemon=True).start()
+        return s
+
+    # Returns the id of the message, or None if it couldn't be sent
+    def send(self, message):
+        with self.lock:
+            s = self.sock or self.connect()
+            if not s:
+                return None
+
+            message['id'] = self.nextId
+            self.nextId += 1
+            try:
+                s.sendall((json.dumps(message) + '\n').encode('utf-8'))
+            except OSError:
+                self.disconnect(s)
+                return None
+            return message['id']
+
+    def receive(self, s):
+        received = b''
+        while True:
+            try:
+                data = s.recv(65536)
+            except OSError:
+                data = b''
+            if not data:
+                break
+
+            received += data
+            while b'\n' in received:
+                line, received = received.split(b'\n', 1)
+                try:
+                    message = json.loads(line.decode('utf-8'))
+                except ValueError:
+                    continue
+                listener = self.listeners.get(message.get('path'))
+                if listener:
+                    sublime.set_timeout(functools.partial(listener, message), 0)
+
+        with self.lock:
+            self.disconnect(s)
+
+    def disconnect(self, s):
+        if self.sock is s:
+            self.sock = None
+        try:
+            s.close()
+        except OSError:
+            pass
+
+    def close(self):
+        with self.lock:
+            if self.sock:
+                self.disconnect(self.sock)
+
+editorLink = EditorLink()
   
 class RenderToy(sublime_plugin.ViewEventListener):  
     show_errors_inline = True
@@ -70,7 +173,45 @@ class RenderToy(sublime_plugin.ViewEventListener):
     def on_phantom_navigate(self, url):
         self.hide_phantoms()
 
+    def pushSource(self, changeCount):
+        if changeCount != self.changeCount or self.shouldUnload:
+            return
+        source = self.view.substr(sublime.Region(0, self.view.size()))
+        messageId = editorLink.send({'type': 'source', 'path': self.view.file_name(), 'source': source})
+        if messageId:
+            self.lastMessageId = messageId
+
+    def onLinkMessage(self, message):
+        # Replies to older buffers can still arrive while typing
+        if message.get('id') != self.lastMessageId or self.shouldUnload:
+            return
+
+        self.errors = {}
+        for e in message.get('errors', []):
+            line = max(e['line'], 1)
+            self.errors.setdefault(line, []).append((e['column'], e['message']))
+        self.update_phantoms()
+
+    def on_modified_async(self):
+        if not self.enabled:
+            return
+        self.changeCount += 1
+        sublime.set_timeout_async(functools.partial(self.pushSource, self.changeCount), 100)
+
+    def on_close(self):
+        if not self.enabled:
+            return
+        path = self.view.file_name()
+        if self.view.is_dirty():
+            editorLink.send({'type': 'revert', 'path': path})
+        if editorLink.listeners.get(path) == self.onLinkMessage:
+            del editorLink.listeners[path]
+
     def onUpdate(self):
+        # While the buffer differs from the file, the errors come from the link
+        if self.lastMessageId and self.view.is_dirty() and editorLink.connected():
+            return
+
         errorsFilePath = self.view.file_name() + '.errors'
 
         if not os.path.isfile(errorsFilePath):
@@ -112,12 +253,17 @@ class RenderToy(sublime_plugin.ViewEventListener):
             sublime.set_timeout(functools.partial(self.handleTimeout, self.view), 250)
 
     def __init__(self, view):
+        self.view = view
+        self.enabled = False
         fname = view.file_name()
         if fname and fname[-5:] == '.glsl':
             global pluginInstances
             pluginInstances.append(self)
+            self.enabled = True
             self.shouldUnload = False
-            self.view = view
             self.prevMtime = 0
+            self.changeCount = 0
+            self.lastMessageId = None
+            editorLink.listeners[fname] = self.onLinkMessage
             self.errorRe = re.compile(r'ERROR: (.+):(\d+): (.*)')
             self.handleTimeout(self.view)
@@ -70,9 +70,24 @@ local rendertoy = Program {
 			"comdlg32.lib",
 			"gdi32.lib",
 			"opengl32.lib",
+			"ws2_32.lib",
 			Config = {"win*"}
 		},
 	},
 }
 
+-- Random edits of the node graph checked against a reference model, then timed at a range of
+-- graph sizes. Needs neither GL nor a window: tundra2 nodegraph_stress
+local nodegraph_stress = Program {
+	Name = "nodegraph_stress",
+	Includes = {
+		"src/rendertoy",
+	},
+	Sources = {
+		"src/rendertoy/NodeGraph.cpp",
+		"src/nodegraph_stress/BaselineGraph.cpp",
+		"src/nodegraph_stress/NodeGraphStress.cpp",
+	},
+}
+
 Default(rendertoy)